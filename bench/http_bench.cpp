@@ -0,0 +1,708 @@
+// HTTP/1.1 load generator: every thread drives its share of connections from its own epoll loop.
+// Latency is recorded into log-linear (HDR-style) histograms and corrected for coordinated omission:
+// at fixed rate (-R) it is measured from the time request was scheduled to be sent rather than from the time it was actually sent,
+// in closed loop (no -R) missing samples are back-filled after the run with mean latency as expected interval between requests.
+// Usage: http_bench [-h host] [-p port] [-c connections] [-t threads] [-d seconds] [-D pipeline_depth] [-k 0|1] [-R requests_per_sec]
+//                   [-u url_file | -s]
+// URL file lists one path per line optionally followed by integer weight ('#' starts a comment),
+// '-s' replays assets requested by the browser on the home page of the 'test/' site.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char *c_site_preset[] = {
+    "/index.html",
+    "/css/bootstrap.min.css",
+    "/css/styles.css",
+    "/js/jquery-2.1.4.min.js",
+    "/js/bootstrap.min.js",
+    "/js/ajax-utils.js",
+    "/js/script.js",
+    "/snippets/home-snippet.html",
+    "/images/star-k-logo.png",
+    "/images/restaurant-logo_large.png",
+    "/images/jumbotron_1200.jpg",
+    "/images/menu-tile.jpg",
+    "/images/specials-tile.jpg",
+    "/fonts/glyphicons-halflings-regular.woff2",
+};
+
+int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+//
+
+// Log-linear histogram of microseconds: values below 128 are exact, above that every octave is split into 64 buckets (error < 1.6%).
+class Histogram
+{
+public:
+    Histogram();
+
+    void Record(uint64_t us, uint64_t count = 1);
+    void Merge(const Histogram &other);
+    Histogram CorrectedCopy(uint64_t expected_interval_us) const; // back-fills samples omitted while a request was stalled
+
+    uint64_t Count() const { return total; }
+    uint64_t Max() const { return max; }
+    double Mean() const;
+    uint64_t Percentile(double p) const;
+
+private:
+    static const int c_sub_bits = 7;
+    static const int c_half = 1 << (c_sub_bits - 1);
+    static const int c_octaves = 40;
+
+    static int Index(uint64_t v);
+    static uint64_t Lowest(int idx);
+    static uint64_t Median(int idx);
+
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t max;
+};
+
+Histogram::Histogram()
+    : counts((1 << c_sub_bits) + c_octaves * c_half, 0)
+    , total(0)
+    , max(0)
+{
+}
+
+int Histogram::Index(uint64_t v)
+{
+    if (v < (1u << c_sub_bits)) {
+        return v;
+    }
+    const int shift = 63 - __builtin_clzll(v) - (c_sub_bits - 1);
+    const int idx = (1 << c_sub_bits) + (shift - 1) * c_half + int((v >> shift) - c_half);
+    return std::min(idx, (1 << c_sub_bits) + c_octaves * c_half - 1);
+}
+
+uint64_t Histogram::Lowest(int idx)
+{
+    if (idx < (1 << c_sub_bits)) {
+        return idx;
+    }
+    const int shift = (idx - (1 << c_sub_bits)) / c_half + 1;
+    return uint64_t(c_half + (idx - (1 << c_sub_bits)) % c_half) << shift;
+}
+
+uint64_t Histogram::Median(int idx)
+{
+    return (Lowest(idx) + Lowest(idx + 1)) / 2;
+}
+
+void Histogram::Record(uint64_t us, uint64_t count)
+{
+    counts[Index(us)] += count;
+    total += count;
+    max = std::max(max, us);
+}
+
+void Histogram::Merge(const Histogram &other)
+{
+    for (size_t i = 0; i < counts.size(); ++i) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+    max = std::max(max, other.max);
+}
+
+Histogram Histogram::CorrectedCopy(uint64_t expected_interval_us) const
+{
+    Histogram res;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (!counts[i]) {
+            continue;
+        }
+        const uint64_t v = (int(i) == Index(max)) ? max : Median(i);
+        res.Record(v, counts[i]);
+        if (expected_interval_us == 0) {
+            continue;
+        }
+        for (uint64_t missing = v - std::min(v, expected_interval_us); missing >= expected_interval_us; missing -= expected_interval_us) {
+            res.Record(missing, counts[i]);
+        }
+    }
+    return res;
+}
+
+double Histogram::Mean() const
+{
+    if (!total) {
+        return 0;
+    }
+    double sum = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        sum += double(counts[i]) * Median(i);
+    }
+    return sum / total;
+}
+
+uint64_t Histogram::Percentile(double p) const
+{
+    if (!total) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(p / 100 * total)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(max, Median(i));
+        }
+    }
+    return max;
+}
+
+//
+
+struct Config
+{
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    int connections = 64;
+    int threads = 2;
+    int duration_s = 10;
+    int depth = 1;
+    bool keep_alive = true;
+    double rate = 0; // requests per second over all connections, '0' for closed loop
+    std::vector<std::string> urls;
+    std::vector<unsigned> weights;
+};
+
+struct Result
+{
+    Histogram corrected;
+    Histogram raw;
+    uint64_t requests = 0;
+    uint64_t bytes = 0;
+    uint64_t connect_errors = 0;
+    uint64_t read_errors = 0;
+    uint64_t bad_status = 0;
+};
+
+//
+
+struct Conn
+{
+    int fd = -1;
+    bool connecting = false;
+    std::string out;       // request bytes not yet written
+    size_t out_pos = 0;
+    std::deque<std::pair<int64_t, int64_t>> in_flight; // (scheduled, actually sent) time of each pending request
+    std::string head;      // partially received response head
+    size_t body_left = 0;  // bytes of current response body still to be skipped
+    bool in_body = false;
+    bool close_after = false;
+    int status = 0;
+    unsigned sent_on_socket = 0;
+    int64_t next_due = 0;  // fixed rate only
+};
+
+class Client
+{
+public:
+    Client(const Config &_cfg, const addrinfo &_addr, int _conns, int64_t _start, int64_t _end, Result &_res);
+    ~Client();
+
+    void Run();
+
+private:
+    bool CanIssue(const Conn &c, int64_t now) const;
+    void Pump(Conn &c, int64_t now);
+    void Connect(Conn &c);
+    void Close(Conn &c);
+    void Fail(Conn &c, uint64_t &counter);
+    void Flush(Conn &c);
+    void Read(Conn &c);
+    bool Consume(Conn &c, const char *data, size_t len); // 'false' if connection is to be dropped
+    void Complete(Conn &c);
+    const std::string &PickRequest();
+    void ArmTimer(int64_t now);
+
+    const Config &cfg;
+    const addrinfo &addr;
+    std::vector<Conn> conns;
+    std::vector<std::string> requests; // prebuilt request per URL
+    std::vector<unsigned> cumulative;  // cumulative weights of 'requests'
+    uint64_t rng;
+    int64_t interval;                  // per connection, fixed rate only
+    int64_t start;
+    int64_t end;
+    int epfd;
+    int tfd;
+    Result &res;
+};
+
+Client::Client(const Config &_cfg, const addrinfo &_addr, int _conns, int64_t _start, int64_t _end, Result &_res)
+    : cfg(_cfg)
+    , addr(_addr)
+    , conns(_conns)
+    , rng(0x9e3779b97f4a7c15ull ^ uint64_t(uintptr_t(&_res)) ^ uint64_t(NowNs()))
+    , interval(cfg.rate > 0 ? int64_t(1e9 * cfg.connections / cfg.rate) : 0)
+    , start(_start)
+    , end(_end)
+    , epfd(epoll_create1(EPOLL_CLOEXEC))
+    , tfd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC))
+    , res(_res)
+{
+    unsigned sum = 0;
+    for (size_t i = 0; i < cfg.urls.size(); ++i) {
+        std::string req = "GET " + cfg.urls[i] + " HTTP/1.1\r\nHost: " + cfg.host + ":" + cfg.port + "\r\n";
+        if (!cfg.keep_alive) {
+            req += "Connection: close\r\n";
+        }
+        requests.push_back(req + "\r\n");
+        cumulative.push_back(sum += cfg.weights[i]);
+    }
+    for (size_t i = 0; i < conns.size(); ++i) {
+        conns[i].next_due = start + (interval ? interval * int64_t(i) / int64_t(conns.size()) : 0); // spread connections over the interval
+    }
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = UINT64_MAX;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+}
+
+Client::~Client()
+{
+    for (auto &c : conns) {
+        Close(c);
+    }
+    close(tfd);
+    close(epfd);
+}
+
+const std::string &Client::PickRequest()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    const unsigned r = rng % cumulative.back();
+    return requests[std::upper_bound(cumulative.begin(), cumulative.end(), r) - cumulative.begin()];
+}
+
+bool Client::CanIssue(const Conn &c, int64_t now) const
+{
+    if (int(c.in_flight.size()) >= cfg.depth || c.close_after) {
+        return false;
+    }
+    if (!cfg.keep_alive && c.sent_on_socket > 0) {
+        return false;
+    }
+    return !interval || c.next_due <= now;
+}
+
+void Client::Pump(Conn &c, int64_t now)
+{
+    bool issued = false;
+    while (now < end && CanIssue(c, now)) {
+        if (c.fd < 0) {
+            Connect(c);
+            if (c.fd < 0) {
+                return;
+            }
+        }
+        const int64_t scheduled = interval ? c.next_due : now;
+        c.in_flight.emplace_back(scheduled, now);
+        c.out += PickRequest();
+        ++c.sent_on_socket;
+        c.next_due += interval;
+        issued = true;
+    }
+    if (issued && !c.connecting) {
+        Flush(c);
+    }
+}
+
+void Client::Connect(Conn &c)
+{
+    c.fd = socket(addr.ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c.fd < 0) {
+        ++res.connect_errors;
+        return;
+    }
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(c.fd, addr.ai_addr, addr.ai_addrlen) < 0 && errno != EINPROGRESS) {
+        close(c.fd);
+        c.fd = -1;
+        ++res.connect_errors;
+        return;
+    }
+    c.connecting = true;
+    epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u64 = &c - conns.data();
+    epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+}
+
+void Client::Close(Conn &c)
+{
+    if (c.fd >= 0) {
+        close(c.fd);
+    }
+    c.fd = -1;
+    c.connecting = false;
+    c.out.clear();
+    c.out_pos = 0;
+    c.in_flight.clear();
+    c.head.clear();
+    c.body_left = 0;
+    c.in_body = false;
+    c.close_after = false;
+    c.sent_on_socket = 0;
+}
+
+void Client::Fail(Conn &c, uint64_t &counter)
+{
+    counter += std::max<size_t>(1, c.in_flight.size());
+    Close(c);
+}
+
+void Client::Flush(Conn &c)
+{
+    while (c.out_pos < c.out.size()) {
+        const ssize_t n = send(c.fd, c.out.data() + c.out_pos, c.out.size() - c.out_pos, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                Fail(c, res.read_errors);
+            }
+            return;
+        }
+        c.out_pos += n;
+    }
+    c.out.clear();
+    c.out_pos = 0;
+}
+
+void Client::Read(Conn &c)
+{
+    char buf[64 * 1024];
+    for (;;) {
+        const ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            res.bytes += n;
+            if (!Consume(c, buf, n)) {
+                return;
+            }
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (c.in_flight.empty() && !c.in_body) {
+            Close(c); // server closed idle connection, reopen on next request
+        } else {
+            Fail(c, res.read_errors);
+        }
+        return;
+    }
+}
+
+bool Client::Consume(Conn &c, const char *data, size_t len)
+{
+    while (len > 0) {
+        if (c.in_body) {
+            const size_t n = std::min(len, c.body_left);
+            c.body_left -= n;
+            data += n;
+            len -= n;
+            if (c.body_left == 0) {
+                Complete(c);
+                if (c.fd < 0) {
+                    return false;
+                }
+            }
+            continue;
+        }
+        if (c.in_flight.empty()) {
+            Fail(c, res.read_errors); // unsolicited bytes
+            return false;
+        }
+        const size_t old = c.head.size();
+        c.head.append(data, len);
+        const size_t end_of_head = c.head.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+        if (end_of_head == std::string::npos) {
+            if (c.head.size() > 64 * 1024) {
+                Fail(c, res.read_errors);
+                return false;
+            }
+            return true;
+        }
+        const size_t head_len = end_of_head + 4;
+        c.status = (c.head.size() > 12 && c.head.compare(0, 5, "HTTP/") == 0) ? std::atoi(c.head.c_str() + 9) : 0;
+        c.body_left = 0;
+        std::istringstream lines(c.head.substr(0, end_of_head));
+        std::string line;
+        while (std::getline(lines, line)) {
+            const size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            const std::string name = line.substr(0, colon);
+            if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+                c.body_left = std::strtoull(line.c_str() + colon + 1, nullptr, 10);
+            } else if (strcasecmp(name.c_str(), "Connection") == 0 && line.find("close") != std::string::npos) {
+                c.close_after = true;
+            }
+        }
+        const size_t rest = c.head.size() - head_len; // bytes past the head, they came from 'data'
+        data += len - rest;
+        len = rest;
+        c.head.clear();
+        c.in_body = true;
+        if (c.body_left == 0) {
+            c.in_body = false;
+            Complete(c);
+            if (c.fd < 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Client::Complete(Conn &c)
+{
+    const int64_t now = NowNs();
+    const auto times = c.in_flight.front();
+    c.in_flight.pop_front();
+    c.in_body = false;
+    if (now <= end) {
+        ++res.requests;
+        res.corrected.Record(std::max<int64_t>(0, now - times.first) / 1000);
+        res.raw.Record(std::max<int64_t>(0, now - times.second) / 1000);
+        if (c.status < 200 || c.status >= 400) {
+            ++res.bad_status;
+        }
+    }
+    if ((c.close_after || !cfg.keep_alive) && c.in_flight.empty()) {
+        Close(c);
+    }
+}
+
+void Client::ArmTimer(int64_t now)
+{
+    int64_t due = end;
+    for (const auto &c : conns) {
+        if (c.fd < 0 || CanIssue(c, INT64_MAX)) {
+            due = std::min(due, c.next_due);
+        }
+    }
+    itimerspec ts = {}; // steady clock is CLOCK_MONOTONIC on Linux
+    const int64_t at = std::max(due, now + 1000);
+    ts.it_value.tv_sec = at / 1000000000;
+    ts.it_value.tv_nsec = at % 1000000000;
+    timerfd_settime(tfd, TFD_TIMER_ABSTIME, &ts, nullptr);
+}
+
+void Client::Run()
+{
+    epoll_event events[256];
+    for (int64_t now = NowNs(); now < end; now = NowNs()) {
+        for (auto &c : conns) {
+            Pump(c, now);
+        }
+        if (interval) {
+            ArmTimer(now);
+        }
+        const int timeout_ms = int(std::min<int64_t>((end - now) / 1000000 + 1, 100));
+        const int n = epoll_wait(epfd, events, 256, interval ? -1 : timeout_ms);
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.u64 == UINT64_MAX) {
+                uint64_t expirations;
+                (void)!read(tfd, &expirations, sizeof(expirations));
+                continue;
+            }
+            Conn &c = conns[events[i].data.u64];
+            if (c.fd < 0) {
+                continue;
+            }
+            if (c.connecting && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err || (events[i].events & EPOLLERR)) {
+                    Fail(c, res.connect_errors);
+                    continue;
+                }
+                c.connecting = false;
+            }
+            if (events[i].events & EPOLLOUT) {
+                Flush(c);
+            }
+            if (c.fd >= 0 && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                Read(c);
+            }
+        }
+    }
+}
+
+//
+
+bool LoadUrls(const std::string &path, Config &cfg)
+{
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string url;
+        unsigned weight = 1;
+        if (!(fields >> url)) {
+            continue;
+        }
+        fields >> weight;
+        if (weight > 0) {
+            cfg.urls.push_back(url);
+            cfg.weights.push_back(weight);
+        }
+    }
+    return !cfg.urls.empty();
+}
+
+void PrintLatency(const char *name, const Histogram &h)
+{
+    std::printf("  %-12s %10.0f %10llu %10llu %10llu %10llu %10llu\n", name, h.Mean(),
+                (unsigned long long)h.Percentile(50), (unsigned long long)h.Percentile(90),
+                (unsigned long long)h.Percentile(99), (unsigned long long)h.Percentile(99.9),
+                (unsigned long long)h.Max());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Config cfg;
+    std::string url_file;
+    bool site = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:t:d:D:k:R:u:s")) != -1) {
+        switch (opt) {
+        case 'h': cfg.host = optarg;                        break;
+        case 'p': cfg.port = optarg;                        break;
+        case 'c': cfg.connections = std::atoi(optarg);      break;
+        case 't': cfg.threads = std::atoi(optarg);          break;
+        case 'd': cfg.duration_s = std::atoi(optarg);       break;
+        case 'D': cfg.depth = std::atoi(optarg);            break;
+        case 'k': cfg.keep_alive = std::atoi(optarg) != 0;  break;
+        case 'R': cfg.rate = std::atof(optarg);             break;
+        case 'u': url_file = optarg;                        break;
+        case 's': site = true;                              break;
+        default:
+            std::fprintf(stderr, "usage: %s [-h host] [-p port] [-c connections] [-t threads] [-d seconds] [-D depth] [-k 0|1] [-R rate] [-u url_file | -s]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (site) {
+        for (auto url : c_site_preset) {
+            cfg.urls.push_back(url);
+            cfg.weights.push_back(1);
+        }
+    } else if (!url_file.empty()) {
+        if (!LoadUrls(url_file, cfg)) {
+            std::fprintf(stderr, "no URLs in %s\n", url_file.c_str());
+            return 1;
+        }
+    } else {
+        cfg.urls.push_back("/index.html");
+        cfg.weights.push_back(1);
+    }
+    if (!cfg.keep_alive) {
+        cfg.depth = 1;
+    }
+    cfg.connections = std::max(1, cfg.connections);
+    cfg.threads = std::max(1, std::min(cfg.threads, cfg.connections));
+    cfg.depth = std::max(1, cfg.depth);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addr = nullptr;
+    if (getaddrinfo(cfg.host.c_str(), cfg.port.c_str(), &hints, &addr) != 0 || !addr) {
+        std::fprintf(stderr, "cannot resolve %s:%s\n", cfg.host.c_str(), cfg.port.c_str());
+        return 1;
+    }
+
+    std::printf("%d s @ %s:%s, %zu URL(s), %d threads, %d connections, pipeline depth %d, keep-alive %s, ",
+                cfg.duration_s, cfg.host.c_str(), cfg.port.c_str(), cfg.urls.size(), cfg.threads, cfg.connections, cfg.depth,
+                cfg.keep_alive ? "on" : "off");
+    if (cfg.rate > 0) {
+        std::printf("fixed rate %.0f req/s\n", cfg.rate);
+    } else {
+        std::printf("closed loop\n");
+    }
+
+    const int64_t start = NowNs();
+    const int64_t end = start + int64_t(cfg.duration_s) * 1000000000;
+    std::vector<Result> results(cfg.threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < cfg.threads; ++t) {
+        const int n = cfg.connections / cfg.threads + (t < cfg.connections % cfg.threads);
+        threads.emplace_back([&, t, n] {
+            Client(cfg, *addr, n, start, end, results[t]).Run();
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    const double elapsed = double(std::max<int64_t>(NowNs(), end) - start) / 1e9;
+    freeaddrinfo(addr);
+
+    Result total;
+    for (const auto &r : results) {
+        total.corrected.Merge(r.corrected);
+        total.raw.Merge(r.raw);
+        total.requests += r.requests;
+        total.bytes += r.bytes;
+        total.connect_errors += r.connect_errors;
+        total.read_errors += r.read_errors;
+        total.bad_status += r.bad_status;
+    }
+    // in closed loop every pipeline slot sends next request as soon as previous one completes, so mean latency is the expected interval
+    const Histogram corrected = cfg.rate > 0 ? total.corrected : total.raw.CorrectedCopy(uint64_t(total.raw.Mean()));
+
+    std::printf("  %llu requests in %.2f s, %.1f MB read\n", (unsigned long long)total.requests, elapsed, total.bytes / 1e6);
+    std::printf("  Requests/sec: %.0f\n", total.requests / elapsed);
+    std::printf("  Transfer/sec: %.2f MB\n", total.bytes / 1e6 / elapsed);
+    std::printf("  Errors: connect %llu, read %llu, status %llu\n", (unsigned long long)total.connect_errors,
+                (unsigned long long)total.read_errors, (unsigned long long)total.bad_status);
+    std::printf("  Latency, us %10s %10s %10s %10s %10s %10s\n", "mean", "p50", "p90", "p99", "p99.9", "max");
+    PrintLatency("corrected", corrected);
+    PrintLatency("uncorrected", total.raw);
+    return 0;
+}
@@ -0,0 +1,486 @@
+// Micro-benchmarks of the components on the server's hot path, each exercised in isolation over socketpairs or in memory.
+// Every benchmark is calibrated to run for at least the given time per repetition, warmed up and then repeated,
+// nanoseconds per operation (median, min, max, mean, stddev over repetitions) are written as JSON to compare builds.
+// Usage: micro_bench [-f name_filter] [-w warmup_ms] [-t min_ms_per_repetition] [-r repetitions] [-n ops_per_repetition] [-o json_file] [-l]
+
+#include "../src/http_parser.h"
+#include "../src/http_response.h"
+#include "../src/file_cache.h"
+#include "../src/doc_index.h"
+#include "../src/message_queue.h"
+#include "../src/ring_queue.h"
+#include "../src/worker_pool.h"
+#include "../src/io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Runner = std::function<void(uint64_t ops)>; // performs given number of operations
+
+const char *c_request =
+    "GET /images/menu/B/B12.jpg HTTP/1.1\r\n"
+    "Host: 127.0.0.1:12345\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+    "Referer: http://127.0.0.1:12345/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-US,en;q=0.9,de;q=0.8\r\n"
+    "\r\n";
+
+const int c_pipeline_depth = 16;
+const int c_producers = 4;
+const int c_pool_size = 4;
+
+const char *c_site_files[] = {
+    "test/index.html",
+    "test/css/bootstrap.min.css",
+    "test/css/styles.css",
+    "test/js/jquery-2.1.4.min.js",
+    "test/js/script.js",
+    "test/snippets/home-snippet.html",
+    "test/images/star-k-logo.png",
+    "test/images/jumbotron_1200.jpg",
+    "test/images/menu/B/B12.jpg",
+    "test/fonts/glyphicons-halflings-regular.woff2",
+};
+
+struct Benchmark
+{
+    const char *name;
+    std::function<Runner()> setup; // state lives in the returned runner, so it's released once benchmark is done
+};
+
+struct SocketPair
+{
+    int fds[2];
+
+    SocketPair();
+    ~SocketPair();
+};
+
+SocketPair::SocketPair()
+{
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0) {
+        perror("socketpair");
+        exit(1);
+    }
+}
+
+SocketPair::~SocketPair()
+{
+    close(fds[1]);
+}
+
+Http::Parser::Limits DefaultLimits()
+{
+    Http::Parser::Limits limits;
+    limits.max_request_line = 8192;
+    limits.max_headers = 100;
+    limits.max_head_bytes = 16384;
+    return limits;
+}
+
+// batches of pipelined requests are written to the peer, read by 'BufReader' and handed to 'on_request' one by one
+Runner PipelinedReads(std::function<size_t(const char *buf, size_t len)> on_request)
+{
+    auto sp = std::make_shared<SocketPair>();
+    auto r = std::make_shared<IO::BufReader>(IO::Socket(sp->fds[0]));
+    std::string batch;
+    for (int i = 0; i < c_pipeline_depth; ++i) {
+        batch += c_request;
+    }
+    return [sp, r, batch, on_request](uint64_t ops) {
+        for (uint64_t done = 0; done < ops; ) {
+            if (write(sp->fds[1], batch.data(), batch.size()) != ssize_t(batch.size())) {
+                perror("write");
+                exit(1);
+            }
+            while (r->Size() < batch.size()) {
+                r->Fill();
+            }
+            for (int i = 0; i < c_pipeline_depth; ++i, ++done) {
+                r->Consume(on_request(r->Data(), r->Size()));
+            }
+        }
+    };
+}
+
+template <typename Queue>
+Runner Contention()
+{
+    return [](uint64_t ops) {
+        Queue q(1024);
+        const uint64_t per_producer = std::max<uint64_t>(1, ops / c_producers);
+        std::vector<std::thread> threads;
+        for (int p = 0; p < c_producers; ++p) {
+            threads.emplace_back([&q, per_producer]() {
+                for (uint64_t i = 0; i < per_producer; ++i) {
+                    size_t msg = i;
+                    while (!q.Send(std::move(msg))) { // full
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (uint64_t i = 0; i < per_producer * c_producers; ++i) {
+            q.Receive();
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+    };
+}
+
+struct CountingTask : Concurrent::ITask
+{
+    std::atomic<uint64_t> &done;
+
+    explicit CountingTask(std::atomic<uint64_t> &_done);
+
+    void Perform() override;
+};
+
+CountingTask::CountingTask(std::atomic<uint64_t> &_done)
+    : done(_done)
+{
+}
+
+void CountingTask::Perform()
+{
+    done.fetch_add(1, std::memory_order_relaxed);
+}
+
+struct Pool
+{
+    Concurrent::RoundRobinWorkerPool pool;
+    std::atomic<uint64_t> done;
+
+    Pool();
+    ~Pool();
+};
+
+Pool::Pool()
+    : pool(c_pool_size)
+    , done(0)
+{
+    pool.Start();
+}
+
+Pool::~Pool()
+{
+    pool.Quit();
+    pool.Wait();
+}
+
+std::vector<Benchmark> Benchmarks()
+{
+    std::vector<Benchmark> res;
+
+    res.push_back({"buf_reader/fill_consume", []() {
+        return PipelinedReads([](const char *, size_t) {
+            return strlen(c_request);
+        });
+    }});
+
+    res.push_back({"parser/pipelined_request", []() {
+        auto parser = std::make_shared<Http::Parser>(DefaultLimits());
+        return PipelinedReads([parser](const char *buf, size_t len) {
+            parser->Reset();
+            if (parser->Parse(buf, len) != Http::Parser::Complete) {
+                fprintf(stderr, "parse failed\n");
+                exit(1);
+            }
+            // what request keeps of the connection buffer once it's dispatched
+            std::string raw(buf, parser->Head().head_len);
+            Http::RequestHead head(parser->Head());
+            return raw.size() + head.content_len;
+        });
+    }});
+
+    res.push_back({"file_metadata/mime_type", []() -> Runner {
+        return [](uint64_t ops) {
+            size_t sum = 0;
+            for (uint64_t i = 0; i < ops; ++i) {
+                sum += Http::FileMetaData(c_site_files[i % (sizeof(c_site_files) / sizeof(*c_site_files))]).mime_type[0];
+            }
+            if (sum == 0) {
+                fprintf(stderr, "unexpected\n");
+            }
+        };
+    }});
+
+    res.push_back({"file_cache/find_hit", []() -> Runner {
+        auto cache = std::make_shared<Http::FileCache>(32 << 20);
+        struct stat st = {};
+        st.st_ino = 1;
+        st.st_size = 4096;
+        std::vector<std::string> paths;
+        for (auto f : c_site_files) {
+            paths.push_back(std::string("/srv/www/") + f);
+            std::shared_ptr<Http::FileCache::Entry> e(new Http::FileCache::Entry(st, Http::FileMetaData(f).mime_type));
+            e->response = Http::Response::Header("200 OK", e->mime_type, st.st_size) + std::string(st.st_size, 'x');
+            e->header_len = e->response.size() - st.st_size;
+            cache->Insert(paths.back(), e);
+        }
+        return [cache, paths, st](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; ++i) {
+                if (!cache->Find(paths[i % paths.size()], st)) {
+                    fprintf(stderr, "cache miss\n");
+                    exit(1);
+                }
+            }
+        };
+    }});
+
+    res.push_back({"doc_index/find_hit", []() -> Runner {
+        auto index = std::make_shared<Http::DocIndex>("test", false);
+        std::vector<std::string> paths;
+        for (auto f : c_site_files) {
+            paths.push_back(std::string(f).substr(strlen("test")));
+        }
+        return [index, paths](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; ++i) {
+                if (!index->Find(paths[i % paths.size()])) {
+                    fprintf(stderr, "index miss (run from the repository root)\n");
+                    exit(1);
+                }
+            }
+        };
+    }});
+
+    res.push_back({"message_queue/4_producers", []() {
+        return Contention<Concurrent::MessageQueue<size_t>>();
+    }});
+
+    res.push_back({"mpsc_queue/4_producers", []() {
+        return Contention<Concurrent::MpscQueue<size_t>>();
+    }});
+
+    res.push_back({"round_robin_pool/submit_task", []() -> Runner {
+        auto p = std::make_shared<Pool>();
+        return [p](uint64_t ops) {
+            const uint64_t target = p->done.load() + ops;
+            for (uint64_t i = 0; i < ops; ++i) {
+                p->pool.SubmitTask(std::unique_ptr<Concurrent::ITask>(new CountingTask(p->done)));
+            }
+            while (p->done.load() < target) {
+                std::this_thread::yield();
+            }
+        };
+    }});
+
+    res.push_back({"response/header", []() -> Runner {
+        return [](uint64_t ops) {
+            size_t sum = 0;
+            for (uint64_t i = 0; i < ops; ++i) {
+                sum += Http::Response::Header("200 OK", "text/html", 4096 + i % 1024).size();
+            }
+            if (sum == 0) {
+                fprintf(stderr, "unexpected\n");
+            }
+        };
+    }});
+
+    res.push_back({"response/send", []() -> Runner {
+        auto sp = std::make_shared<SocketPair>();
+        auto out = std::make_shared<IO::OutQueue>(IO::Socket(sp->fds[0]), size_t(1) << 20);
+        out->Defer(); // drained in memory below instead of being written to the socket
+        const std::string body(512, 'x');
+        return [sp, out, body](uint64_t ops) {
+            IO::OutQueue::WriteOp op;
+            for (uint64_t i = 0; i < ops; ++i) {
+                out->BeginResponse();
+                Http::Response::Send(*out, "200 OK", "text/html", body.size(), body);
+                out->EndResponse();
+                while (out->NextWrite(op)) {
+                    out->Written(op.len);
+                }
+            }
+        };
+    }});
+
+    res.push_back({"logger/log", []() -> Runner {
+        IO::LogConfig cfg;
+        cfg.overflow = IO::LogOverflow::Block; // sustained rate rather than rate of dropping
+        IO::Logger::Instance().Reset("/dev/null", cfg);
+        return [](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; ++i) {
+                IO::Logger::Instance().Log(" Request", 42, int64_t(i), "", "GET /images/menu/B/B12.jpg HTTP/1.1");
+            }
+        };
+    }});
+
+    return res;
+}
+
+//
+
+struct Options
+{
+    std::string filter;
+    unsigned warmup_ms = 200;
+    unsigned min_ms = 200;
+    unsigned repetitions = 5;
+    uint64_t ops = 0; // calibrated if zero
+    std::string output;
+    bool list = false;
+};
+
+struct Summary
+{
+    uint64_t ops;
+    std::vector<double> ns_per_op; // of each repetition
+    double median;
+    double min;
+    double max;
+    double mean;
+    double stddev;
+};
+
+double Run(const Runner &run, uint64_t ops)
+{
+    const auto start = Clock::now();
+    run(ops);
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+uint64_t Calibrate(const Runner &run, unsigned min_ms)
+{
+    const double target = min_ms * 1e6;
+    uint64_t ops = 1;
+    for (;;) {
+        const double ns = Run(run, ops);
+        if (ns >= target / 10) {
+            return std::max<uint64_t>(1, uint64_t(ops * target / ns));
+        }
+        ops *= (ns > 0) ? std::min(10.0, std::max(2.0, target / 10 / ns)) : 10;
+    }
+}
+
+Summary Measure(const Runner &run, const Options &opts)
+{
+    Summary s;
+    s.ops = opts.ops ? opts.ops : Calibrate(run, opts.min_ms);
+    for (const auto warmup_end = Clock::now() + std::chrono::milliseconds(opts.warmup_ms); Clock::now() < warmup_end; ) {
+        Run(run, std::max<uint64_t>(1, s.ops / 10));
+    }
+    for (unsigned i = 0; i < opts.repetitions; ++i) {
+        s.ns_per_op.push_back(Run(run, s.ops) / s.ops);
+    }
+    auto sorted = s.ns_per_op;
+    std::sort(sorted.begin(), sorted.end());
+    const size_t n = sorted.size();
+    s.median = (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    s.min = sorted.front();
+    s.max = sorted.back();
+    s.mean = 0;
+    for (auto v : sorted) {
+        s.mean += v / n;
+    }
+    s.stddev = 0;
+    for (auto v : sorted) {
+        s.stddev += (v - s.mean) * (v - s.mean) / n;
+    }
+    s.stddev = std::sqrt(s.stddev);
+    return s;
+}
+
+void WriteJson(FILE *f, const Options &opts, const std::vector<std::pair<const char *, Summary>> &results)
+{
+    fprintf(f, "{\n");
+    fprintf(f, "  \"context\": {\n");
+    fprintf(f, "    \"compiler\": \"%s\",\n", __VERSION__);
+    fprintf(f, "    \"cpus\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(f, "    \"warmup_ms\": %u,\n", opts.warmup_ms);
+    fprintf(f, "    \"min_ms\": %u,\n", opts.min_ms);
+    fprintf(f, "    \"repetitions\": %u\n", opts.repetitions);
+    fprintf(f, "  },\n");
+    fprintf(f, "  \"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &s = results[i].second;
+        fprintf(f, "%s\n    {\n", i ? "," : "");
+        fprintf(f, "      \"name\": \"%s\",\n", results[i].first);
+        fprintf(f, "      \"ops_per_repetition\": %llu,\n", (unsigned long long)s.ops);
+        fprintf(f, "      \"ns_per_op\": {\"median\": %.3f, \"min\": %.3f, \"max\": %.3f, \"mean\": %.3f, \"stddev\": %.3f},\n",
+                s.median, s.min, s.max, s.mean, s.stddev);
+        fprintf(f, "      \"ops_per_sec\": %.0f,\n", 1e9 / s.median);
+        fprintf(f, "      \"repetitions\": [");
+        for (size_t r = 0; r < s.ns_per_op.size(); ++r) {
+            fprintf(f, "%s%.3f", r ? ", " : "", s.ns_per_op[r]);
+        }
+        fprintf(f, "]\n    }");
+    }
+    fprintf(f, "\n  ]\n}\n");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options opts;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:w:t:r:n:o:l")) != -1) {
+        switch (opt) {
+        case 'f': opts.filter = optarg;                                      break;
+        case 'w': opts.warmup_ms = std::atoi(optarg);                        break;
+        case 't': opts.min_ms = std::max(1, std::atoi(optarg));              break;
+        case 'r': opts.repetitions = std::max(1, std::atoi(optarg));         break;
+        case 'n': opts.ops = std::strtoull(optarg, nullptr, 10);             break;
+        case 'o': opts.output = optarg;                                      break;
+        case 'l': opts.list = true;                                          break;
+        default:
+            fprintf(stderr, "usage: %s [-f filter] [-w warmup_ms] [-t min_ms] [-r repetitions] [-n ops] [-o json_file] [-l]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<const char *, Summary>> results;
+    for (const auto &b : Benchmarks()) {
+        if (!opts.filter.empty() && !strstr(b.name, opts.filter.c_str())) {
+            continue;
+        }
+        if (opts.list) {
+            printf("%s\n", b.name);
+            continue;
+        }
+        Summary s;
+        {
+            const Runner run = b.setup();
+            s = Measure(run, opts);
+        }
+        fprintf(stderr, "%-32s %12.1f ns/op (min %.1f, max %.1f, %llu ops x %u)\n", b.name, s.median, s.min, s.max,
+                (unsigned long long)s.ops, opts.repetitions);
+        results.emplace_back(b.name, s);
+    }
+    if (opts.list) {
+        return 0;
+    }
+
+    FILE *f = opts.output.empty() ? stdout : fopen(opts.output.c_str(), "w");
+    if (!f) {
+        perror(opts.output.c_str());
+        return 1;
+    }
+    WriteJson(f, opts, results);
+    if (f != stdout) {
+        fclose(f);
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+// Compares round-robin, work-stealing and adaptive worker pools on a skewed workload: few connections request large files
+// (long service time), the rest request small ones. Service time is simulated by sleeping, i.e., worker is blocked on I/O.
+// Adaptive pool starts with a single thread and may grow up to 4 times 'threads'.
+// Usage: pool_bench [threads] [connections] [requests_per_connection] [large_percent]
+
+#include "../src/worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const auto c_small_service = std::chrono::microseconds(200);
+const auto c_large_service = std::chrono::milliseconds(20);
+
+struct Stats
+{
+    std::mutex mtx;
+    std::vector<double> small_latency_ms;
+    std::vector<double> large_latency_ms;
+    std::atomic<int> done;
+    std::atomic<int> out_of_order;
+
+    Stats();
+};
+
+Stats::Stats()
+    : done(0)
+    , out_of_order(0)
+{
+}
+
+struct Task : Concurrent::ITask
+{
+    Stats &stats;
+    std::vector<int> &conn_progress; // last performed request of each connection
+    int conn;
+    int seq;
+    bool large;
+    Clock::time_point submitted;
+
+    Task(Stats &_stats, std::vector<int> &_conn_progress, int _conn, int _seq, bool _large);
+
+    void Perform() override;
+};
+
+Task::Task(Stats &_stats, std::vector<int> &_conn_progress, int _conn, int _seq, bool _large)
+    : stats(_stats)
+    , conn_progress(_conn_progress)
+    , conn(_conn)
+    , seq(_seq)
+    , large(_large)
+    , submitted(Clock::now())
+{
+}
+
+void Task::Perform()
+{
+    std::this_thread::sleep_for(large ? std::chrono::duration_cast<std::chrono::microseconds>(c_large_service) : c_small_service);
+    if (conn_progress[conn] != seq - 1) {
+        ++stats.out_of_order;
+    }
+    conn_progress[conn] = seq;
+
+    const double ms = std::chrono::duration<double, std::milli>(Clock::now() - submitted).count();
+    {
+        std::lock_guard<std::mutex> lock(stats.mtx);
+        (large ? stats.large_latency_ms : stats.small_latency_ms).push_back(ms);
+    }
+    ++stats.done;
+}
+
+double Percentile(std::vector<double> v, double p)
+{
+    if (v.empty()) {
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, size_t(p / 100 * v.size()))];
+}
+
+void RunBench(const char *name, Concurrent::WorkerPool &pool, int conns, int requests, int large_percent)
+{
+    Stats stats;
+    std::vector<int> conn_progress(conns, -1);
+    std::vector<std::shared_ptr<Concurrent::IWorker>> workers(conns);
+
+    pool.Start();
+    const auto start = Clock::now();
+    for (int r = 0; r < requests; ++r) { // requests arrive interleaved across connections, as the event loop would read them
+        for (int c = 0; c < conns; ++c) {
+            const bool large = (c * 100 / conns) < large_percent;
+            std::unique_ptr<Concurrent::ITask> task(new Task(stats, conn_progress, c, r, large));
+            if (!workers[c]) {
+                workers[c] = pool.SubmitTask(std::move(task));
+            } else {
+                workers[c]->AssignTask(std::move(task));
+            }
+        }
+    }
+    while (stats.done < conns * requests) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const double total_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    printf("%-14s %10.1f %10.2f %10.2f %10.2f %10.2f %8d\n", name, total_ms,
+           Percentile(stats.small_latency_ms, 50), Percentile(stats.small_latency_ms, 99),
+           Percentile(stats.large_latency_ms, 50), Percentile(stats.large_latency_ms, 99), stats.out_of_order.load());
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const unsigned threads = (argc > 1) ? std::atoi(argv[1]) : 8;
+    const int conns = (argc > 2) ? std::atoi(argv[2]) : 64;
+    const int requests = (argc > 3) ? std::atoi(argv[3]) : 20;
+    const int large_percent = (argc > 4) ? std::atoi(argv[4]) : 10;
+
+    printf("threads=%u connections=%d requests/connection=%d large=%d%%\n", threads, conns, requests, large_percent);
+    printf("%-14s %10s %10s %10s %10s %10s %8s\n", "pool", "total ms", "small p50", "small p99", "large p50", "large p99", "reorder");
+    {
+        Concurrent::RoundRobinWorkerPool pool(threads);
+        RunBench("round-robin", pool, conns, requests, large_percent);
+    }
+    {
+        Concurrent::WorkStealingWorkerPool pool(threads);
+        RunBench("work-stealing", pool, conns, requests, large_percent);
+    }
+    {
+        Concurrent::AdaptiveWorkerPool::Sizing sizing(1, threads * 4);
+        sizing.interval = std::chrono::milliseconds(20); // benchmark takes just a few intervals of the default length
+        Concurrent::AdaptiveWorkerPool pool(sizing);
+        RunBench("adaptive", pool, conns, requests, large_percent);
+        const auto status = pool.GetStatus();
+        printf("adaptive pool: %u threads (grown %llu, shrunk %llu times)\n", status.threads,
+               (unsigned long long)status.grown, (unsigned long long)status.shrunk);
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Contention benchmark of mutex-based 'MessageQueue' against lock-free 'SpscQueue' and 'MpscQueue':
+// throughput with several producers feeding one consumer, and round-trip latency of ping-pong between two threads.
+// Usage: queue_bench [messages] [max_producers]
+
+#include "../src/message_queue.h"
+#include "../src/ring_queue.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t c_queue_size = 1024;
+
+template <typename Queue>
+double Throughput(size_t messages, int producers)
+{
+    Queue q(c_queue_size);
+    const size_t per_producer = messages / producers;
+
+    const auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&q, per_producer]() {
+            for (size_t i = 0; i < per_producer; ++i) {
+                size_t msg = i;
+                while (!q.Send(std::move(msg))) { // full
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    size_t sum = 0;
+    for (size_t i = 0; i < per_producer * producers; ++i) {
+        sum += q.Receive();
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    const double sec = std::chrono::duration<double>(Clock::now() - start).count();
+    if (sum != producers * (per_producer * (per_producer - 1) / 2)) {
+        fprintf(stderr, "lost messages\n");
+        exit(1);
+    }
+    return per_producer * producers / sec / 1e6;
+}
+
+template <typename Queue>
+double RoundTripNs(size_t rounds)
+{
+    Queue ping(c_queue_size), pong(c_queue_size);
+    std::thread echo([&ping, &pong, rounds]() {
+        for (size_t i = 0; i < rounds; ++i) {
+            pong.Send(ping.Receive());
+        }
+    });
+    const auto start = Clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+        ping.Send(size_t(i));
+        pong.Receive();
+    }
+    const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    echo.join();
+    return ns / rounds;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const size_t messages = (argc > 1) ? std::atoll(argv[1]) : 4000000;
+    const int max_producers = (argc > 2) ? std::atoi(argv[2]) : 4;
+
+    using Mutex = Concurrent::MessageQueue<size_t>;
+    using Spsc = Concurrent::SpscQueue<size_t>;
+    using Mpsc = Concurrent::MpscQueue<size_t>;
+
+    printf("throughput, million messages/s (%zu messages, queue size %zu)\n", messages, c_queue_size);
+    printf("%10s %10s %10s %10s\n", "producers", "mutex", "spsc", "mpsc");
+    for (int p = 1; p <= max_producers; p *= 2) {
+        const double mutex = Throughput<Mutex>(messages, p);
+        const double mpsc = Throughput<Mpsc>(messages, p);
+        if (p == 1) {
+            printf("%10d %10.2f %10.2f %10.2f\n", p, mutex, Throughput<Spsc>(messages, p), mpsc);
+        } else {
+            printf("%10d %10.2f %10s %10.2f\n", p, mutex, "-", mpsc);
+        }
+    }
+
+    const size_t rounds = messages / 20;
+    printf("\nping-pong round trip, ns (%zu rounds)\n", rounds);
+    printf("%10s %10s %10s\n", "mutex", "spsc", "mpsc");
+    printf("%10.0f %10.0f %10.0f\n", RoundTripNs<Mutex>(rounds), RoundTripNs<Spsc>(rounds), RoundTripNs<Mpsc>(rounds));
+    return 0;
+}
@@ -0,0 +1,123 @@
+// Compares vectorized delimiter scanning kernels against the scalar ones on realistic browser requests.
+// Usage: scan_bench [iterations]
+
+#include "../src/http_scan.h"
+#include "../src/http_parser.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+const char *c_request =
+    "GET /images/menu/B/B12.jpg?v=20190816 HTTP/1.1\r\n"
+    "Host: 127.0.0.1:12345\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Referer: http://127.0.0.1:12345/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-US,en;q=0.9,de;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1697040000; session=4f0c1e2b9a8d7c6b5a4f3e2d1c0b9a8f\r\n"
+    "If-Modified-Since: Sat, 14 Oct 2023 10:00:00 GMT\r\n"
+    "\r\n";
+
+const int c_pipeline_depth = 16;
+
+using Clock = std::chrono::steady_clock;
+
+double NsPerOp(Clock::time_point start, long ops)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / ops;
+}
+
+size_t ScanLines(const std::string &buf) // every header line end and every token, the way parser walks them
+{
+    size_t found = 0;
+    const char *p = buf.data();
+    const char *end = p + buf.size();
+    while (p < end) {
+        const char *name_end = Http::Scan::SkipToken(p, end);
+        const char *line_end = Http::Scan::FindLineEnd(name_end, end);
+        found += (line_end - p);
+        p = line_end + 2;
+    }
+    return found;
+}
+
+bool CheckAgainstScalar(Http::Scan::Isa isa)
+{
+    std::string sample;
+    for (int c = 0; c < 256; ++c) {
+        sample += char(c);
+    }
+    sample += c_request;
+    bool ok = true;
+    for (size_t i = 0; i < sample.size(); ++i) {
+        const char *b = sample.data() + i;
+        const char *e = sample.data() + sample.size();
+        Http::Scan::Use(Http::Scan::Scalar);
+        const auto a1 = Http::Scan::FindLineEnd(b, e), a2 = Http::Scan::FindSpaceOrLineEnd(b, e), a3 = Http::Scan::SkipToken(b, e);
+        Http::Scan::Use(isa);
+        ok = ok && (a1 == Http::Scan::FindLineEnd(b, e)) && (a2 == Http::Scan::FindSpaceOrLineEnd(b, e)) && (a3 == Http::Scan::SkipToken(b, e));
+    }
+    return ok;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const long iterations = (argc > 1) ? std::atol(argv[1]) : 200000;
+
+    std::string pipelined;
+    for (int i = 0; i < c_pipeline_depth; ++i) {
+        pipelined += c_request;
+    }
+
+    Http::Parser::Limits limits;
+    limits.max_request_line = 8192;
+    limits.max_headers = 100;
+    limits.max_head_bytes = 16384;
+
+    printf("%-8s %-6s %14s %14s %10s\n", "isa", "check", "scan ns/req", "parse ns/req", "parse MB/s");
+    for (auto isa : { Http::Scan::Scalar, Http::Scan::Sse2, Http::Scan::Avx2 }) {
+        if (!Http::Scan::Supported(isa)) {
+            printf("%-8s unsupported by this CPU\n", Http::Scan::IsaName(isa));
+            continue;
+        }
+        const bool ok = CheckAgainstScalar(isa);
+        Http::Scan::Use(isa);
+
+        volatile size_t sink = 0;
+        for (long i = 0; i < iterations / 10; ++i) { // warmup
+            sink = sink + ScanLines(pipelined);
+        }
+        auto start = Clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            sink = sink + ScanLines(pipelined);
+        }
+        const double scan_ns = NsPerOp(start, iterations * c_pipeline_depth);
+
+        Http::Parser parser(limits);
+        start = Clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            size_t off = 0;
+            while (off < pipelined.size()) { // parse pipelined requests one after another from the single buffer
+                parser.Parse(pipelined.data() + off, pipelined.size() - off);
+                off += parser.Head().head_len;
+                parser.Reset();
+            }
+        }
+        const double parse_ns = NsPerOp(start, iterations * c_pipeline_depth);
+
+        printf("%-8s %-6s %14.1f %14.1f %10.1f\n", Http::Scan::IsaName(isa), ok ? "ok" : "FAIL", scan_ns, parse_ns, strlen(c_request) / parse_ns * 1e3);
+    }
+    return 0;
+}
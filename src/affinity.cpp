@@ -0,0 +1,201 @@
+#include "affinity.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+namespace Concurrent {
+
+namespace {
+
+const char *c_nodes_dir = "/sys/devices/system/node";
+
+bool ReadList(const std::string &fname, std::vector<int> &cpus)
+{
+    std::ifstream f(fname);
+    std::string list;
+    return std::getline(f, list) && Topology::ParseList(list, cpus);
+}
+
+bool Contains(const std::vector<int> &cpus, int cpu)
+{
+    return std::find(cpus.begin(), cpus.end(), cpu) != cpus.end();
+}
+
+}
+
+Topology::Topology(const std::vector<int> &allowed)
+{
+    std::vector<int> ids;
+    if (DIR *d = opendir(c_nodes_dir)) {
+        while (const dirent *de = readdir(d)) {
+            char *end = nullptr;
+            if ((strncmp(de->d_name, "node", 4) == 0) && isdigit(static_cast<unsigned char>(de->d_name[4]))) {
+                const long id = strtol(de->d_name + 4, &end, 10);
+                if (*end == '\0') {
+                    ids.push_back(int(id));
+                }
+            }
+        }
+        closedir(d);
+    }
+    std::sort(ids.begin(), ids.end());
+    for (const int id : ids) {
+        std::vector<int> cpus, usable;
+        if (!ReadList(std::string(c_nodes_dir) + "/node" + std::to_string(id) + "/cpulist", cpus)) {
+            continue;
+        }
+        for (const int cpu : cpus) {
+            if (Contains(allowed, cpu)) {
+                usable.push_back(cpu);
+            }
+        }
+        if (!usable.empty()) {
+            nodes.push_back(usable);
+        }
+    }
+    if (nodes.empty() && !allowed.empty()) {
+        nodes.push_back(allowed);
+    }
+}
+
+int Topology::NodeOf(int cpu) const
+{
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (Contains(nodes[i], cpu)) {
+            return int(i);
+        }
+    }
+    return -1;
+}
+
+std::vector<int> Topology::Allowed()
+{
+    std::vector<int> res;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                res.push_back(cpu);
+            }
+        }
+    }
+    return res;
+}
+
+bool Topology::ParseList(const std::string &list, std::vector<int> &cpus)
+{
+    std::istringstream in(list);
+    for (std::string item; std::getline(in, item, ','); ) {
+        item.erase(std::remove_if(item.begin(), item.end(), [](char c) { return isspace(static_cast<unsigned char>(c)); }), item.end());
+        if (item.empty()) {
+            continue;
+        }
+        char *end = nullptr;
+        const long first = strtol(item.c_str(), &end, 10);
+        long last = first;
+        if (*end == '-') {
+            last = strtol(end + 1, &end, 10);
+        }
+        if ((*end != '\0') || (end == item.c_str()) || (first < 0) || (last < first) || (last >= CPU_SETSIZE)) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(int(cpu));
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return true;
+}
+
+std::vector<int> Topology::IrqCpus(const std::string &interface)
+{
+    std::vector<int> res;
+    std::ifstream f("/proc/interrupts");
+    for (std::string line; std::getline(f, line); ) { // e.g., " 45:  0  1234  PCI-MSI 524288-edge  eth0-TxRx-0"
+        if (interface.empty() || (line.find(interface) == std::string::npos)) {
+            continue;
+        }
+        char *end = nullptr;
+        const long irq = strtol(line.c_str(), &end, 10);
+        if ((end == line.c_str()) || (*end != ':')) {
+            continue;
+        }
+        const auto dir = "/proc/irq/" + std::to_string(irq);
+        if (!ReadList(dir + "/effective_affinity_list", res)) {
+            ReadList(dir + "/smp_affinity_list", res);
+        }
+    }
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+    return res;
+}
+
+bool Topology::Pin(const std::vector<int> &cpus)
+{
+    if (cpus.empty()) {
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+//
+
+Placement::Placement(const Topology &topology, unsigned reactor_count, const std::vector<int> &irq_cpus)
+{
+    // cores handling interrupts first, then the rest taking nodes in turn
+    std::vector<int> order;
+    for (const int cpu : irq_cpus) {
+        if (topology.NodeOf(cpu) >= 0) {
+            order.push_back(cpu);
+        }
+    }
+    for (size_t i = 0; ; ++i) {
+        bool more = false;
+        for (const auto &node : topology.nodes) {
+            if (i < node.size()) {
+                more = true;
+                if (!Contains(order, node[i])) {
+                    order.push_back(node[i]);
+                }
+            }
+        }
+        if (!more) {
+            break;
+        }
+    }
+    if (order.empty()) {
+        return;
+    }
+
+    std::vector<int> taken;
+    for (unsigned i = 0; i < reactor_count; ++i) {
+        reactors.push_back(std::vector<int>(1, order[i % order.size()]));
+        taken.push_back(reactors.back().front());
+    }
+    const auto &node = topology.nodes[topology.NodeOf(reactors.front().front())];
+    for (const int cpu : node) {
+        if (!Contains(taken, cpu)) {
+            workers.push_back(cpu);
+        }
+    }
+    if (workers.empty()) { // event loops took all the cores of the node
+        workers = node;
+    }
+}
+
+}
@@ -0,0 +1,37 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <string>
+#include <vector>
+
+namespace Concurrent {
+
+// NUMA nodes and their cores as reported by sysfs (no libnuma needed), limited to cores the process is allowed to run on
+struct Topology
+{
+    std::vector<std::vector<int>> nodes; // cores of each node, nodes without usable cores are left out
+
+    explicit Topology(const std::vector<int> &allowed); // single node of all 'allowed' cores if sysfs doesn't describe them
+
+    int NodeOf(int cpu) const; // index into 'nodes', -1 if 'cpu' isn't usable
+
+    static std::vector<int> Allowed(); // cores the calling thread may run on
+    static bool ParseList(const std::string &list, std::vector<int> &cpus); // e.g., "0-3,8,10-11", 'false' if malformed
+    static std::vector<int> IrqCpus(const std::string &interface); // cores interrupts of network interface are routed to
+    static bool Pin(const std::vector<int> &cpus); // confines the calling thread to 'cpus', nothing is done if empty
+};
+
+// where event loops and worker threads run: every event loop gets a core of its own, spread over NUMA nodes
+// (cores handling NIC interrupts first, if any), worker threads share the rest of the cores of the first event loop's node,
+// so connections accepted by the event loop are served by workers of the same node
+struct Placement
+{
+    std::vector<std::vector<int>> reactors; // cores of each event loop
+    std::vector<int> workers;
+
+    Placement(const Topology &topology, unsigned reactor_count, const std::vector<int> &irq_cpus);
+};
+
+}
+
+#endif
@@ -0,0 +1,288 @@
+#include "doc_index.h"
+
+#include <set>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+namespace Http {
+
+namespace {
+
+const uint32_t c_watch_mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW;
+const int c_settle_ms = 20; // burst of changes (e.g., deployment) is applied as a single update...
+const int c_max_settle_ms = 200; // ...but file changing all the time (e.g., log being written) doesn't hold updates back for longer
+
+std::atomic<uint64_t> instances(0);
+
+bool MoreEvents(pollfd &fd, std::chrono::steady_clock::time_point deadline) // within 'c_settle_ms', but not past 'deadline'
+{
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    return (left > 0) && (poll(&fd, 1, int(std::min<int64_t>(left, c_settle_ms))) > 0);
+}
+
+// every thread keeps a reference to the snapshot it has seen last, so that lookups only touch shared state
+// (and take the lock 'std::atomic_load' is implemented with) once after the index is updated
+struct SnapshotRef
+{
+    uint64_t owner = 0;
+    uint64_t version = 0;
+    std::shared_ptr<const void> snapshot;
+};
+
+thread_local SnapshotRef t_snapshot;
+
+bool SameFile(const struct stat &a, const struct stat &b) // as told apart by 'FileCache'
+{
+    return (a.st_ino == b.st_ino) && (a.st_size == b.st_size) && (a.st_mtim.tv_sec == b.st_mtim.tv_sec) && (a.st_mtim.tv_nsec == b.st_mtim.tv_nsec);
+}
+
+}
+
+DocIndex::Entry::Entry(const std::string &_path, const struct stat &_st, std::shared_ptr<const IO::File> _file)
+    : path(_path)
+    , st(_st)
+    , mime_type(FileMetaData(_path.c_str()).mime_type)
+    , validators(_st)
+    , file(std::move(_file))
+{
+}
+
+//
+
+DocIndex::DocIndex(const std::string &_root, bool _keep_open, Changed _on_change)
+    : root(_root)
+    , keep_open(_keep_open)
+    , on_change(std::move(_on_change))
+    , id(++instances)
+    , version(0)
+    , inotify(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+    , stop_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    while ((root.size() > 1) && (root.back() == '/')) {
+        root.pop_back();
+    }
+    std::shared_ptr<Snapshot> snapshot(new Snapshot);
+    Walk("", *snapshot);
+    current = std::move(snapshot);
+    if (Watching()) {
+        watcher = std::thread(&DocIndex::Run, this);
+    }
+}
+
+DocIndex::~DocIndex()
+{
+    if (watcher.joinable()) {
+        const uint64_t one = 1;
+        (void)!write(stop_fd, &one, sizeof(one));
+        watcher.join();
+    }
+    if (inotify >= 0) {
+        close(inotify);
+    }
+    if (stop_fd >= 0) {
+        close(stop_fd);
+    }
+}
+
+bool DocIndex::Watching() const
+{
+    return (inotify >= 0) && (stop_fd >= 0) && !watches.empty();
+}
+
+size_t DocIndex::Size() const
+{
+    return std::atomic_load(&current)->size();
+}
+
+DocIndex::EntryPtr DocIndex::Find(const std::string &path) const
+{
+    auto &ref = t_snapshot;
+    const auto v = version.load(std::memory_order_acquire);
+    if ((ref.owner != id) || (ref.version != v)) {
+        ref.snapshot = std::atomic_load(&current);
+        ref.owner = id;
+        ref.version = v;
+    }
+    const auto &snapshot = *static_cast<const Snapshot *>(ref.snapshot.get());
+    const auto it = snapshot.find(path);
+    return (it != snapshot.end()) ? it->second : nullptr;
+}
+
+bool DocIndex::Normalize(const std::string &path, std::string &res)
+{
+    if (path.empty() || (path[0] != '/')) {
+        return false;
+    }
+    res.clear();
+    for (size_t i = 0; i < path.size(); ) {
+        while ((i < path.size()) && (path[i] == '/')) {
+            ++i;
+        }
+        const size_t end = std::min(path.find('/', i), path.size());
+        const size_t len = end - i;
+        if ((len == 2) && (path[i] == '.') && (path[i + 1] == '.')) {
+            if (res.empty()) { // would climb above the root
+                return false;
+            }
+            res.resize(res.rfind('/'));
+        } else if ((len > 0) && !((len == 1) && (path[i] == '.'))) {
+            res += '/';
+            res.append(path, i, len);
+        }
+        i = end;
+    }
+    if (res.empty()) {
+        res = "/";
+    }
+    return true;
+}
+
+void DocIndex::Walk(const std::string &dir, Snapshot &snapshot)
+{
+    const auto full = root + dir;
+    if (inotify >= 0) {
+        const int wd = inotify_add_watch(inotify, full.c_str(), c_watch_mask);
+        if (wd >= 0) {
+            watches[wd] = dir;
+        } else {
+            LOG_WARN("DocIndex: can't watch " + full + ": " + strerror(errno));
+        }
+    }
+    DIR *d = opendir(full.c_str());
+    if (!d) {
+        return;
+    }
+    while (const dirent *de = readdir(d)) {
+        if ((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0)) {
+            continue;
+        }
+        const auto path = dir + "/" + de->d_name;
+        struct stat st;
+        if (lstat((root + path).c_str(), &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            Walk(path, snapshot);
+            continue;
+        }
+        Update(path, snapshot);
+    }
+    closedir(d);
+}
+
+void DocIndex::Update(const std::string &path, Snapshot &snapshot)
+{
+    const auto full = root + path;
+    struct stat st;
+    if ((lstat(full.c_str(), &st) == 0) && S_ISDIR(st.st_mode)) {
+        Walk(path, snapshot); // created or moved in
+        return;
+    }
+    // symbolic links to files are followed, the ones to directories aren't (they could form cycles)
+    if ((stat(full.c_str(), &st) == 0) && S_ISREG(st.st_mode)) {
+        std::shared_ptr<const IO::File> f;
+        if (keep_open) {
+            f = std::make_shared<const IO::File>(full);
+            if (!*f) {
+                snapshot.erase(path);
+                return;
+            }
+            st = f->Stat();
+        }
+        snapshot[path] = std::make_shared<const Entry>(path, st, std::move(f));
+        return;
+    }
+    // removed or moved away, either file or the whole directory
+    snapshot.erase(path);
+    const auto prefix = path + "/";
+    for (auto it = snapshot.begin(); it != snapshot.end(); ) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) {
+            it = snapshot.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DocIndex::Run()
+{
+    alignas(inotify_event) char buf[64 * 1024];
+    pollfd fds[2] = { { inotify, POLLIN, 0 }, { stop_fd, POLLIN, 0 } };
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+
+        std::set<std::string> changed;
+        bool overflow = false;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(c_max_settle_ms);
+        do {
+            const ssize_t n = read(inotify, buf, sizeof(buf));
+            if (n <= 0) {
+                break;
+            }
+            for (const char *p = buf; p < buf + n; ) {
+                const auto *ev = reinterpret_cast<const inotify_event *>(p);
+                p += sizeof(inotify_event) + ev->len;
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    overflow = true;
+                    continue;
+                }
+                const auto it = watches.find(ev->wd);
+                if (it == watches.end()) {
+                    continue;
+                }
+                if (ev->mask & IN_IGNORED) { // directory is gone
+                    watches.erase(it);
+                    continue;
+                }
+                if (ev->len) {
+                    changed.insert(it->second + "/" + ev->name);
+                }
+            }
+        } while (MoreEvents(fds[0], deadline));
+
+        if (!overflow && changed.empty()) {
+            continue;
+        }
+        std::shared_ptr<Snapshot> next;
+        if (overflow) { // some changes are lost, so everything is examined again
+            next.reset(new Snapshot);
+            Walk("", *next);
+        } else {
+            next.reset(new Snapshot(*std::atomic_load(&current)));
+            for (const auto &path : changed) {
+                Update(path, *next);
+            }
+        }
+        LOG_DEBUG("DocIndex: " + std::to_string(overflow ? 0 : changed.size()) + " change(s), " + std::to_string(next->size()) + " file(s)");
+        const auto prev = std::atomic_load(&current);
+        std::shared_ptr<const Snapshot> published(std::move(next));
+        std::atomic_store(&current, published);
+        version.fetch_add(1, std::memory_order_release);
+        if (on_change) { // after publishing, so that nothing cached while the previous snapshot was current outlives it
+            for (const auto &e : *prev) {
+                const auto it = published->find(e.first);
+                if ((it == published->end()) || !SameFile(it->second->st, e.second->st)) {
+                    on_change(e.first);
+                }
+            }
+        }
+    }
+}
+
+}
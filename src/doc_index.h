@@ -0,0 +1,78 @@
+#ifndef DOCINDEX_H
+#define DOCINDEX_H
+
+#include "http_response.h"
+#include "io.h"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace Http {
+
+// immutable hash index of all regular files under the document root, built once on construction;
+// changes reported by inotify are applied to a copy of the current index, which then replaces it as a whole (RCU-style),
+// so lookups never lock and never see partially updated index
+class DocIndex
+{
+public:
+    struct Entry
+    {
+        std::string path; // relative to the root, starts with '/'
+        struct stat st;
+        const char *mime_type;
+        Validators validators;
+        std::shared_ptr<const IO::File> file; // 'nullptr' unless files are kept open
+
+        Entry(const std::string &_path, const struct stat &_st, std::shared_ptr<const IO::File> _file);
+    };
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    // 'on_change' is called by the watcher thread with the path of every indexed file found modified or removed once the update is published
+    // (e.g., so that caches drop stale entries right away instead of on the next lookup)
+    using Changed = std::function<void(const std::string &path)>;
+
+    DocIndex(const std::string &_root, bool _keep_open, Changed _on_change = nullptr); // check 'Watching' to know whether index is kept up to date
+    ~DocIndex();
+
+    DocIndex(const DocIndex &) = delete;
+    DocIndex &operator =(const DocIndex &) = delete;
+
+    bool Watching() const;
+    size_t Size() const;
+
+    EntryPtr Find(const std::string &path) const; // 'nullptr' if there is no such file, 'path' must be normalized
+
+    // collapses repeated slashes and "." segments, resolves ".." against the preceding segment,
+    // 'false' if path isn't absolute or escapes the root via ".."
+    static bool Normalize(const std::string &path, std::string &res);
+private:
+    using Snapshot = std::unordered_map<std::string, EntryPtr>;
+
+    void Walk(const std::string &dir, Snapshot &snapshot); // adds all files under 'dir' and watches its subdirectories
+    void Update(const std::string &path, Snapshot &snapshot); // re-examines file or directory reported by inotify
+    void Run();
+
+    std::string root;
+    bool keep_open;
+    Changed on_change;
+    const uint64_t id; // tells snapshots cached by threads for different indexes apart
+    std::shared_ptr<const Snapshot> current; // accessed by 'std::atomic_load' and 'std::atomic_store' only
+    std::atomic<uint64_t> version; // incremented after 'current' is replaced
+
+    int inotify;
+    int stop_fd; // eventfd signalled on destruction
+    std::map<int, std::string> watches; // directory by watch descriptor, used by watcher thread only (after construction)
+    std::thread watcher;
+};
+
+}
+
+#endif
@@ -0,0 +1,64 @@
+#include "event_count.h"
+
+#include <climits>
+#include <thread>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace Concurrent {
+
+namespace {
+
+const int c_spin_limit = 256;
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be plain 32-bit integer");
+
+long Futex(std::atomic<uint32_t> *addr, int op, uint32_t val)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), op, val, nullptr, nullptr, 0);
+}
+
+}
+
+EventCount::EventCount()
+    : state(0)
+{
+}
+
+uint32_t EventCount::PrepareWait()
+{
+    // pairs with the fence in 'Notify': either waiter sees condition made true or notifier sees the bit
+    return state.fetch_or(1, std::memory_order_seq_cst) | 1;
+}
+
+void EventCount::Wait(uint32_t key)
+{
+    while (state.load(std::memory_order_acquire) == key) {
+        Futex(&state, FUTEX_WAIT_PRIVATE, key); // returns right away if state has already moved on, spurious wake-ups are re-checked
+    }
+}
+
+void EventCount::Notify()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t s = state.load(std::memory_order_relaxed);
+    if ((s & 1) == 0) {
+        return;
+    }
+    // failure means another notifier has already bumped the epoch (threads parking after that re-check condition themselves)
+    if (state.compare_exchange_strong(s, (s + 2) & ~1u, std::memory_order_seq_cst)) {
+        Futex(&state, FUTEX_WAKE_PRIVATE, INT_MAX);
+    }
+}
+
+//
+
+int SpinLimit()
+{
+    static const int limit = (std::thread::hardware_concurrency() > 1) ? c_spin_limit : 0;
+    return limit;
+}
+
+}
@@ -0,0 +1,45 @@
+#ifndef EVENTCOUNT_H
+#define EVENTCOUNT_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace Concurrent {
+
+// lets lock-free data structures park waiting threads on a futex:
+//
+//     auto key = ec.PrepareWait();
+//     if (!condition) { ec.Wait(key); }
+//
+// while the other side makes condition true and then calls 'Notify', which costs nothing but a fence and a load when no one waits;
+// only the first 'Notify' after thread parked issues a syscall, and it wakes all parked threads (meant for one or a few waiters)
+class EventCount
+{
+public:
+    EventCount();
+
+    EventCount(const EventCount &) = delete;
+    EventCount &operator=(const EventCount &) = delete;
+
+    uint32_t PrepareWait();
+    void Wait(uint32_t key);
+
+    void Notify();
+private:
+    std::atomic<uint32_t> state; // bit 0 is set while someone is (about to be) parked, the rest is epoch bumped by 'Notify'
+};
+
+// hints CPU that caller is spinning (e.g., lets sibling hyper-thread run)
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// how many times waiter should spin (calling 'CpuRelax') before parking, it's pointless on single CPU machine
+int SpinLimit();
+
+}
+
+#endif
@@ -0,0 +1,151 @@
+#include "file_cache.h"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace Http {
+
+namespace {
+
+const size_t c_shards = 16; // shards have independent locks and LRU lists to keep worker threads from contending
+
+}
+
+FileCache::Entry::Entry(const struct stat &st, const char *_mime_type)
+    : header_len(0)
+    , mime_type(_mime_type)
+    , ino(st.st_ino)
+    , size(st.st_size)
+    , mtime(st.st_mtim)
+{
+}
+
+bool FileCache::Entry::Matches(const struct stat &st) const
+{
+    return (ino == st.st_ino) && (size == st.st_size) && (mtime.tv_sec == st.st_mtim.tv_sec) && (mtime.tv_nsec == st.st_mtim.tv_nsec);
+}
+
+size_t FileCache::Entry::Bytes() const
+{
+    return response.size();
+}
+
+//
+
+struct FileCache::Shard
+{
+    using Lru = std::list<std::string>;
+    struct Slot
+    {
+        EntryPtr e;
+        Lru::iterator pos;
+    };
+
+    std::mutex mtx;
+    std::unordered_map<std::string, Slot> slots;
+    Lru lru; // most recently used at the front
+    size_t bytes;
+    size_t max_bytes;
+
+    Shard();
+
+    void Erase(std::unordered_map<std::string, Slot>::iterator it);
+    void EvictUntilFits(size_t extra);
+};
+
+FileCache::Shard::Shard()
+    : bytes(0)
+    , max_bytes(0)
+{
+}
+
+void FileCache::Shard::Erase(std::unordered_map<std::string, Slot>::iterator it)
+{
+    bytes -= it->second.e->Bytes();
+    lru.erase(it->second.pos);
+    slots.erase(it);
+}
+
+void FileCache::Shard::EvictUntilFits(size_t extra)
+{
+    while (!lru.empty() && (bytes + extra > max_bytes)) {
+        Erase(slots.find(lru.back()));
+    }
+}
+
+//
+
+FileCache::FileCache(size_t _max_bytes)
+    : max_bytes(_max_bytes)
+    , shards(new Shard[c_shards])
+{
+    for (size_t i = 0; i < c_shards; ++i) {
+        shards[i].max_bytes = max_bytes / c_shards;
+    }
+}
+
+FileCache::~FileCache() = default;
+
+size_t FileCache::MaxBytes() const
+{
+    return max_bytes;
+}
+
+size_t FileCache::MaxEntryBytes() const
+{
+    return max_bytes / c_shards;
+}
+
+FileCache::EntryPtr FileCache::Find(const std::string &path, const struct stat &st)
+{
+    auto &shard = ShardOf(path);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    auto it = shard.slots.find(path);
+    if (it == shard.slots.end()) {
+        return nullptr;
+    }
+    if (!it->second.e->Matches(st)) { // file changed on disk since it was cached
+        shard.Erase(it);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.pos);
+    return it->second.e;
+}
+
+void FileCache::Insert(const std::string &path, EntryPtr e)
+{
+    if (!e || (e->Bytes() > MaxEntryBytes())) {
+        return;
+    }
+    auto &shard = ShardOf(path);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    auto it = shard.slots.find(path);
+    if (it != shard.slots.end()) {
+        shard.Erase(it);
+    }
+    shard.EvictUntilFits(e->Bytes());
+    shard.lru.push_front(path);
+    shard.bytes += e->Bytes();
+    shard.slots[path] = Shard::Slot{ std::move(e), shard.lru.begin() };
+}
+
+void FileCache::Invalidate(const std::string &path)
+{
+    auto &shard = ShardOf(path);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    auto it = shard.slots.find(path);
+    if (it != shard.slots.end()) {
+        shard.Erase(it);
+    }
+}
+
+FileCache::Shard &FileCache::ShardOf(const std::string &path)
+{
+    return shards[std::hash<std::string>()(path) % c_shards];
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <memory>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace Http {
+
+class FileCache
+{
+public:
+    struct Entry
+    {
+        std::string response; // pre-rendered header immediately followed by the body
+        size_t header_len;
+        const char *mime_type;
+
+        ino_t ino;
+        off_t size;
+        timespec mtime;
+
+        Entry(const struct stat &st, const char *_mime_type);
+
+        bool Matches(const struct stat &st) const;
+        size_t Bytes() const;
+    };
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    explicit FileCache(size_t _max_bytes);
+    ~FileCache();
+
+    FileCache(const FileCache &) = delete;
+    FileCache &operator =(const FileCache &) = delete;
+
+    size_t MaxBytes() const;
+    size_t MaxEntryBytes() const;
+
+    // returns 'nullptr' on miss or if cached entry is stale w.r.t. 'st' (stale entry is dropped)
+    EntryPtr Find(const std::string &path, const struct stat &st);
+    void Insert(const std::string &path, EntryPtr e);
+    void Invalidate(const std::string &path);
+private:
+    struct Shard;
+    Shard &ShardOf(const std::string &path);
+
+    size_t max_bytes;
+    std::unique_ptr<Shard[]> shards;
+};
+
+}
+
+#endif
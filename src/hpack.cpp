@@ -0,0 +1,453 @@
+#include "hpack.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Http {
+namespace Hpack {
+
+namespace {
+
+const Field c_static_table[] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+const size_t c_static_size = sizeof(c_static_table) / sizeof(c_static_table[0]);
+
+const struct
+{
+    uint32_t code;
+    uint8_t len;
+} c_huffman_codes[257] = {
+    { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 }, { 0xfffffe4, 28 }, { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 },
+    { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 }, { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 },
+    { 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 }, { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+    { 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 }, { 0xffffff8, 28 }, { 0xffffff9, 28 }, { 0xffffffa, 28 }, { 0xffffffb, 28 },
+    { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 }, { 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 },
+    { 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 }, { 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 },
+    { 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 }, { 0x1a, 6 }, { 0x1b, 6 }, { 0x1c, 6 }, { 0x1d, 6 },
+    { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 }, { 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 },
+    { 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 }, { 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 },
+    { 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 }, { 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 }, { 0x6a, 7 },
+    { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 }, { 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 },
+    { 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 }, { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 },
+    { 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 }, { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 },
+    { 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 }, { 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 },
+    { 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 }, { 0x8, 5 }, { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 },
+    { 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 }, { 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 },
+    { 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 }, { 0xfffe8, 20 }, { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 },
+    { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 }, { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 },
+    { 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 }, { 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 }, { 0x7fffe3, 23 },
+    { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 }, { 0x7fffe5, 23 }, { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 },
+    { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 }, { 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 },
+    { 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 }, { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 }, { 0x7fffec, 23 },
+    { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 }, { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 },
+    { 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 }, { 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 }, { 0x7ffff1, 23 },
+    { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 }, { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 },
+    { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 }, { 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 },
+    { 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 }, { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 }, { 0xfffff2, 24 },
+    { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 }, { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 },
+    { 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 }, { 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 },
+    { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 }, { 0x1ffffef, 25 }, { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 },
+    { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 }, { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 },
+    { 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 }, { 0x7ffffed, 27 }, { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 },
+    { 0x3fffffff, 30 } // EOS
+};
+const int c_eos = 256;
+
+// binary tree of Huffman codes for bit-by-bit decoding, child 0 means there is no such code (root is nobody's child),
+// negative child is a leaf standing for symbol -(child + 1)
+struct HuffmanTree
+{
+    std::vector<int16_t> nodes; // pairs of children
+
+    HuffmanTree()
+        : nodes(2, 0)
+    {
+        for (int sym = 0; sym <= c_eos; ++sym) {
+            const auto &c = c_huffman_codes[sym];
+            size_t node = 0;
+            for (int bit = c.len - 1; bit > 0; --bit) {
+                const size_t child = 2 * node + ((c.code >> bit) & 1);
+                if (nodes[child] == 0) {
+                    nodes[child] = int16_t(nodes.size() / 2);
+                    nodes.resize(nodes.size() + 2, 0);
+                }
+                node = nodes[child];
+            }
+            nodes[2 * node + (c.code & 1)] = int16_t(-(sym + 1));
+        }
+    }
+};
+
+const HuffmanTree &Tree()
+{
+    static const HuffmanTree tree;
+    return tree;
+}
+
+// names of fields whose values hardly ever repeat, adding them to the dynamic table would only evict useful entries
+bool Indexable(const std::string &name)
+{
+    return (name != "content-length") && (name != "content-range") && (name != "etag") && (name != "last-modified") && (name != "date");
+}
+
+void EncodeInt(uint8_t flags, int prefix_bits, size_t value, std::string &res)
+{
+    const size_t max_prefix = (size_t(1) << prefix_bits) - 1;
+    if (value < max_prefix) {
+        res += char(flags | value);
+        return;
+    }
+    res += char(flags | max_prefix);
+    for (value -= max_prefix; value >= 0x80; value >>= 7) {
+        res += char((value & 0x7f) | 0x80);
+    }
+    res += char(value);
+}
+
+bool DecodeInt(const uint8_t *&p, const uint8_t *end, int prefix_bits, size_t &value)
+{
+    const size_t max_prefix = (size_t(1) << prefix_bits) - 1;
+    value = *p++ & max_prefix;
+    if (value < max_prefix) {
+        return true;
+    }
+    for (int shift = 0; (p < end) && (shift <= 28); shift += 7) { // anything larger is surely bogus
+        const uint8_t b = *p++;
+        value += size_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void EncodeString(const std::string &str, std::string &res)
+{
+    const size_t huffman_len = HuffmanLen(str);
+    if (huffman_len < str.size()) {
+        EncodeInt(0x80, 7, huffman_len, res);
+        HuffmanEncode(str, res);
+    } else {
+        EncodeInt(0x00, 7, str.size(), res);
+        res += str;
+    }
+}
+
+bool DecodeString(const uint8_t *&p, const uint8_t *end, std::string &res)
+{
+    if (p == end) {
+        return false;
+    }
+    const bool huffman = (*p & 0x80);
+    size_t len;
+    if (!DecodeInt(p, end, 7, len) || (len > size_t(end - p))) {
+        return false;
+    }
+    const char *data = reinterpret_cast<const char *>(p);
+    p += len;
+    res.clear();
+    if (huffman) {
+        return HuffmanDecode(data, len, res);
+    }
+    res.assign(data, len);
+    return true;
+}
+
+}
+
+Table::Table()
+    : size(0)
+    , max_size(c_default_size)
+{
+}
+
+void Table::Resize(size_t _max_size)
+{
+    max_size = _max_size;
+    Evict(max_size);
+}
+
+void Table::Add(const Field &f)
+{
+    const size_t bytes = f.name.size() + f.value.size() + c_entry_overhead;
+    if (bytes > max_size) { // table just becomes empty
+        Evict(0);
+        return;
+    }
+    Evict(max_size - bytes);
+    entries.push_front(f);
+    size += bytes;
+}
+
+const Field *Table::Get(size_t index) const
+{
+    if ((index == 0) || (index > c_static_size + entries.size())) {
+        return nullptr;
+    }
+    return (index <= c_static_size) ? &c_static_table[index - 1] : &entries[index - c_static_size - 1];
+}
+
+bool Table::Find(const Field &f, size_t &index) const
+{
+    index = 0;
+    for (size_t i = 0; i < c_static_size; ++i) {
+        if (c_static_table[i].name == f.name) {
+            if (c_static_table[i].value == f.value) {
+                index = i + 1;
+                return true;
+            }
+            if (index == 0) {
+                index = i + 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].name == f.name) {
+            if (entries[i].value == f.value) {
+                index = c_static_size + i + 1;
+                return true;
+            }
+            if (index == 0) {
+                index = c_static_size + i + 1;
+            }
+        }
+    }
+    return false;
+}
+
+size_t Table::MaxSize() const
+{
+    return max_size;
+}
+
+void Table::Evict(size_t limit)
+{
+    while (size > limit) {
+        size -= entries.back().name.size() + entries.back().value.size() + c_entry_overhead;
+        entries.pop_back();
+    }
+}
+
+//
+
+bool Decoder::Decode(const char *data, size_t len, size_t max_fields_bytes, Fields &fields)
+{
+    const auto *p = reinterpret_cast<const uint8_t *>(data);
+    const auto *end = p + len;
+    size_t bytes = 0;
+    while (p < end) {
+        const uint8_t b = *p;
+        size_t index;
+        Field f;
+        if (b & 0x80) { // indexed field
+            if (!DecodeInt(p, end, 7, index)) {
+                return false;
+            }
+            const Field *e = table.Get(index);
+            if (!e) {
+                return false;
+            }
+            f = *e;
+        } else if ((b & 0xe0) == 0x20) { // dynamic table size update, allowed at the beginning of the block only
+            size_t size;
+            if (!DecodeInt(p, end, 5, size) || !fields.empty() || (size > Table::c_default_size)) {
+                return false;
+            }
+            table.Resize(size);
+            continue;
+        } else { // literal field, with incremental indexing, without indexing or never indexed
+            const bool indexing = (b & 0x40);
+            if (!DecodeInt(p, end, indexing ? 6 : 4, index)) {
+                return false;
+            }
+            if (index) {
+                const Field *e = table.Get(index);
+                if (!e) {
+                    return false;
+                }
+                f.name = e->name;
+            } else if (!DecodeString(p, end, f.name)) {
+                return false;
+            }
+            if (!DecodeString(p, end, f.value)) {
+                return false;
+            }
+            if (indexing) {
+                table.Add(f);
+            }
+        }
+        bytes += f.name.size() + f.value.size();
+        if (bytes > max_fields_bytes) {
+            return false;
+        }
+        fields.push_back(std::move(f));
+    }
+    return true;
+}
+
+//
+
+Encoder::Encoder()
+    : size_update(false)
+    , min_size(Table::c_default_size)
+{
+}
+
+void Encoder::SetMaxTableSize(size_t size)
+{
+    size = (size < Table::c_default_size) ? size : size_t(Table::c_default_size); // larger table than the default one isn't worth the memory
+    if (size != table.MaxSize()) {
+        table.Resize(size);
+        size_update = true;
+        min_size = std::min(min_size, size);
+    }
+}
+
+void Encoder::Encode(const Fields &fields, std::string &res)
+{
+    if (size_update) {
+        if (min_size < table.MaxSize()) { // table shrank and grew again, decoder has to evict what encoder did (RFC 7541 4.2)
+            EncodeInt(0x20, 5, min_size, res);
+        }
+        EncodeInt(0x20, 5, table.MaxSize(), res);
+        size_update = false;
+        min_size = table.MaxSize();
+    }
+    for (const auto &f : fields) {
+        size_t index;
+        if (table.Find(f, index)) {
+            EncodeInt(0x80, 7, index, res);
+            continue;
+        }
+        const bool indexing = Indexable(f.name);
+        EncodeInt(indexing ? 0x40 : 0x00, indexing ? 6 : 4, index, res);
+        if (index == 0) {
+            EncodeString(f.name, res);
+        }
+        EncodeString(f.value, res);
+        if (indexing) {
+            table.Add(f);
+        }
+    }
+}
+
+//
+
+bool HuffmanDecode(const char *data, size_t len, std::string &res)
+{
+    const auto &nodes = Tree().nodes;
+    size_t node = 0;
+    int depth = 0;       // bits of the code being decoded...
+    bool ones = true;    // ...which are all set so far (padding is the most significant bits of EOS)
+    for (size_t i = 0; i < len; ++i) {
+        const uint8_t b = data[i];
+        for (int bit = 7; bit >= 0; --bit) {
+            const int child = nodes[2 * node + ((b >> bit) & 1)];
+            ones = ones && ((b >> bit) & 1);
+            ++depth;
+            if (child > 0) {
+                node = child;
+                continue;
+            }
+            if ((child == 0) || (child == -(c_eos + 1))) { // EOS must not be decoded
+                return false;
+            }
+            res += char(-child - 1);
+            node = 0;
+            depth = 0;
+            ones = true;
+        }
+    }
+    return (depth < 8) && ones;
+}
+
+void HuffmanEncode(const std::string &str, std::string &res)
+{
+    uint64_t acc = 0;
+    int bits = 0;
+    for (const char ch : str) {
+        const auto &c = c_huffman_codes[uint8_t(ch)];
+        acc = (acc << c.len) | c.code;
+        bits += c.len;
+        for (; bits >= 8; bits -= 8) {
+            res += char(acc >> (bits - 8));
+        }
+        acc &= (uint64_t(1) << bits) - 1;
+    }
+    if (bits > 0) { // padded with ones
+        res += char((acc << (8 - bits)) | (0xff >> bits));
+    }
+}
+
+size_t HuffmanLen(const std::string &str)
+{
+    size_t bits = 0;
+    for (const char ch : str) {
+        bits += c_huffman_codes[uint8_t(ch)].len;
+    }
+    return (bits + 7) / 8;
+}
+
+}
+}
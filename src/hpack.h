@@ -0,0 +1,77 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace Http {
+
+// HPACK (RFC 7541), header compression of HTTP/2: fields are sent as indexes into static table or dynamic table
+// (of recently sent fields, kept in sync by both ends of a connection) or as literals, optionally Huffman-coded
+namespace Hpack {
+
+struct Field
+{
+    std::string name; // lowercase
+    std::string value;
+};
+using Fields = std::vector<Field>;
+
+class Table // dynamic table of a single direction of a connection
+{
+public:
+    static const size_t c_entry_overhead = 32;
+    static const size_t c_default_size = 4096;
+
+    Table();
+
+    void Resize(size_t _max_size); // evicts the oldest entries until the table fits
+    void Add(const Field &f);
+    const Field *Get(size_t index) const; // 1-based index into static table followed by dynamic one, 'nullptr' if out of range
+
+    // index of matching field, 'false' if only the name matches (or 0, if even the name doesn't)
+    bool Find(const Field &f, size_t &index) const;
+
+    size_t MaxSize() const;
+private:
+    void Evict(size_t limit);
+
+    std::deque<Field> entries; // newest first
+    size_t size;
+    size_t max_size;
+};
+
+class Decoder
+{
+public:
+    // header blocks are decoded into 'fields', 'false' means compression error (the connection can't continue),
+    // 'max_fields_bytes' limits decoded size of the whole block (names and values)
+    bool Decode(const char *data, size_t len, size_t max_fields_bytes, Fields &fields);
+private:
+    Table table; // its size is only changed by updates signalled by the encoder (within the default size, which is never changed by settings)
+};
+
+class Encoder
+{
+public:
+    Encoder();
+
+    void SetMaxTableSize(size_t size); // peer's SETTINGS_HEADER_TABLE_SIZE, the change is signalled in the next header block
+    void Encode(const Fields &fields, std::string &res); // appends header block
+private:
+    Table table;
+    bool size_update; // table size update is yet to be signalled
+    size_t min_size;  // smallest table size since the last header block, signalled before the final one if it's smaller
+};
+
+bool HuffmanDecode(const char *data, size_t len, std::string &res); // appends decoded string, 'false' if coding or padding is invalid
+void HuffmanEncode(const std::string &str, std::string &res);
+size_t HuffmanLen(const std::string &str); // bytes of Huffman-coded 'str'
+
+}
+
+}
+
+#endif
@@ -0,0 +1,845 @@
+#include "http2.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace Http {
+
+namespace {
+
+const size_t c_frame_header_len = 9;
+const size_t c_max_frame = 16384; // the default, both received and sent frames are never larger (so that streams are interleaved finely)
+const int64_t c_default_window = 65535;
+const int64_t c_max_window = 0x7fffffff;
+const size_t c_max_response_head = 16384;
+
+enum FrameType
+{
+    Data = 0x0,
+    Headers = 0x1,
+    Priority = 0x2,
+    RstStream = 0x3,
+    Settings = 0x4,
+    PushPromise = 0x5,
+    Ping = 0x6,
+    GoAwayFrame = 0x7,
+    WindowUpdate = 0x8,
+    Continuation = 0x9
+};
+
+enum Flag
+{
+    EndStreamFlag = 0x1,
+    AckFlag = 0x1,
+    EndHeadersFlag = 0x4,
+    PaddedFlag = 0x8,
+    PriorityFlag = 0x20
+};
+
+enum Setting
+{
+    HeaderTableSize = 0x1,
+    EnablePush = 0x2,
+    MaxConcurrentStreams = 0x3,
+    InitialWindowSize = 0x4,
+    MaxFrameSize = 0x5,
+    MaxHeaderListSize = 0x6
+};
+
+enum ErrorCode
+{
+    NoError = 0x0,
+    ProtocolError = 0x1,
+    InternalError = 0x2,
+    FlowControlError = 0x3,
+    StreamClosed = 0x5,
+    FrameSizeError = 0x6,
+    RefusedStream = 0x7,
+    CompressionError = 0x9,
+    EnhanceYourCalm = 0xb
+};
+
+uint32_t Get32(const char *p)
+{
+    const auto *b = reinterpret_cast<const uint8_t *>(p);
+    return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3];
+}
+
+void Put32(uint32_t v, std::string &res)
+{
+    res += char(v >> 24);
+    res += char(v >> 16);
+    res += char(v >> 8);
+    res += char(v);
+}
+
+std::string FrameHeader(size_t len, uint8_t type, uint8_t flags, uint32_t id)
+{
+    std::string res;
+    res += char(len >> 16);
+    res += char(len >> 8);
+    res += char(len);
+    res += char(type);
+    res += char(flags);
+    Put32(id, res);
+    return res;
+}
+
+void PutSetting(uint16_t id, uint32_t v, std::string &res)
+{
+    res += char(id >> 8);
+    res += char(id);
+    Put32(v, res);
+}
+
+bool Base64UrlDecode(const std::string &str, std::string &res) // unpadded, as 'HTTP2-Settings' is
+{
+    uint32_t acc = 0;
+    int bits = 0;
+    for (const char c : str) {
+        int v;
+        if ((c >= 'A') && (c <= 'Z')) {
+            v = c - 'A';
+        } else if ((c >= 'a') && (c <= 'z')) {
+            v = c - 'a' + 26;
+        } else if ((c >= '0') && (c <= '9')) {
+            v = c - '0' + 52;
+        } else if (c == '-') {
+            v = 62;
+        } else if (c == '_') {
+            v = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            return false;
+        }
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            res += char(acc >> bits);
+        }
+    }
+    return true;
+}
+
+// header fields specific to HTTP/1.1 connection, which are not allowed in HTTP/2
+bool ConnectionSpecific(const std::string &name)
+{
+    return (name == "connection") || (name == "keep-alive") || (name == "proxy-connection") || (name == "transfer-encoding") || (name == "upgrade");
+}
+
+bool Valid(const Hpack::Field &f) // nothing that would break request head apart once it is in HTTP/1.1 form
+{
+    if (f.name.empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < f.name.size(); ++i) {
+        const char c = f.name[i];
+        if (((c >= 'A') && (c <= 'Z')) || (c <= ' ') || (c == 0x7f) || ((c == ':') && (i > 0))) {
+            return false;
+        }
+    }
+    return f.value.find_first_of(std::string("\r\n\0", 3)) == std::string::npos;
+}
+
+// request line and headers in HTTP/1.1 wire form (with HTTP/2.0 version), 'false' if request is malformed
+bool ToHttp1(const Hpack::Fields &fields, std::string &head)
+{
+    std::string method, path, scheme, authority, headers;
+    bool regular = false;
+    bool host = false;
+    for (const auto &f : fields) {
+        if (!Valid(f)) {
+            return false;
+        }
+        if (f.name[0] == ':') { // pseudo-header fields precede regular ones and never repeat
+            std::string *dst = (f.name == ":method") ? &method : (f.name == ":path") ? &path : (f.name == ":scheme") ? &scheme :
+                               (f.name == ":authority") ? &authority : nullptr;
+            if (regular || !dst || !dst->empty() || f.value.empty()) {
+                return false;
+            }
+            *dst = f.value;
+            continue;
+        }
+        regular = true;
+        if (ConnectionSpecific(f.name) || ((f.name == "te") && (f.value != "trailers"))) {
+            return false;
+        }
+        if (f.name == "te") {
+            continue;
+        }
+        host = host || (f.name == "host");
+        headers += f.name;
+        headers += ": ";
+        headers += f.value;
+        headers += "\r\n";
+    }
+    if (method.empty() || path.empty() || scheme.empty() || (method.find(' ') != std::string::npos) || (path.find(' ') != std::string::npos)) {
+        return false;
+    }
+    head = method + " " + path + " HTTP/2.0\r\n";
+    if (!authority.empty() && !host) {
+        head += "host: " + authority + "\r\n";
+    }
+    head += headers;
+    head += "\r\n";
+    return true;
+}
+
+// status and header fields of response in HTTP/1.1 wire form, 'false' if it's malformed
+bool FromHttp1(const std::string &head, Hpack::Fields &fields)
+{
+    const size_t sp = head.find(' ');
+    size_t pos = head.find("\r\n");
+    if ((sp == std::string::npos) || (sp + 4 > pos)) {
+        return false;
+    }
+    fields.push_back(Hpack::Field{ ":status", head.substr(sp + 1, 3) });
+    for (pos += 2; pos + 2 < head.size(); ) {
+        const size_t eol = head.find("\r\n", pos);
+        const size_t colon = head.find(':', pos);
+        if (colon > eol) {
+            return false;
+        }
+        std::string name = head.substr(pos, colon - pos);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        size_t v = colon + 1;
+        while ((v < eol) && ((head[v] == ' ') || (head[v] == '\t'))) {
+            ++v;
+        }
+        if (!ConnectionSpecific(name)) {
+            fields.push_back(Hpack::Field{ name, head.substr(v, eol - v) });
+        }
+        pos = eol + 2;
+    }
+    return true;
+}
+
+}
+
+const char Http2Session::c_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+Http2Session::Stream::Stream(std::shared_ptr<IO::OutQueue> _out, int64_t _window, bool _remote_closed)
+    : out(std::move(_out))
+    , done(false)
+    , reset(false)
+    , remote_closed(_remote_closed)
+    , headers_sent(false)
+    , window(_window)
+{
+}
+
+Http2Session::Http2Session(IO::Socket _s, std::shared_ptr<IO::OutQueue> _out, size_t _read_capacity, Handler _handler)
+    : s(std::move(_s))
+    , out(std::move(_out))
+    , read_capacity(_read_capacity)
+    , handler(std::move(_handler))
+    , last_stream_id(0)
+    , opened(0)
+    , resets(0)
+    , window(c_default_window)
+    , initial_window(c_default_window)
+    , preface(false)
+    , data_len(0)
+    , data_left(0)
+    , data_stream(0)
+    , data_flags(0)
+    , continuation(false)
+    , block_stream(0)
+    , block_end_stream(false)
+    , goaway_sent(false)
+    , goaway_received(false)
+{
+    // control frames (acks, window updates) are small writes preceding responses, those mustn't wait for delayed ACKs of the peer
+    const int on = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+void Http2Session::Start()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    SendSettings();
+}
+
+bool Http2Session::Upgrade(const std::string &settings, const std::string &head)
+{
+    std::string payload;
+    if (!Base64UrlDecode(settings, payload) || (payload.size() % 6 != 0)) {
+        return false;
+    }
+    std::vector<Dispatched> requests;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (ApplySettings(payload.data(), payload.size()) != NoError) {
+            return false;
+        }
+        out->Push("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+        SendSettings();
+        last_stream_id = 1;
+        const size_t eol = head.find("\r\n");
+        const size_t sp = head.rfind(' ', eol);
+        Open(1, head.substr(0, sp + 1) + "HTTP/2.0" + head.substr(eol), true, requests); // half-closed by client already
+    }
+    Dispatch(requests);
+    return true;
+}
+
+size_t Http2Session::Receive(const char *data, size_t len)
+{
+    std::vector<Dispatched> requests;
+    size_t pos = 0;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        while (!goaway_sent) {
+            if (!preface) {
+                if (len - pos < c_preface_len) {
+                    break;
+                }
+                if (memcmp(data + pos, c_preface, c_preface_len) != 0) {
+                    GoAway(ProtocolError);
+                    break;
+                }
+                pos += c_preface_len;
+                preface = true;
+                continue;
+            }
+            if (data_left > 0) {
+                const size_t n = std::min(data_left, len - pos);
+                if (n == 0) {
+                    break;
+                }
+                pos += n;
+                data_left -= n;
+                if (data_left == 0) {
+                    EndData();
+                }
+                continue;
+            }
+            if (len - pos < c_frame_header_len) {
+                break;
+            }
+            const auto *h = reinterpret_cast<const uint8_t *>(data + pos);
+            const size_t frame_len = (size_t(h[0]) << 16) | (size_t(h[1]) << 8) | h[2];
+            const uint8_t type = h[3];
+            const uint8_t flags = h[4];
+            const uint32_t id = Get32(data + pos + 5) & 0x7fffffff;
+            if ((frame_len > c_max_frame) || ((type != Data) && (c_frame_header_len + frame_len > read_capacity))) { // the latter would never fit
+                GoAway(FrameSizeError);
+                break;
+            }
+            if (continuation && ((type != Continuation) || (id != block_stream))) { // header block must not be interrupted
+                GoAway(ProtocolError);
+                break;
+            }
+            if (type == Data) { // payload isn't needed as a whole, so it could be larger than read buffer
+                if ((id == 0) || (id > last_stream_id)) { // idle streams can't carry data
+                    GoAway(ProtocolError);
+                    break;
+                }
+                const auto it = streams.find(id);
+                if ((it == streams.end()) || it->second.remote_closed || it->second.reset) { // payload is discarded still, as it counts against the window
+                    Reset(id, StreamClosed);
+                    if (it != streams.end()) {
+                        Close(it);
+                    }
+                } else if (flags & EndStreamFlag) {
+                    it->second.remote_closed = true;
+                }
+                pos += c_frame_header_len;
+                data_len = data_left = frame_len;
+                data_stream = id;
+                data_flags = flags;
+                if (data_left == 0) {
+                    EndData();
+                }
+                continue;
+            }
+            if (len - pos < c_frame_header_len + frame_len) {
+                break;
+            }
+            pos += c_frame_header_len + frame_len;
+            Process(type, flags, id, data + pos - frame_len, frame_len, requests);
+        }
+        if (goaway_sent) { // whatever follows is ignored
+            pos = len;
+        }
+    }
+    Dispatch(requests);
+    Pump();
+    return pos;
+}
+
+void Http2Session::Pump()
+{
+    Queues drained;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        PumpLocked(drained);
+    }
+    for (auto &q : drained) {
+        q->Produce();
+    }
+}
+
+void Http2Session::Abort()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto it = streams.begin(); it != streams.end(); ) {
+        it = Drop(it);
+    }
+    goaway_sent = true; // nothing is to be sent anymore
+}
+
+bool Http2Session::Closed() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return goaway_sent || (goaway_received && streams.empty());
+}
+
+void Http2Session::Finish(uint32_t id)
+{
+    Queues drained;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        const auto it = streams.find(id);
+        if (it == streams.end()) { // connection is gone meanwhile
+            return;
+        }
+        if (it->second.reset) { // nothing is to be sent
+            Drop(it);
+            return;
+        }
+        it->second.done = true;
+        PumpLocked(drained);
+    }
+    for (auto &q : drained) {
+        q->Produce();
+    }
+}
+
+void Http2Session::Dispatch(std::vector<Dispatched> &requests)
+{
+    for (auto &r : requests) {
+        const auto self = shared_from_this(); // kept alive until responses are complete
+        const uint32_t id = r.id;
+        if (!handler(id, r.head, std::move(r.out), [self, id]() { self->Finish(id); })) { // client may retry refused stream
+            std::lock_guard<std::mutex> lock(mtx);
+            const auto it = streams.find(id);
+            if (it != streams.end()) {
+                Reset(id, RefusedStream);
+                Drop(it);
+            }
+        }
+    }
+}
+
+void Http2Session::Process(uint8_t type, uint8_t flags, uint32_t id, const char *payload, size_t len, std::vector<Dispatched> &requests)
+{
+    switch (type) {
+    case Headers:
+        StartHeaders(flags, id, payload, len, requests);
+        break;
+    case Continuation:
+        if (!continuation) {
+            GoAway(ProtocolError);
+            break;
+        }
+        block.append(payload, len);
+        if (block.size() > read_capacity) {
+            GoAway(FrameSizeError);
+        } else if (flags & EndHeadersFlag) {
+            EndHeaders(requests);
+        }
+        break;
+    case Priority: // streams are served in order of their ids
+        if (len != 5) {
+            Reset(id, FrameSizeError);
+        }
+        break;
+    case RstStream:
+        if ((id == 0) || (len != 4)) {
+            GoAway((id == 0) ? ProtocolError : FrameSizeError);
+        } else {
+            const auto it = streams.find(id);
+            if (it != streams.end()) {
+                Close(it);
+                if ((++resets > c_max_resets) && (resets > opened / 2)) { // opening and resetting streams in a loop
+                    GoAway(EnhanceYourCalm);
+                }
+            }
+        }
+        break;
+    case Settings:
+        if ((id != 0) || ((flags & AckFlag) && (len != 0)) || (len % 6 != 0)) {
+            GoAway((id != 0) ? ProtocolError : FrameSizeError);
+        } else if (!(flags & AckFlag)) {
+            const uint32_t error = ApplySettings(payload, len);
+            if (error != NoError) {
+                GoAway(error);
+            } else {
+                SendFrame(Settings, AckFlag, 0, std::string());
+            }
+        }
+        break;
+    case PushPromise: // clients never push
+        GoAway(ProtocolError);
+        break;
+    case Ping:
+        if ((id != 0) || (len != 8)) {
+            GoAway((id != 0) ? ProtocolError : FrameSizeError);
+        } else if (!(flags & AckFlag)) {
+            SendFrame(Ping, AckFlag, 0, std::string(payload, len));
+        }
+        break;
+    case GoAwayFrame: // streams being served are completed, then the connection is closed
+        goaway_received = true;
+        break;
+    case WindowUpdate:
+        if (len != 4) {
+            GoAway(FrameSizeError);
+        } else {
+            UpdateWindow(id, Get32(payload) & 0x7fffffff);
+        }
+        break;
+    default: // unknown frames are ignored
+        break;
+    }
+}
+
+void Http2Session::StartHeaders(uint8_t flags, uint32_t id, const char *payload, size_t len, std::vector<Dispatched> &requests)
+{
+    if ((id == 0) || !(id & 1)) { // streams initiated by client are odd
+        GoAway(ProtocolError);
+        return;
+    }
+    size_t pad = 0;
+    if (flags & PaddedFlag) {
+        if (len < 1) {
+            GoAway(ProtocolError);
+            return;
+        }
+        pad = uint8_t(payload[0]);
+        ++payload;
+        --len;
+    }
+    if (flags & PriorityFlag) { // dependency and weight are ignored
+        if (len < 5) {
+            GoAway(ProtocolError);
+            return;
+        }
+        payload += 5;
+        len -= 5;
+    }
+    if (pad > len) {
+        GoAway(ProtocolError);
+        return;
+    }
+    block.assign(payload, len - pad);
+    block_stream = id;
+    block_end_stream = (flags & EndStreamFlag);
+    continuation = true;
+    if (flags & EndHeadersFlag) {
+        EndHeaders(requests);
+    }
+}
+
+void Http2Session::EndHeaders(std::vector<Dispatched> &requests)
+{
+    continuation = false;
+    Hpack::Fields fields;
+    const bool decoded = decoder.Decode(block.data(), block.size(), read_capacity, fields); // decoded even if stream is refused
+    block.clear();
+    if (!decoded) { // compression context of the connection is broken
+        GoAway(CompressionError);
+        return;
+    }
+    const uint32_t id = block_stream;
+    if (id <= last_stream_id) { // trailers of an open stream, ignored as request bodies are
+        const auto it = streams.find(id);
+        if ((it == streams.end()) || it->second.remote_closed || it->second.reset) {
+            Reset(id, StreamClosed);
+            if (it != streams.end()) {
+                Close(it);
+            }
+        } else if (!block_end_stream) { // trailers end the stream
+            Reset(id, ProtocolError);
+            Close(it);
+        } else {
+            it->second.remote_closed = true;
+        }
+        return;
+    }
+    last_stream_id = id;
+    if (goaway_received || (streams.size() >= c_max_streams)) {
+        Reset(id, RefusedStream);
+        return;
+    }
+    std::string head;
+    if (!ToHttp1(fields, head)) {
+        Reset(id, ProtocolError);
+        return;
+    }
+    Open(id, std::move(head), block_end_stream, requests);
+}
+
+void Http2Session::EndData()
+{
+    // request bodies are discarded, so the windows are replenished right away
+    if (data_len > 0) {
+        std::string increment;
+        Put32(uint32_t(data_len), increment);
+        SendFrame(WindowUpdate, 0, 0, increment);
+        if (!(data_flags & EndStreamFlag) && streams.count(data_stream)) {
+            SendFrame(WindowUpdate, 0, data_stream, increment);
+        }
+    }
+    data_len = 0;
+}
+
+uint32_t Http2Session::ApplySettings(const char *payload, size_t len)
+{
+    for (size_t i = 0; i + 6 <= len; i += 6) {
+        const uint16_t id = (uint16_t(uint8_t(payload[i])) << 8) | uint8_t(payload[i + 1]);
+        const uint32_t value = Get32(payload + i + 2);
+        switch (id) {
+        case HeaderTableSize:
+            encoder.SetMaxTableSize(value);
+            break;
+        case EnablePush:
+            if (value > 1) {
+                return ProtocolError;
+            }
+            break;
+        case InitialWindowSize:
+            if (value > c_max_window) {
+                return FlowControlError;
+            }
+            for (const auto &st : streams) { // no window may grow beyond the maximum
+                if (st.second.window + int64_t(value) - initial_window > c_max_window) {
+                    return FlowControlError;
+                }
+            }
+            for (auto &st : streams) { // windows of open streams change by the difference
+                st.second.window += int64_t(value) - initial_window;
+            }
+            initial_window = value;
+            break;
+        case MaxFrameSize:
+            if ((value < c_max_frame) || (value > 0xffffff)) {
+                return ProtocolError;
+            }
+            break; // frames sent are never larger than the default anyway
+        default:
+            break;
+        }
+    }
+    return NoError;
+}
+
+void Http2Session::UpdateWindow(uint32_t id, uint32_t increment)
+{
+    if (id == 0) {
+        if ((increment == 0) || (window + increment > c_max_window)) {
+            GoAway((increment == 0) ? ProtocolError : FlowControlError);
+            return;
+        }
+        window += increment;
+        return;
+    }
+    const auto it = streams.find(id);
+    if (it == streams.end()) {
+        return;
+    }
+    if ((increment == 0) || (it->second.window + increment > c_max_window)) {
+        Reset(id, (increment == 0) ? ProtocolError : FlowControlError);
+        Drop(it);
+        return;
+    }
+    it->second.window += increment;
+}
+
+void Http2Session::Open(uint32_t id, std::string head, bool end_stream, std::vector<Dispatched> &requests)
+{
+    auto st_out = std::make_shared<IO::OutQueue>(s, 0); // never paused, as it is never read from
+    st_out->Defer();
+    std::weak_ptr<Http2Session> self = shared_from_this();
+    st_out->SetProducer(out->Producer(), [self]() { // streamed body goes on once its next piece is produced
+        if (auto session = self.lock()) {
+            session->Pump();
+        }
+    });
+    streams.insert(std::make_pair(id, Stream(st_out, initial_window, end_stream)));
+    ++opened;
+    out->BeginResponse(); // connection is busy until the stream is done
+    Dispatched d;
+    d.id = id;
+    d.head = std::move(head);
+    d.out = std::move(st_out);
+    requests.push_back(std::move(d));
+}
+
+//
+
+void Http2Session::PumpLocked(Queues &drained)
+{
+    if (goaway_sent || !preface) { // after upgrade, client takes nothing but 101 and SETTINGS until it sends its preface
+        return;
+    }
+    out->Cork(); // frames are written in batches
+    for (bool progress = true; progress && out->ReadingAllowed(); ) { // one frame per stream in every round
+        progress = false;
+        for (auto it = streams.begin(); it != streams.end(); ) {
+            auto &st = it->second;
+            if (!st.done) {
+                ++it;
+                continue;
+            }
+            if (!st.headers_sent) {
+                bool end = false;
+                if (!SendHeaders(it->first, st, end)) {
+                    Reset(it->first, InternalError);
+                    it = Drop(it);
+                    continue;
+                }
+                progress = true;
+                if (end) {
+                    it = Drop(it);
+                    continue;
+                }
+            }
+            const size_t queued = st.out->Queued();
+            const bool producing = st.out->Producing();
+            if ((queued == 0) && !producing) { // source has ended while nothing was queued
+                SendFrame(Data, EndStreamFlag, it->first, std::string());
+                progress = true;
+                it = Drop(it);
+                continue;
+            }
+            const size_t n = std::min(queued, size_t(std::max<int64_t>(0, std::min(std::min(window, st.window), int64_t(c_max_frame)))));
+            if (n == 0) { // blocked by flow control (or waiting for the next piece of a source)
+                ++it;
+                continue;
+            }
+            bool end = (n == queued) && !producing;
+            out->Push(FrameHeader(n, Data, end ? EndStreamFlag : 0, it->first));
+            st.out->MoveTo(*out, n); // payload isn't copied
+            if (producing && (drained.empty() || (drained.back() != st.out))) {
+                drained.push_back(st.out);
+            }
+            window -= n;
+            st.window -= n;
+            progress = true;
+            if (!end && (st.out->Queued() == 0) && !st.out->Producing()) { // source has just ended
+                SendFrame(Data, EndStreamFlag, it->first, std::string());
+                end = true;
+            }
+            it = end ? Drop(it) : std::next(it);
+        }
+    }
+    out->Uncork();
+}
+
+bool Http2Session::SendHeaders(uint32_t id, Stream &st, bool &end)
+{
+    std::string head; // response line and headers are gathered, the body stays in the queue
+    for (bool found = false; !found; ) {
+        IO::OutQueue::WriteOp op;
+        if (!st.out->NextWrite(op)) {
+            return false;
+        }
+        if (op.file >= 0) {
+            st.out->Written(-EAGAIN);
+            return false;
+        }
+        size_t consumed = 0;
+        for (int i = 0; (i < op.iov_cnt) && !found; ++i) {
+            const char *p = static_cast<const char *>(op.iov[i].iov_base);
+            for (size_t j = 0; (j < op.iov[i].iov_len) && !found; ++j) {
+                head += p[j];
+                ++consumed;
+                found = (head.size() >= 4) && (head.compare(head.size() - 4, 4, "\r\n\r\n") == 0);
+            }
+        }
+        st.out->Written(consumed);
+        if (head.size() > c_max_response_head) {
+            return false;
+        }
+    }
+    Hpack::Fields fields;
+    if (!FromHttp1(head, fields)) {
+        return false;
+    }
+    std::string block;
+    encoder.Encode(fields, block);
+    end = (st.out->Queued() == 0) && !st.out->Producing();
+    const uint8_t end_stream = end ? EndStreamFlag : 0;
+    for (size_t pos = 0; ; ) { // block is split into HEADERS and CONTINUATION frames if needed
+        const size_t n = std::min(block.size() - pos, c_max_frame);
+        const bool last = (pos + n == block.size());
+        SendFrame((pos == 0) ? Headers : Continuation, ((pos == 0) ? end_stream : 0) | (last ? EndHeadersFlag : 0), id, block.substr(pos, n));
+        pos += n;
+        if (last) {
+            break;
+        }
+    }
+    st.headers_sent = true;
+    return true;
+}
+
+void Http2Session::Close(std::map<uint32_t, Stream>::iterator it)
+{
+    if (it->second.done) {
+        Drop(it);
+    } else { // request is still queued or being served, so the stream keeps counting against the limit until it is done
+        it->second.reset = true;
+    }
+}
+
+std::map<uint32_t, Http2Session::Stream>::iterator Http2Session::Drop(std::map<uint32_t, Stream>::iterator it)
+{
+    out->EndResponse();
+    return streams.erase(it);
+}
+
+void Http2Session::SendFrame(uint8_t type, uint8_t flags, uint32_t id, const std::string &payload)
+{
+    auto frame = FrameHeader(payload.size(), type, flags, id);
+    frame += payload;
+    out->Push(std::move(frame));
+}
+
+void Http2Session::SendSettings()
+{
+    std::string payload;
+    PutSetting(MaxConcurrentStreams, c_max_streams, payload);
+    PutSetting(MaxHeaderListSize, read_capacity, payload);
+    SendFrame(Settings, 0, 0, payload);
+}
+
+void Http2Session::Reset(uint32_t id, uint32_t error)
+{
+    std::string payload;
+    Put32(error, payload);
+    SendFrame(RstStream, 0, id, payload);
+}
+
+void Http2Session::GoAway(uint32_t error)
+{
+    LOG_DEBUG("HTTP/2", s, -1, "GOAWAY, error ", std::to_string(error).c_str());
+    std::string payload;
+    Put32(last_stream_id, payload);
+    Put32(error, payload);
+    SendFrame(GoAwayFrame, 0, 0, payload);
+    for (auto it = streams.begin(); it != streams.end(); ) {
+        it = Drop(it);
+    }
+    goaway_sent = true;
+}
+
+}
@@ -0,0 +1,123 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include "hpack.h"
+#include "io.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+namespace Http {
+
+// cleartext HTTP/2 connection (RFC 7540), entered either with prior knowledge (client starts with the preface) or by 'Upgrade: h2c';
+// request of every stream is turned into HTTP/1.1 wire form and served by the usual path (concurrently with other streams),
+// its response pushed into a queue of the stream is converted into HEADERS and DATA frames afterwards,
+// which are interleaved across streams as flow control windows and connection's output allow
+class Http2Session : public std::enable_shared_from_this<Http2Session>
+{
+public:
+    static const char c_preface[]; // sent by client first
+    static const size_t c_preface_len = 24;
+    static const size_t c_max_streams = 128; // concurrently open streams, further ones are refused
+    static const size_t c_max_resets = 100; // streams reset by client, more than that (and more than half of the opened ones) close the connection
+
+    // called for request of every stream (without session's lock held): 'head' is request line and headers,
+    // response is to be pushed to 'out' and 'done' called once it is pushed completely; 'false' means request is refused (e.g., overload)
+    using Handler = std::function<bool(uint32_t stream_id, const std::string &head, std::shared_ptr<IO::OutQueue> out, std::function<void()> done)>;
+
+    // frames are read from buffer of 'read_capacity' bytes, so no other frame than DATA could be larger than that
+    Http2Session(IO::Socket _s, std::shared_ptr<IO::OutQueue> _out, size_t _read_capacity, Handler _handler);
+
+    Http2Session(const Http2Session &) = delete;
+    Http2Session &operator =(const Http2Session &) = delete;
+
+    void Start(); // sends server's preface, for connections with prior knowledge
+
+    // switches from HTTP/1.1: 'settings' is the value of 'HTTP2-Settings' header, request 'head' becomes stream 1;
+    // '101 Switching Protocols' and server's preface are sent unless 'settings' are malformed ('false' is returned then)
+    bool Upgrade(const std::string &settings, const std::string &head);
+
+    size_t Receive(const char *data, size_t len); // processes received frames, returns number of bytes consumed
+    void Pump(); // sends responses as far as flow control windows and connection's output allow
+    void Abort(); // connection is gone, streams are dropped
+
+    bool Closed() const; // no more frames are to be read
+private:
+    struct Stream
+    {
+        std::shared_ptr<IO::OutQueue> out; // response is pushed here...
+        bool done;                          // ...completely
+        bool reset; // by client (or by a stream error) before the response is done, stream is dropped once it is
+        bool remote_closed; // client has ended its side (END_STREAM), it may only send trailers before that
+        bool headers_sent;
+        int64_t window; // bytes peer is ready to receive
+
+        Stream(std::shared_ptr<IO::OutQueue> _out, int64_t _window, bool _remote_closed);
+    };
+
+    struct Dispatched // requests are handed over once session's lock is released
+    {
+        uint32_t id;
+        std::string head;
+        std::shared_ptr<IO::OutQueue> out;
+    };
+
+    void Finish(uint32_t id);
+    void Dispatch(std::vector<Dispatched> &requests);
+
+    void Process(uint8_t type, uint8_t flags, uint32_t id, const char *payload, size_t len, std::vector<Dispatched> &requests);
+    void StartHeaders(uint8_t flags, uint32_t id, const char *payload, size_t len, std::vector<Dispatched> &requests);
+    void EndHeaders(std::vector<Dispatched> &requests);
+    void EndData();
+    uint32_t ApplySettings(const char *payload, size_t len); // error code
+    void UpdateWindow(uint32_t id, uint32_t increment);
+    void Open(uint32_t id, std::string head, bool end_stream, std::vector<Dispatched> &requests);
+    void Close(std::map<uint32_t, Stream>::iterator it); // stream is closed before its response is done: dropped right away or once it is
+
+    using Queues = std::vector<std::shared_ptr<IO::OutQueue>>;
+    void PumpLocked(Queues &drained); // 'drained' gets queues of streamed bodies, which produce next pieces once the lock is released
+    bool SendHeaders(uint32_t id, Stream &st, bool &end); // 'false' if response is malformed, 'end' if there is no body (END_STREAM is set)
+    std::map<uint32_t, Stream>::iterator Drop(std::map<uint32_t, Stream>::iterator it);
+
+    void SendFrame(uint8_t type, uint8_t flags, uint32_t id, const std::string &payload);
+    void SendSettings();
+    void Reset(uint32_t id, uint32_t error);
+    void GoAway(uint32_t error); // connection error, streams are dropped
+
+    mutable std::mutex mtx;
+    IO::Socket s;
+    std::shared_ptr<IO::OutQueue> out;
+    size_t read_capacity;
+    Handler handler;
+
+    Hpack::Decoder decoder;
+    Hpack::Encoder encoder;
+    std::map<uint32_t, Stream> streams; // open ones, responses go out in order of stream ids within every round
+    uint32_t last_stream_id; // highest one opened by client
+    size_t opened; // streams
+    size_t resets; // streams reset by client
+    int64_t window; // connection's, shared by all streams
+    int64_t initial_window; // of new streams, peer's SETTINGS_INITIAL_WINDOW_SIZE
+
+    bool preface; // client's preface is received
+    size_t data_len; // DATA frame being received (its payload is discarded as it comes)...
+    size_t data_left;
+    uint32_t data_stream;
+    uint8_t data_flags;
+    bool continuation; // header block is being received...
+    std::string block;
+    uint32_t block_stream;
+    bool block_end_stream; // END_STREAM of HEADERS frame starting the block
+
+    bool goaway_sent;
+    bool goaway_received;
+};
+
+}
+
+#endif
@@ -0,0 +1,260 @@
+#include "http_parser.h"
+#include "http_scan.h"
+
+#include <cstring>
+#include <strings.h>
+
+namespace Http {
+
+Span::Span()
+    : off(0)
+    , len(0)
+{
+}
+
+std::string Span::Str(const char *base) const
+{
+    return std::string(base + off, len);
+}
+
+bool Span::Equals(const char *base, const char *str) const
+{
+    return (strlen(str) == len) && (memcmp(base + off, str, len) == 0);
+}
+
+bool Span::EqualsNoCase(const char *base, const char *str) const
+{
+    return (strlen(str) == len) && (strncasecmp(base + off, str, len) == 0);
+}
+
+//
+
+void RequestHead::Clear()
+{
+    method = uri = version = Span();
+    headers.clear(); // keeps capacity, so parsing of subsequent requests doesn't allocate
+    request_line_len = 0;
+    head_len = 0;
+    content_len = 0;
+}
+
+const RequestHead::Header *RequestHead::Find(const char *base, const char *name) const
+{
+    for (const auto &h : headers) {
+        if (h.name.EqualsNoCase(base, name)) {
+            return &h;
+        }
+    }
+    return nullptr;
+}
+
+//
+
+Parser::Parser(const Limits &_limits)
+    : limits(_limits)
+{
+    Reset();
+}
+
+void Parser::Reset()
+{
+    state = RequestLineStart;
+    pos = 0;
+    mark = 0;
+    head.Clear();
+    error_status = nullptr;
+}
+
+const RequestHead &Parser::Head() const
+{
+    return head;
+}
+
+const char *Parser::ErrorStatus() const
+{
+    return error_status;
+}
+
+Parser::Result Parser::Fail(const char *status)
+{
+    error_status = status;
+    return Failed;
+}
+
+bool Parser::EndHeader(const char *buf)
+{
+    auto &h = head.headers.back();
+    while ((h.value.len > 0) && ((buf[h.value.off + h.value.len - 1] == ' ') || (buf[h.value.off + h.value.len - 1] == '\t'))) {
+        --h.value.len;
+    }
+    if (h.name.EqualsNoCase(buf, "Content-Length")) {
+        if (h.value.len == 0) {
+            return false;
+        }
+        size_t n = 0;
+        for (uint32_t i = 0; i < h.value.len; ++i) {
+            const char c = buf[h.value.off + i];
+            if ((c < '0') || (c > '9') || (n > (SIZE_MAX - 9) / 10)) {
+                return false;
+            }
+            n = n * 10 + (c - '0');
+        }
+        head.content_len = n;
+    }
+    return true;
+}
+
+Parser::Result Parser::Parse(const char *buf, size_t len)
+{
+    if (error_status) {
+        return Failed;
+    }
+    const char *const end = buf + len;
+    while (pos < len) {
+        const char *p = buf + pos;
+        switch (state) {
+        case RequestLineStart:
+            if ((*p == '\r') || (*p == '\n')) { // tolerate empty lines preceding request line (RFC 7230, 3.5)
+                ++pos;
+                break;
+            }
+            mark = pos;
+            state = Method;
+            break;
+        case Method:
+            p = Scan::SkipToken(p, end);
+            pos = p - buf;
+            if (p == end) {
+                break;
+            }
+            if ((*p != ' ') || (pos == mark)) {
+                return Fail("400 Bad Request");
+            }
+            head.method.off = mark;
+            head.method.len = pos - mark;
+            mark = ++pos;
+            state = Uri;
+            break;
+        case Uri:
+            p = Scan::FindSpaceOrLineEnd(p, end);
+            pos = p - buf;
+            if (p == end) {
+                break;
+            }
+            if ((*p != ' ') || (pos == mark)) {
+                return Fail("400 Bad Request");
+            }
+            head.uri.off = mark;
+            head.uri.len = pos - mark;
+            mark = ++pos;
+            state = Version;
+            break;
+        case Version:
+            p = Scan::FindLineEnd(p, end);
+            pos = p - buf;
+            if (p == end) {
+                break;
+            }
+            if ((pos - mark != strlen("HTTP/x.y")) || (memcmp(buf + mark, "HTTP/", strlen("HTTP/")) != 0)) {
+                return Fail("400 Bad Request");
+            }
+            head.version.off = mark;
+            head.version.len = pos - mark;
+            head.request_line_len = pos - head.method.off;
+            if (head.request_line_len > limits.max_request_line) {
+                return Fail("414 URI Too Long");
+            }
+            state = (*p == '\r') ? RequestLineLF : HeaderStart;
+            ++pos;
+            break;
+        case RequestLineLF:
+        case HeaderLF:
+            if (*p != '\n') {
+                return Fail("400 Bad Request");
+            }
+            if ((state == HeaderLF) && !EndHeader(buf)) {
+                return Fail("400 Bad Request");
+            }
+            state = HeaderStart;
+            ++pos;
+            break;
+        case HeaderStart:
+            if ((*p == '\r') || (*p == '\n')) {
+                state = HeadLF;
+                if (*p == '\r') {
+                    ++pos;
+                }
+                break;
+            }
+            if (head.headers.size() == limits.max_headers) {
+                return Fail("431 Request Header Fields Too Large");
+            }
+            mark = pos;
+            state = HeaderName;
+            break;
+        case HeaderName:
+            p = Scan::SkipToken(p, end);
+            pos = p - buf;
+            if (p == end) {
+                break;
+            }
+            if ((*p != ':') || (pos == mark)) { // also rejects obsolete line folding
+                return Fail("400 Bad Request");
+            }
+            head.headers.push_back(RequestHead::Header());
+            head.headers.back().name.off = mark;
+            head.headers.back().name.len = pos - mark;
+            ++pos;
+            state = HeaderValueStart;
+            break;
+        case HeaderValueStart:
+            if ((*p == ' ') || (*p == '\t')) {
+                ++pos;
+                break;
+            }
+            mark = pos;
+            state = HeaderValue;
+            break;
+        case HeaderValue:
+            p = Scan::FindLineEnd(p, end);
+            pos = p - buf;
+            if (p == end) {
+                break;
+            }
+            head.headers.back().value.off = mark;
+            head.headers.back().value.len = pos - mark;
+            if (*p == '\r') {
+                state = HeaderLF;
+            } else if (!EndHeader(buf)) {
+                return Fail("400 Bad Request");
+            } else {
+                state = HeaderStart;
+            }
+            ++pos;
+            break;
+        case HeadLF:
+            if (*p != '\n') {
+                return Fail("400 Bad Request");
+            }
+            head.head_len = ++pos;
+            if (head.head_len > limits.max_head_bytes) {
+                return Fail("431 Request Header Fields Too Large");
+            }
+            if (head.Find(buf, "Transfer-Encoding")) {
+                return Fail("501 Not Implemented");
+            }
+            return Complete;
+        }
+    }
+
+    const size_t line_start = (state == Method) ? mark : head.method.off;
+    if ((state >= Method) && (state <= Version) && (pos - line_start > limits.max_request_line)) {
+        return Fail("414 URI Too Long");
+    }
+    if (pos >= limits.max_head_bytes) {
+        return Fail("431 Request Header Fields Too Large");
+    }
+    return Incomplete;
+}
+
+}
@@ -0,0 +1,98 @@
+#ifndef HTTPPARSER_H
+#define HTTPPARSER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace Http {
+
+struct Span // location of a token relative to the first byte of the request
+{
+    uint32_t off;
+    uint32_t len;
+
+    Span();
+
+    std::string Str(const char *base) const;
+    bool Equals(const char *base, const char *str) const;
+    bool EqualsNoCase(const char *base, const char *str) const;
+};
+
+struct RequestHead
+{
+    struct Header
+    {
+        Span name;
+        Span value;
+    };
+
+    Span method;
+    Span uri;
+    Span version;
+    std::vector<Header> headers;
+    size_t request_line_len; // without line terminator
+    size_t head_len;         // request line and headers including terminating empty line
+    size_t content_len;
+
+    void Clear();
+
+    const Header *Find(const char *base, const char *name) const; // header names are case-insensitive
+};
+
+class Parser
+{
+public:
+    struct Limits
+    {
+        size_t max_request_line;
+        size_t max_headers;
+        size_t max_head_bytes;
+    };
+
+    enum Result
+    {
+        Incomplete,
+        Complete,
+        Failed
+    };
+
+    explicit Parser(const Limits &_limits);
+
+    // 'buf' must start at the first byte of the current request and contain all bytes passed by the previous calls
+    // (i.e., buffer is allowed to grow or move between calls, but not to lose bytes); parsing resumes where previous call stopped
+    Result Parse(const char *buf, size_t len);
+    void Reset();
+
+    const RequestHead &Head() const;
+    const char *ErrorStatus() const; // valid if Parse returned 'Failed'
+private:
+    enum State
+    {
+        RequestLineStart,
+        Method,
+        Uri,
+        Version,
+        RequestLineLF,
+        HeaderStart,
+        HeaderName,
+        HeaderValueStart,
+        HeaderValue,
+        HeaderLF,
+        HeadLF
+    };
+
+    Result Fail(const char *status);
+    bool EndHeader(const char *buf);
+
+    Limits limits;
+    State state;
+    size_t pos;
+    size_t mark; // start of the token being scanned
+    RequestHead head;
+    const char *error_status;
+};
+
+}
+
+#endif
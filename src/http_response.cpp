@@ -0,0 +1,572 @@
+#include "http_response.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+
+#include <strings.h>
+#include <zlib.h>
+
+namespace Http {
+
+namespace {
+
+const char *c_range_not_satisfiable = "416 Range Not Satisfiable";
+const std::string c_accept_ranges = "Accept-Ranges: bytes\r\n";
+const size_t c_chunk_header_len = 10; // fixed-width hex size (leading zeros are allowed) and CRLF
+const int c_gzip_level = Z_DEFAULT_COMPRESSION; // cached and streamed variants share the "-gzip" ETag, so they must be the same bytes
+
+bool ParseOffset(const char *&p, off_t &res) // at least one digit, fails on overflow
+{
+    if ((*p < '0') || (*p > '9')) {
+        return false;
+    }
+    res = 0;
+    for (; (*p >= '0') && (*p <= '9'); ++p) {
+        if (res > (std::numeric_limits<off_t>::max() - (*p - '0')) / 10) {
+            return false;
+        }
+        res = res * 10 + (*p - '0');
+    }
+    return true;
+}
+
+void SkipSpaces(const char *&p)
+{
+    while ((*p == ' ') || (*p == '\t')) {
+        ++p;
+    }
+}
+
+std::string Boundary()
+{
+    static std::atomic<uint64_t> count(0);
+    uint64_t x = (++count) * 0x9e3779b97f4a7c15ull ^ uint64_t(time(nullptr));
+    x ^= x >> 31;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 29;
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(x));
+    return buf;
+}
+
+std::string ContentRange(off_t first, off_t last, off_t size)
+{
+    return "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(size);
+}
+
+// all but body length, no content type is described if 'content_type' is 'nullptr' (e.g., '304 Not Modified')
+std::string HeaderLines(const char *status_code, const char *content_type, const std::string &extra)
+{
+    std::string res = "HTTP/1.1 ";
+    res += status_code;
+    res += "\r\n";
+    res += "Server: HttpServer\r\n";
+    res += "Connection: keep-alive\r\n";
+    res += "Keep-Alive: timeout=";
+    res += std::to_string(Response::c_keep_alive_sec);
+    res += "\r\n";
+    if (content_type) {
+        res += "Content-type: ";
+        res += content_type;
+        res += "\r\n";
+        res += "X-Content-Type-Options: nosniff\r\n";
+    }
+    res += extra;
+    return res;
+}
+
+}
+
+//
+
+bool ByteRange::Parse(const std::string &spec, off_t size, std::vector<ByteRange> &ranges)
+{
+    ranges.clear();
+    const char *p = spec.c_str();
+    SkipSpaces(p);
+    if (strncasecmp(p, "bytes", 5) != 0) {
+        return false;
+    }
+    p += 5;
+    SkipSpaces(p);
+    if (*p++ != '=') {
+        return false;
+    }
+    size_t count = 0;
+    for (;;) {
+        SkipSpaces(p);
+        if (*p == ',') { // empty list elements are allowed
+            ++p;
+            continue;
+        }
+        if (!*p) {
+            break;
+        }
+        ByteRange r;
+        if (*p == '-') { // suffix: last N bytes
+            ++p;
+            off_t n;
+            if (!ParseOffset(p, n)) {
+                return false;
+            }
+            r.first = size - std::min(n, size);
+            r.last = size - 1;
+            if (n == 0) {
+                r.first = size; // unsatisfiable
+            }
+        } else {
+            if (!ParseOffset(p, r.first) || (*p++ != '-')) {
+                return false;
+            }
+            r.last = size - 1;
+            if ((*p >= '0') && (*p <= '9')) {
+                if (!ParseOffset(p, r.last) || (r.last < r.first)) {
+                    return false;
+                }
+                r.last = std::min(r.last, size - 1);
+            }
+        }
+        if (++count > c_max_ranges) {
+            ranges.clear();
+            return false;
+        }
+        if (r.first < size) {
+            ranges.push_back(r);
+        }
+        SkipSpaces(p);
+        if (*p == ',') {
+            ++p;
+        } else if (*p) {
+            ranges.clear();
+            return false;
+        }
+    }
+    if (count == 0) {
+        return false;
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const ByteRange &a, const ByteRange &b) { return a.first < b.first; });
+    size_t n = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (n && (ranges[i].first <= ranges[n - 1].last + 1)) {
+            ranges[n - 1].last = std::max(ranges[n - 1].last, ranges[i].last);
+        } else {
+            ranges[n++] = ranges[i];
+        }
+    }
+    ranges.resize(n);
+    return true;
+}
+
+size_t ByteRange::Len() const
+{
+    return last - first + 1;
+}
+
+//
+
+Validators::Validators(const struct stat &st, const char *encoding)
+    : last_modified(Response::Date(st.st_mtime))
+    , mtime(st.st_mtime)
+{
+    char buf[96];
+    snprintf(buf, sizeof(buf), "\"%llx-%llx-%llx%s%s\"", static_cast<unsigned long long>(st.st_ino), static_cast<unsigned long long>(st.st_size),
+             static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ull + st.st_mtim.tv_nsec, encoding ? "-" : "", encoding ? encoding : "");
+    etag = buf;
+}
+
+std::string Validators::Headers() const
+{
+    return "ETag: " + etag + "\r\nLast-Modified: " + last_modified + "\r\n";
+}
+
+bool Validators::MatchesAny(const std::string &if_none_match) const
+{
+    const char *p = if_none_match.c_str();
+    for (;;) {
+        while ((*p == ' ') || (*p == '\t') || (*p == ',')) {
+            ++p;
+        }
+        if (!*p) {
+            return false;
+        }
+        if (*p == '*') {
+            return true;
+        }
+        if (strncmp(p, "W/", 2) == 0) { // weak comparison: weakness is ignored
+            p += 2;
+        }
+        if (*p != '"') {
+            return false; // malformed
+        }
+        const char *end = strchr(p + 1, '"');
+        if (!end) {
+            return false;
+        }
+        if ((size_t(end + 1 - p) == etag.size()) && (strncmp(p, etag.data(), etag.size()) == 0)) {
+            return true;
+        }
+        p = end + 1;
+    }
+}
+
+bool Validators::ModifiedSince(const std::string &if_modified_since) const
+{
+    struct tm tm = {};
+    const char *end = strptime(if_modified_since.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end) {
+        return true;
+    }
+    return mtime > timegm(&tm);
+}
+
+bool Validators::Matches(const std::string &if_range) const
+{
+    return (if_range == etag) || (if_range == last_modified); // weak entity tags never match as they start with "W/"
+}
+
+//
+
+unsigned Encoding::Accepted(const std::string &accept_encoding)
+{
+    unsigned listed = 0;
+    unsigned accepted = 0;
+    bool any = false;
+    std::istringstream items(accept_encoding);
+    for (std::string item; std::getline(items, item, ','); ) {
+        const char *p = item.c_str();
+        SkipSpaces(p);
+        const char *name = p;
+        while (*p && (*p != ';') && (*p != ' ') && (*p != '\t')) {
+            ++p;
+        }
+        const std::string coding(name, p);
+        double q = 1;
+        if (const char *qv = strstr(p, "q=")) {
+            q = strtod(qv + 2, nullptr);
+        }
+        unsigned e = 0;
+        if ((strcasecmp(coding.c_str(), "gzip") == 0) || (strcasecmp(coding.c_str(), "x-gzip") == 0)) {
+            e = Gzip;
+        } else if (strcasecmp(coding.c_str(), "br") == 0) {
+            e = Brotli;
+        } else if (coding == "*") {
+            any = (q > 0);
+            continue;
+        }
+        listed |= e;
+        if (q > 0) {
+            accepted |= e;
+        }
+    }
+    if (any) {
+        accepted |= (Gzip | Brotli) & ~listed;
+    }
+    return accepted;
+}
+
+bool Encoding::Compressible(const char *mime_type)
+{
+    return (strncmp(mime_type, "text/", 5) == 0) || strstr(mime_type, "javascript") || strstr(mime_type, "json") || strstr(mime_type, "xml");
+}
+
+bool Encoding::Compress(const std::string &data, std::string &res)
+{
+    z_stream zs = {};
+    if (deflateInit2(&zs, c_gzip_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) { // +16 for gzip wrapper
+        return false;
+    }
+    const size_t start = res.size();
+    res.resize(start + deflateBound(&zs, data.size()));
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    zs.avail_in = data.size();
+    zs.next_out = reinterpret_cast<Bytef *>(&res[start]);
+    zs.avail_out = res.size() - start;
+    const bool ok = (deflate(&zs, Z_FINISH) == Z_STREAM_END);
+    res.resize(ok ? (start + zs.total_out) : start);
+    deflateEnd(&zs);
+    return ok;
+}
+
+//
+
+struct GzipStream::Impl
+{
+    std::shared_ptr<const IO::File> f;
+    bool chunked;
+    std::vector<char> in; // reused for every piece
+    off_t offset;
+    z_stream zs;
+    bool ready;    // deflate state is initialized
+    bool finished; // last piece is produced
+
+    Impl(std::shared_ptr<const IO::File> _f, size_t chunk_bytes, bool _chunked);
+    ~Impl();
+
+    bool Deflate(size_t len, bool last, std::string &piece); // appends compressed output of 'len' bytes of 'in'
+};
+
+GzipStream::Impl::Impl(std::shared_ptr<const IO::File> _f, size_t chunk_bytes, bool _chunked)
+    : f(std::move(_f))
+    , chunked(_chunked)
+    , in(std::max<size_t>(chunk_bytes, 1))
+    , offset(0)
+    , zs()
+    , ready(deflateInit2(&zs, c_gzip_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+    , finished(false)
+{
+}
+
+GzipStream::Impl::~Impl()
+{
+    if (ready) {
+        deflateEnd(&zs);
+    }
+}
+
+bool GzipStream::Impl::Deflate(size_t len, bool last, std::string &piece)
+{
+    zs.next_in = reinterpret_cast<Bytef *>(in.data());
+    zs.avail_in = len;
+    size_t used = piece.size();
+    int rc;
+    do {
+        const size_t room = deflateBound(&zs, zs.avail_in);
+        piece.resize(used + room);
+        zs.next_out = reinterpret_cast<Bytef *>(&piece[used]);
+        zs.avail_out = room;
+        rc = deflate(&zs, last ? Z_FINISH : Z_NO_FLUSH);
+        used += room - zs.avail_out;
+    } while ((rc == Z_OK) && (zs.avail_out == 0));
+    piece.resize(used);
+    return last ? (rc == Z_STREAM_END) : (rc == Z_OK) || (rc == Z_BUF_ERROR); // the latter if nothing could be done
+}
+
+GzipStream::GzipStream(std::shared_ptr<const IO::File> _f, size_t _chunk_bytes, bool _chunked)
+    : pimpl(new Impl(std::move(_f), _chunk_bytes, _chunked))
+{
+}
+
+GzipStream::~GzipStream() = default;
+
+bool GzipStream::Next(std::string &piece)
+{
+    piece.clear();
+    if (pimpl->finished) {
+        return true;
+    }
+    if (!pimpl->ready) {
+        return false;
+    }
+    const size_t header_len = pimpl->chunked ? c_chunk_header_len : 0;
+    piece.resize(header_len);
+    while ((piece.size() == header_len) && !pimpl->finished) { // deflate may buffer a whole chunk without output
+        const auto n = pimpl->f->Read(pimpl->offset, pimpl->in.data(), pimpl->in.size());
+        if (n < 0) {
+            return false;
+        }
+        pimpl->offset += n;
+        pimpl->finished = (n == 0) || (pimpl->offset >= pimpl->f->Size()); // file growing meanwhile is cut at its original size
+        if (!pimpl->Deflate(n, pimpl->finished, piece)) {
+            return false;
+        }
+    }
+    if (pimpl->chunked) {
+        char size[c_chunk_header_len + 1];
+        snprintf(size, sizeof(size), "%08zx\r\n", piece.size() - header_len);
+        memcpy(&piece[0], size, header_len);
+        piece += "\r\n";
+        if (pimpl->finished) {
+            piece += "0\r\n\r\n";
+        }
+    }
+    return true;
+}
+
+//
+
+off_t Response::Body::Size() const
+{
+    return cached ? (cached->response.size() - cached->header_len) : file->Size(); // cached body could be compressed
+}
+
+void Response::Body::Push(IO::OutQueue &out, off_t offset, size_t len) const
+{
+    if (cached) {
+        out.Push(cached, cached->response.data() + cached->header_len + offset, len);
+    } else {
+        out.Push(file, offset, len);
+    }
+}
+
+std::string Response::Date(time_t t)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+std::string Response::Header(const char *status_code, const char *content_type, size_t content_len, const std::string &extra)
+{
+    auto res = HeaderLines(status_code, content_type, extra);
+    res += "Content-length: ";
+    res += std::to_string(content_len);
+    res += "\r\n\r\n";
+    return res;
+}
+
+std::string Response::FileHeader(const char *content_type, off_t size, const std::string &meta)
+{
+    return Header("200 OK", content_type, size, c_accept_ranges + meta);
+}
+
+size_t Response::Send(IO::OutQueue &out, const char *status_code, const char *content_type, size_t content_len, const std::string &content,
+                      const std::string &extra)
+{
+    auto res = Header(status_code, content_type, content_len, extra);
+    res += content; // std::string is used for 'content' to allow '\0' character to be in the middle of the buffer
+
+    const size_t n = res.size();
+    out.Push(std::move(res));
+    return n;
+}
+
+size_t Response::SendFile(IO::OutQueue &out, const char *content_type, std::shared_ptr<const IO::File> f, const std::string &meta, bool head_only)
+{
+    const size_t len = f->Size();
+    auto header = FileHeader(content_type, len, meta);
+    const size_t n = header.size() + (head_only ? 0 : len);
+    out.Cork();
+    out.Push(std::move(header));
+    if (!head_only) {
+        out.Push(std::move(f), 0, len); // body never passes through user space
+    }
+    out.Uncork();
+    return n;
+}
+
+size_t Response::SendCached(IO::OutQueue &out, FileCache::EntryPtr e, bool head_only)
+{
+    const char *data = e->response.data();
+    const size_t len = head_only ? e->header_len : e->response.size();
+    out.Push(std::move(e), data, len); // entry stays alive until response is written, even if it is evicted meanwhile
+    return len;
+}
+
+size_t Response::SendStream(IO::OutQueue &out, const char *content_type, std::shared_ptr<IO::Source> body, const std::string &meta, bool chunked,
+                            bool head_only)
+{
+    auto header = HeaderLines("200 OK", content_type, meta);
+    if (chunked) {
+        header += "Transfer-Encoding: chunked\r\n";
+    }
+    header += "\r\n";
+    const size_t n = header.size();
+    out.Cork();
+    out.Push(std::move(header));
+    if (!head_only) {
+        out.Push(std::move(body)); // first piece goes out with the header
+    }
+    out.Uncork();
+    return n;
+}
+
+size_t Response::SendRanges(IO::OutQueue &out, const char *content_type, const Body &body, const std::vector<ByteRange> &ranges, const std::string &meta)
+{
+    const off_t size = body.Size();
+    if (ranges.size() == 1) {
+        const auto &r = ranges.front();
+        auto header = Header("206 Partial Content", content_type, r.Len(),
+                             c_accept_ranges + meta + "Content-Range: " + ContentRange(r.first, r.last, size) + "\r\n");
+        const size_t n = header.size() + r.Len();
+        out.Cork();
+        out.Push(std::move(header));
+        body.Push(out, r.first, r.Len());
+        out.Uncork();
+        return n;
+    }
+
+    const auto boundary = Boundary();
+    std::vector<std::string> part_headers;
+    size_t content_len = 0;
+    for (const auto &r : ranges) {
+        part_headers.push_back("\r\n--" + boundary + "\r\nContent-type: " + content_type + "\r\nContent-Range: " +
+                               ContentRange(r.first, r.last, size) + "\r\n\r\n");
+        content_len += part_headers.back().size() + r.Len();
+    }
+    auto trailer = "\r\n--" + boundary + "--\r\n";
+    content_len += trailer.size();
+
+    const auto type = "multipart/byteranges; boundary=" + boundary;
+    auto header = Header("206 Partial Content", type.c_str(), content_len, c_accept_ranges + meta);
+    const size_t n = header.size() + content_len;
+    out.Cork();
+    out.Push(std::move(header));
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        out.Push(std::move(part_headers[i]));
+        body.Push(out, ranges[i].first, ranges[i].Len());
+    }
+    out.Push(std::move(trailer));
+    out.Uncork();
+    return n;
+}
+
+size_t Response::SendRangeNotSatisfiable(IO::OutQueue &out, off_t size)
+{
+    const char *reason = c_range_not_satisfiable + strlen("NNN ");
+    return Send(out, c_range_not_satisfiable, "text/plain", strlen(reason), reason, "Content-Range: bytes */" + std::to_string(size) + "\r\n");
+}
+
+size_t Response::SendNotModified(IO::OutQueue &out, const std::string &meta)
+{
+    auto res = HeaderLines("304 Not Modified", nullptr, meta);
+    res += "\r\n";
+
+    const size_t n = res.size();
+    out.Push(std::move(res));
+    return n;
+}
+
+//
+
+FileMetaData::FileMetaData(const char *fname)
+{
+    const size_t len = strlen(fname);
+    if ((len >= 3) && (strcmp(fname + len - 3, ".gz") == 0)) { // precompressed sidecar requested as it is, not of the type of the file it came from
+        mime_type = "application/gzip";
+    } else if ((len >= 3) && (strcmp(fname + len - 3, ".br") == 0)) {
+        mime_type = "application/octet-stream";
+    } else if (strstr(fname, ".html")) {
+        mime_type = "text/html";
+    } else if (strstr(fname, ".css")) {
+        mime_type = "text/css";
+    } else if (strstr(fname, ".js")) {
+        mime_type = "text/javascript";
+    } else if (strstr(fname, ".png")) {
+        mime_type = "image/png";
+    } else if (strstr(fname, ".gif")) {
+        mime_type = "image/gif";
+    } else if (strstr(fname, ".jpg")) {
+        mime_type = "image/jpeg";
+    } else if (strstr(fname, ".svg")) {
+        mime_type = "image/svg+xml";
+    } else if (strstr(fname, ".eot")) {
+        mime_type = "application/vnd.ms-fontobject";
+    } else if (strstr(fname, ".ttf")) {
+        mime_type = "font/ttf";
+    } else if (strstr(fname, ".woff2")) {
+        mime_type = "font/woff2";
+    } else if (strstr(fname, ".woff")) {
+        mime_type = "font/woff";
+    } else {
+        mime_type = "text/plain";
+    }
+}
+
+}
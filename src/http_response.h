@@ -0,0 +1,121 @@
+#ifndef HTTPRESPONSE_H
+#define HTTPRESPONSE_H
+
+#include "file_cache.h"
+#include "io.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <ctime>
+
+#include <sys/types.h>
+
+namespace Http {
+
+struct ByteRange
+{
+    static const size_t c_max_ranges = 16; // more ranges than that are not worth serving separately
+
+    off_t first;
+    off_t last; // inclusive
+
+    // parses 'Range' header value (e.g., "bytes=0-99,200-,-50") against representation of 'size' bytes,
+    // satisfiable ranges are sorted and overlapping or adjacent ones are merged;
+    // returns 'false' if header is to be ignored (malformed, unit other than bytes or too many ranges),
+    // 'ranges' are left empty if none of them is satisfiable
+    static bool Parse(const std::string &spec, off_t size, std::vector<ByteRange> &ranges);
+
+    size_t Len() const;
+};
+
+// validators of the current file contents, conditional requests are evaluated against them
+struct Validators
+{
+    std::string etag;          // strong, derived from inode, size and modification time (and content encoding, if any)
+    std::string last_modified;
+    time_t mtime;
+
+    explicit Validators(const struct stat &st, const char *encoding = nullptr);
+
+    std::string Headers() const; // 'ETag' and 'Last-Modified' header lines
+
+    bool MatchesAny(const std::string &if_none_match) const;        // weak comparison with any of the listed entity tags, "*" matches anything
+    bool ModifiedSince(const std::string &if_modified_since) const; // 'true' if date is malformed
+    bool Matches(const std::string &if_range) const;                // strong comparison with entity tag or exact date
+};
+
+struct Encoding
+{
+    enum Set
+    {
+        Gzip = 1,
+        Brotli = 2
+    };
+
+    static unsigned Accepted(const std::string &accept_encoding); // set of acceptable encodings out of the ones above
+    static bool Compressible(const char *mime_type);
+    static bool Compress(const std::string &data, std::string &res); // in gzip format
+};
+
+// gzip-compressed file produced piece by piece from 'chunk_bytes' of the file at a time, so memory needed doesn't depend on file size;
+// as length of compressed body isn't known in advance, pieces are framed as chunks of chunked transfer coding if 'chunked'
+class GzipStream : public IO::Source
+{
+public:
+    GzipStream(std::shared_ptr<const IO::File> _f, size_t _chunk_bytes, bool _chunked);
+    ~GzipStream();
+
+    GzipStream(const GzipStream &) = delete;
+    GzipStream &operator =(const GzipStream &) = delete;
+
+    bool Next(std::string &piece) override;
+private:
+    struct Impl;
+    std::unique_ptr<Impl> pimpl;
+};
+
+struct Response
+{
+    static const int c_keep_alive_sec = 5;
+
+    struct Body // response body is either part of cached pre-rendered response or file on disk
+    {
+        FileCache::EntryPtr cached;
+        std::shared_ptr<const IO::File> file;
+
+        off_t Size() const;
+        void Push(IO::OutQueue &out, off_t offset, size_t len) const; // never reads the file into memory
+    };
+
+    static std::string Date(time_t t); // IMF-fixdate, e.g., "Sun, 06 Nov 1994 08:49:37 GMT"
+
+    // 'extra' header lines must be terminated by CRLF, 'meta' stands for header lines describing the file (validators, caching directives)
+    static std::string Header(const char *status_code, const char *content_type, size_t content_len, const std::string &extra = std::string());
+    static std::string FileHeader(const char *content_type, off_t size, const std::string &meta); // '200 OK' for the whole file
+
+    // return number of bytes queued for sending
+    static size_t Send(IO::OutQueue &out, const char *status_code, const char *content_type, size_t content_len, const std::string &content,
+                       const std::string &extra = std::string());
+    static size_t SendFile(IO::OutQueue &out, const char *content_type, std::shared_ptr<const IO::File> f, const std::string &meta, bool head_only);
+    static size_t SendCached(IO::OutQueue &out, FileCache::EntryPtr e, bool head_only);
+    // body of unknown length (without 'Content-length'), delimited by chunked transfer coding if 'chunked' (or by the end of HTTP/2 stream),
+    // only header bytes are counted
+    static size_t SendStream(IO::OutQueue &out, const char *content_type, std::shared_ptr<IO::Source> body, const std::string &meta, bool chunked,
+                             bool head_only);
+    // single range as 206 response, several ones as 206 response of 'multipart/byteranges' type
+    static size_t SendRanges(IO::OutQueue &out, const char *content_type, const Body &body, const std::vector<ByteRange> &ranges, const std::string &meta);
+    static size_t SendRangeNotSatisfiable(IO::OutQueue &out, off_t size);
+    static size_t SendNotModified(IO::OutQueue &out, const std::string &meta); // header only
+};
+
+struct FileMetaData
+{
+    const char *mime_type;
+
+    FileMetaData(const char *fname);
+};
+
+}
+
+#endif
@@ -0,0 +1,270 @@
+#include "http_scan.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HTTP_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Http {
+namespace Scan {
+
+namespace {
+
+struct TokenTable // RFC 7230 'tchar'
+{
+    bool is_token[256];
+
+    TokenTable();
+};
+
+TokenTable::TokenTable()
+{
+    for (int c = 0; c < 256; ++c) {
+        is_token[c] = ((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c != 0) && strchr("!#$%&'*+-.^_`|~", c));
+    }
+}
+
+const TokenTable c_tokens;
+
+const char *FindLineEndScalar(const char *p, const char *end)
+{
+    while ((p < end) && (*p != '\r') && (*p != '\n')) {
+        ++p;
+    }
+    return p;
+}
+
+const char *FindSpaceOrLineEndScalar(const char *p, const char *end)
+{
+    while ((p < end) && (*p != ' ') && (*p != '\r') && (*p != '\n')) {
+        ++p;
+    }
+    return p;
+}
+
+const char *SkipTokenScalar(const char *p, const char *end)
+{
+    while ((p < end) && c_tokens.is_token[static_cast<unsigned char>(*p)]) {
+        ++p;
+    }
+    return p;
+}
+
+#ifdef HTTP_SCAN_X86
+
+// 'tchar' is any visible ASCII character except delimiters '"', '(', ')', ',', '/', ':' ... '@', '[', '\', ']', '{', '}'
+
+inline __m128i InRange128(__m128i x, char lo, char hi) // unsigned comparison through min/max
+{
+    return _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8(lo)), x), _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(hi)), x));
+}
+
+inline __m128i NonToken128(__m128i x)
+{
+    __m128i bad = _mm_xor_si128(InRange128(x, 0x21, 0x7e), _mm_set1_epi8(-1));
+    bad = _mm_or_si128(bad, InRange128(x, ':', '@'));
+    bad = _mm_or_si128(bad, InRange128(x, '[', ']'));
+    bad = _mm_or_si128(bad, InRange128(x, '(', ')'));
+    bad = _mm_or_si128(bad, _mm_cmpeq_epi8(x, _mm_set1_epi8('"')));
+    bad = _mm_or_si128(bad, _mm_cmpeq_epi8(x, _mm_set1_epi8(',')));
+    bad = _mm_or_si128(bad, _mm_cmpeq_epi8(x, _mm_set1_epi8('/')));
+    bad = _mm_or_si128(bad, _mm_cmpeq_epi8(x, _mm_set1_epi8('{')));
+    bad = _mm_or_si128(bad, _mm_cmpeq_epi8(x, _mm_set1_epi8('}')));
+    return bad;
+}
+
+__attribute__((target("sse2"))) const char *FindLineEndSse2(const char *p, const char *end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, cr), _mm_cmpeq_epi8(x, lf)));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindLineEndScalar(p, end);
+}
+
+__attribute__((target("sse2"))) const char *FindSpaceOrLineEndSse2(const char *p, const char *end)
+{
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, sp), _mm_or_si128(_mm_cmpeq_epi8(x, cr), _mm_cmpeq_epi8(x, lf))));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindSpaceOrLineEndScalar(p, end);
+}
+
+__attribute__((target("sse2"))) const char *SkipTokenSse2(const char *p, const char *end)
+{
+    for (; end - p >= 16; p += 16) {
+        const int mask = _mm_movemask_epi8(NonToken128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return SkipTokenScalar(p, end);
+}
+
+__attribute__((target("avx2"))) inline __m256i InRange256(__m256i x, char lo, char hi)
+{
+    return _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, _mm256_set1_epi8(lo)), x), _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(hi)), x));
+}
+
+__attribute__((target("avx2"))) inline __m256i NonToken256(__m256i x)
+{
+    __m256i bad = _mm256_xor_si256(InRange256(x, 0x21, 0x7e), _mm256_set1_epi8(-1));
+    bad = _mm256_or_si256(bad, InRange256(x, ':', '@'));
+    bad = _mm256_or_si256(bad, InRange256(x, '[', ']'));
+    bad = _mm256_or_si256(bad, InRange256(x, '(', ')'));
+    bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')));
+    bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(',')));
+    bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('/')));
+    bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('{')));
+    bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('}')));
+    return bad;
+}
+
+__attribute__((target("avx2"))) const char *FindLineEndAvx2(const char *p, const char *end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        const unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, cr), _mm256_cmpeq_epi8(x, lf)));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindLineEndSse2(p, end);
+}
+
+__attribute__((target("avx2"))) const char *FindSpaceOrLineEndAvx2(const char *p, const char *end)
+{
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        const unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, sp), _mm256_or_si256(_mm256_cmpeq_epi8(x, cr), _mm256_cmpeq_epi8(x, lf))));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindSpaceOrLineEndSse2(p, end);
+}
+
+__attribute__((target("avx2"))) const char *SkipTokenAvx2(const char *p, const char *end)
+{
+    for (; end - p >= 32; p += 32) {
+        const unsigned mask = _mm256_movemask_epi8(NonToken256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return SkipTokenSse2(p, end);
+}
+
+#endif
+
+struct Kernels
+{
+    Isa isa;
+    const char *(*find_line_end)(const char *, const char *);
+    const char *(*find_space_or_line_end)(const char *, const char *);
+    const char *(*skip_token)(const char *, const char *);
+
+    explicit Kernels(Isa _isa);
+};
+
+Kernels::Kernels(Isa _isa)
+    : isa(_isa)
+    , find_line_end(FindLineEndScalar)
+    , find_space_or_line_end(FindSpaceOrLineEndScalar)
+    , skip_token(SkipTokenScalar)
+{
+#ifdef HTTP_SCAN_X86
+    if (isa == Sse2) {
+        find_line_end = FindLineEndSse2;
+        find_space_or_line_end = FindSpaceOrLineEndSse2;
+        skip_token = SkipTokenSse2;
+    } else if (isa == Avx2) {
+        find_line_end = FindLineEndAvx2;
+        find_space_or_line_end = FindSpaceOrLineEndAvx2;
+        skip_token = SkipTokenAvx2;
+    }
+#endif
+}
+
+Isa Best()
+{
+    return Supported(Avx2) ? Avx2 : (Supported(Sse2) ? Sse2 : Scalar);
+}
+
+Kernels active(Best());
+
+}
+
+Isa Active()
+{
+    return active.isa;
+}
+
+bool Supported(Isa isa)
+{
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    switch (isa) {
+    case Avx2: return __builtin_cpu_supports("avx2");
+    case Sse2: return __builtin_cpu_supports("sse2");
+    default:   return true;
+    }
+#else
+    return isa == Scalar;
+#endif
+}
+
+bool Use(Isa isa)
+{
+    if (!Supported(isa)) {
+        return false;
+    }
+    active = Kernels(isa);
+    return true;
+}
+
+const char *IsaName(Isa isa)
+{
+    switch (isa) {
+    case Avx2: return "avx2";
+    case Sse2: return "sse2";
+    default:   return "scalar";
+    }
+}
+
+const char *FindLineEnd(const char *p, const char *end)
+{
+    return active.find_line_end(p, end);
+}
+
+const char *FindSpaceOrLineEnd(const char *p, const char *end)
+{
+    return active.find_space_or_line_end(p, end);
+}
+
+const char *SkipToken(const char *p, const char *end)
+{
+    return active.skip_token(p, end);
+}
+
+}
+}
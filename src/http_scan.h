@@ -0,0 +1,32 @@
+#ifndef HTTPSCAN_H
+#define HTTPSCAN_H
+
+namespace Http {
+
+// delimiter scanning kernels used by the request parser;
+// vectorized implementation is chosen once at startup according to CPU features (AVX2, SSE2, otherwise scalar)
+namespace Scan {
+
+enum Isa
+{
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+Isa Active();
+bool Supported(Isa isa);
+bool Use(Isa isa); // intended for benchmarks and tests, must not be called while requests are parsed
+
+const char *IsaName(Isa isa);
+
+// each function returns 'end' if no matching byte is found in [p, end)
+const char *FindLineEnd(const char *p, const char *end);        // first '\r' or '\n'
+const char *FindSpaceOrLineEnd(const char *p, const char *end); // first ' ', '\r' or '\n'
+const char *SkipToken(const char *p, const char *end);          // first byte not allowed in a token (RFC 7230 'tchar')
+
+}
+
+}
+
+#endif
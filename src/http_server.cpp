@@ -1,19 +1,33 @@
 #include "http_server.h"
+#include "file_cache.h"
+#include "doc_index.h"
+#include "http_parser.h"
+#include "http2.h"
+#include "http_response.h"
 #include "worker_pool.h"
+#include "affinity.h"
+#include "timer_wheel.h"
+#include "stats.h"
+#include "ring.h"
 #include "io.h"
 
 #include <vector>
+#include <map>
 #include <thread>
-#include <fstream>
-#include <sstream>
+#include <mutex>
+#include <atomic>
 #include <cstring>
 #include <cstdint>
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 
+#include <strings.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
@@ -21,22 +35,74 @@ namespace Http {
 
 namespace {
 
-using TimePoint = std::chrono::steady_clock::time_point;
+using TimePoint = IO::TimerWheel::Clock::time_point;
+
+const double c_queue_wait_half_life_ms = 100; // while nothing waits, average queue wait decays at the same pace however often it is checked
+
+const struct
+{
+    Encoding::Set encoding;
+    const char *name;
+    const char *suffix;
+} c_sidecars[] = { // precompressed files served instead of the requested one, in order of preference
+    { Encoding::Brotli, "br", ".br" },
+    { Encoding::Gzip, "gzip", ".gz" }
+};
+
+struct Context // state shared by all requests served by the server
+{
+    std::string dir;
+    std::unique_ptr<FileCache> cache;
+    std::unique_ptr<FileCache> compressed; // gzip-compressed variants of text files, 'nullptr' if on-the-fly compression is disabled
+    std::unique_ptr<DocIndex> index; // 'nullptr' if files are looked up in the file system on every request, its watcher invalidates the caches
+    size_t chunk_bytes; // of bodies produced while being sent and of file ranges read by io_uring event loops
+    Parser::Limits limits;
+    size_t output_high_water;
+    std::unique_ptr<Stats> stats; // 'nullptr' if metrics are disabled
+    std::string stats_path;
+    std::map<std::string, std::string> cache_control; // 'Cache-Control' header line by file extension ("*" for any other one)
+    std::string retry_after; // 'Retry-After' header line of responses to requests rejected due to overload
+    std::chrono::nanoseconds max_queue_wait; // zero if accepting is never paused
+    mutable std::atomic<int64_t> queue_wait_ns; // moving average of time requests wait for worker threads
+
+    Context(const std::string &_dir, const Config &cfg);
+
+    const std::string &CacheControl(const std::string &fname) const; // empty if none
+    void Invalidate(const std::string &path); // drops cached responses of the file at 'path' (relative to 'dir') changed or removed
+    void RecordQueueWait(std::chrono::nanoseconds d) const;
+    void DecayQueueWait(std::chrono::nanoseconds elapsed) const;
+};
 
 struct Connection
 {
-    static const int c_keep_alive_sec = 5;
-    static const int c_keep_alive_ms = c_keep_alive_sec * 1000;
+    static const int c_keep_alive_sec = Response::c_keep_alive_sec;
 
     IO::Socket s;
     std::unique_ptr<IO::BufReader> r;
-    Concurrent::IWorker *w;
-    TimePoint last_active;
-
-    Connection(IO::Socket _s, TimePoint timestamp);
-
-    bool Idle(TimePoint now) const;
-    int RemainingMs(TimePoint now) const;
+    std::shared_ptr<IO::OutQueue> out; // shared with requests being processed by workers
+    Parser parser; // keeps state of partially received request between readiness notifications
+    size_t skip;   // bytes of request body yet to be discarded
+    bool closing;  // no more requests will be read, connection is closed once due responses are written
+    std::shared_ptr<Concurrent::IWorker> w;
+    IO::TimerWheel::Id keep_alive; // connection is closed once it expires
+    uint64_t requests; // read so far
+    std::chrono::nanoseconds parse_time; // of the request being received
+    std::shared_ptr<Http2Session> h2; // 'nullptr' unless connection is switched to HTTP/2
+
+    Connection(IO::Socket _s, const Context &ctx, char *storage = nullptr); // 'storage' for read buffer, if not owned by connection
+
+    void SkipBody();
+
+    // parses buffered requests and hands them over for processing ('worker_pool' is 'nullptr' to perform them right away),
+    // output is shut down once no more requests could be read
+    void Dispatch(const Context &ctx, Concurrent::WorkerPool *worker_pool);
+
+    // HTTP/2 is spoken either from the start (prior knowledge), which is detected once the preface is received
+    // ('false' while bytes received so far might still be its beginning), or after upgrade of the request just parsed ('Upgrade: h2c')
+    bool DetectHttp2(const Context &ctx, Concurrent::WorkerPool *worker_pool);
+    bool Upgrade(const Context &ctx, Concurrent::WorkerPool *worker_pool); // 'false' if connection stays with HTTP/1.1
+    void StartHttp2(const Context &ctx, Concurrent::WorkerPool *worker_pool);
+    void DispatchFrames(); // streams are dispatched by the session the same way
 
     operator bool() const;
 };
@@ -45,91 +111,390 @@ struct Acceptor
 {
     IO::Socket master;
 
-    Acceptor(const std::string &ip, short port);
+    Acceptor(const std::string &ip, unsigned short port, bool reuse_port);
 
-    int Bind(const std::string &ip, short port);
+    int Bind(const std::string &ip, unsigned short port);
     int Listen();
 
-    Connection Accept(TimePoint timestamp);
+    Connection Accept(const Context &ctx);
 };
 
 struct Poller
 {
     static const int c_max_events = 32;
+    static const int c_timer_tick_ms = 100;
 
     int epoll;
     epoll_event events[c_max_events];
     int ret_events;
     TimePoint timestamp;
 
-    std::vector<Connection> conns;
+    std::vector<std::unique_ptr<Connection>> conns; // indexed by socket descriptor, so connection never moves while it is open
+    size_t active;
+    IO::TimerWheel timers;
+    std::vector<uint64_t> expired;
+
+    int wake_fd; // signalled by worker threads when connection must be revisited by the event loop
+    std::mutex wake_mtx;
+    std::vector<int> woken;
+
+    Stats *stats;
 
-    Poller(const Acceptor &acceptor);
+    Poller(const Acceptor &acceptor, Stats *_stats);
 
-    bool Wait();
+    bool Wait(int max_timeout_ms = -1); // returns after 'max_timeout_ms' at the latest, unless it's negative
+    void SetAccepting(int master, bool on); // listening socket is (un)paused
 
-    using ConnHdl = std::vector<Connection>::iterator;
+    void Wake(int fd);
+    std::vector<int> TakeWoken();
+
+    using ConnHdl = Connection *; // 'nullptr' if there is no such connection
 
     bool Add(Connection c);
     void Remove(ConnHdl c);
     ConnHdl Find(int fd);
 
+    void Touch(ConnHdl c); // postpones keep-alive expiration
     void RemoveAllIdle();
-    int TimeoutMs() const;
+};
+
+struct Variant // representation of the requested file chosen according to 'Accept-Encoding'
+{
+    std::string path;         // file the body is read from, precompressed sidecar or requested file itself
+    struct stat st;           // of 'path'
+    DocIndex::EntryPtr entry; // of 'path', 'nullptr' if docroot isn't indexed
+    const char *encoding;     // content encoding, 'nullptr' for identity
+    bool compress;            // 'path' is compressed on the fly (once, the result is cached)...
+    bool stream;              // ...or, if it's too large for the cache, while being sent (per request, in chunks)
+    bool vary;                // response depends on 'Accept-Encoding'
+
+    Variant();
+
+    const Validators &Current() const; // of 'st' and 'encoding', the ones precomputed by the index if possible
+    bool Same(const struct stat &_st) const; // 'true' if '_st' is of the same version of 'path'
+    std::string CacheKey() const; // of the response, as sidecar served as a content encoding and requested directly are different responses
+
+    static std::string CacheKey(const std::string &path, const char *encoding);
+private:
+    mutable std::unique_ptr<Validators> computed;
 };
 
 struct Request : Concurrent::ITask
 {
-    static int64_t count;
+    static std::atomic<int64_t> count;
 
     int64_t id;
-    IO::Socket s;
-    std::string dir;
-    std::string request_line;
-    bool bad;
+    std::shared_ptr<IO::OutQueue> out;
+    const Context &ctx;
+    std::string raw; // request line and headers as received, spans of 'head' refer to it
+    RequestHead head;
+    const char *error_status; // non-null if request is malformed
+    TimePoint dispatched;
 
-    static std::unique_ptr<Request> Read(IO::BufReader &reader, IO::Socket s, const std::string &dir);
+    static std::unique_ptr<Request> Read(const Parser &parser, const char *buf, std::shared_ptr<IO::OutQueue> out, const Context &ctx);
 
-    Request(IO::Socket _s, const std::string &_dir, const std::string &_request_line, bool _bad);
+    Request(std::shared_ptr<IO::OutQueue> _out, const Context &_ctx, const Parser &parser, const char *buf);
+    ~Request();
 
     Request(const Request &) = delete;
     Request &operator =(const Request &) = delete;
 
+    void Perform() override;
+    void Serve();
+    void SendError(const char *status_code) const;
+    void Shed(Stats::ShedAction action) const; // rejected due to overload, answered with '503 Service Unavailable' (if 'Answered') by the event loop
+    bool Find(const std::string &path, Variant &v) const; // 'false' if there is no regular file at (normalized) 'path'
+    void Negotiate(const std::string &path, const char *mime_type, Variant &v) const; // replaces 'v' by encoded variant, if any
+    bool NotModified(const Variant &v) const; // conditional request could be answered by '304 Not Modified'
+    bool RangeRequested(const Response::Body &body, const Variant &v, std::vector<ByteRange> &ranges) const; // 'true' if 'ranges' are to be served
+    std::string Meta(const std::string &path, const Variant &v, const struct stat &st) const; // validators (of 'st'), caching and encoding headers
+    void Count(const char *status_code, size_t bytes) const;
+
+    // reads the file (compressing it, if variant is to be compressed) into new cache entry,
+    // 'nullptr' if file shouldn't be cached or couldn't be read
+    FileCache::EntryPtr Load(const std::string &path, const Variant &v, const IO::File &f, const char *mime_type) const;
+};
+
+struct StreamTask : Concurrent::ITask // request of HTTP/2 stream, session is told once the response is pushed completely
+{
+    std::unique_ptr<Request> request;
+    std::function<void()> done;
+
+    StreamTask(std::unique_ptr<Request> _request, std::function<void()> _done);
+
+    // hands request over for processing like 'Connection::Dispatch' does, except that streams of a connection aren't tied to a single worker,
+    // 'false' if request is rejected due to overload
+    static bool Dispatch(uint32_t stream_id, const std::string &head, std::shared_ptr<IO::OutQueue> out, std::function<void()> done,
+                         const Context &ctx, Concurrent::WorkerPool *worker_pool);
+
+    void Perform() override;
+};
+
+struct PieceTask : Concurrent::ITask // produces the next piece of a body streamed to the connection, so the event loop never does that
+{
+    std::function<void()> job;
+
+    explicit PieceTask(std::function<void()> _job);
+
+    // jobs wanted by the event loop setting the runner up are submitted to the pool (any thread would do, as they don't depend on other tasks
+    // of the connection), the loop performs them itself only if the pool is full; other threads (i.e., workers) perform them right away
+    static IO::OutQueue::Runner Runner(Concurrent::WorkerPool *worker_pool);
+
     void Perform() override;
 };
 
-struct Response
+struct IReactor
 {
-    static void Send(IO::Socket s, const char *status_code, const char *content_type, size_t content_len, const std::string &content);
+    virtual ~IReactor() = default;
+    virtual void Run() = 0;
 };
 
-struct FileMetaData
+struct Reactor : IReactor // event loop accepting connections, reading and parsing requests and dispatching them for processing
 {
-    const char *mime_type;
-    bool is_binary;
+    Acceptor acceptor;
+    Poller poller;
+    const Context &ctx;
+    Concurrent::WorkerPool *worker_pool; // 'nullptr' means requests are performed by the event loop thread itself
+    bool accepting; // new connections are accepted unless requests wait for worker threads too long
+    TimePoint admission_checked; // last time admission was controlled
+
+    Reactor(const std::string &ip, unsigned short port, bool reuse_port, const Context &_ctx, Concurrent::WorkerPool *_worker_pool);
+
+    void Run() override;
+    void ProcessEvents();
+    void CloseIdleConnections();
+    void ControlAdmission(); // pauses accepting once average queue wait exceeds the limit, resumes it once it falls below half of that
+
+    void AcceptPendingConnections();
+    void ProcessConnection(Poller::ConnHdl c, uint32_t events);
+    void ProcessWakeups();
+    void DispatchRequests(Poller::ConnHdl c);
+};
+
+// event loop built on io_uring: accepting (multishot), reading requests (into registered buffers) and writing responses
+// (file ranges as linked read and send) are submitted to the ring in a single batch per loop iteration,
+// requests are performed by the event loop thread itself
+struct UringReactor : IReactor
+{
+    static const unsigned c_ring_entries = 1024;
+    static const size_t c_fixed_buffers = 512; // connections beyond that read into their own (not registered) buffers
+
+    enum Op
+    {
+        Accept,
+        Recv,
+        Send,
+        FileRead,
+        FileSend,
+        Cancel
+    };
+
+    struct RingConnection
+    {
+        Connection c;
+        int slot; // of registered buffer, -1 if connection reads into its own buffer
+        bool receiving;
+        int writing; // operations in flight (linked file read and send are two)
+        bool aborted;
+        bool dirty; // to be revisited at the end of loop iteration
+        IO::OutQueue::WriteOp op;
+        msghdr msg;
+        std::unique_ptr<char[]> chunk;
+        size_t chunk_len;
+        bool chunk_failed;
+        ssize_t sent;
+
+        RingConnection(Connection _c, int _slot);
+    };
+
+    Acceptor acceptor;
+    IO::Ring ring;
+    const Context &ctx;
+    bool accepting;
+    TimePoint accept_retry; // terminated multishot accept isn't re-armed before that
 
-    FileMetaData(const char *fname);
+    TimePoint timestamp;
+    IO::TimerWheel timers;
+    std::vector<uint64_t> expired;
+
+    std::vector<std::unique_ptr<RingConnection>> conns; // indexed by socket descriptor
+    std::vector<int> dirty;
+
+    std::unique_ptr<char[]> arena; // registered with the ring, split into read buffers of connections
+    std::vector<int> free_slots;
+
+    UringReactor(const std::string &ip, unsigned short port, bool reuse_port, const Context &_ctx);
+
+    void Run() override;
+    int WaitMs() const; // until the next timer or accept retry, -1 if there is nothing to wait for
+
+    io_uring_sqe *Prepare(uint8_t opcode, int fd, int conn_fd, Op op);
+    void Process(const io_uring_cqe &cqe);
+
+    void Add(int fd);
+    void Remove(RingConnection *rc);
+    void Abort(RingConnection *rc);
+    void Touch(RingConnection *rc);
+    void MarkDirty(RingConnection *rc);
+    void Update(RingConnection *rc); // submits next read and write, removes connection once it is done
+
+    void StartAccept();
+    void StartRecv(RingConnection *rc);
+    void StartWrite(RingConnection *rc);
+    void CloseIdleConnections();
 };
 
 //
 
-Connection::Connection(IO::Socket _s, TimePoint timestamp)
+Connection::Connection(IO::Socket _s, const Context &ctx, char *storage)
     : s(std::move(_s))
-    , r(new IO::BufReader(s))
+    , r(storage ? new IO::BufReader(s, storage, ctx.limits.max_head_bytes) : new IO::BufReader(s, ctx.limits.max_head_bytes))
+    , out(std::make_shared<IO::OutQueue>(s, ctx.output_high_water))
+    , parser(ctx.limits)
+    , skip(0)
+    , closing(false)
     , w(nullptr)
-    , last_active(timestamp)
+    , keep_alive(IO::TimerWheel::c_none)
+    , requests(0)
+    , parse_time(0)
+{
+}
+
+void Connection::SkipBody()
+{
+    const size_t n = std::min(skip, r->Size());
+    r->Consume(n);
+    skip -= n;
+}
+
+void Connection::Dispatch(const Context &ctx, Concurrent::WorkerPool *worker_pool)
 {
+    if (!h2 && (requests == 0) && !DetectHttp2(ctx, worker_pool)) {
+        return;
+    }
+    if (h2) {
+        DispatchFrames();
+        return;
+    }
+    while (!closing && out->ReadingAllowed()) { // single read may bring several pipelined requests
+        SkipBody();
+        if (skip > 0) {
+            closing = r->Eof(); // 'true' means socket closed from the client side
+            break;
+        }
+        const auto start = ctx.stats ? IO::TimerWheel::Clock::now() : TimePoint();
+        const auto res = parser.Parse(r->Data(), r->Size());
+        if (ctx.stats) {
+            parse_time += IO::TimerWheel::Clock::now() - start;
+        }
+        if (res == Parser::Incomplete) {
+            closing = r->Eof();
+            break;
+        }
+        if (ctx.stats) {
+            ctx.stats->Record(Stats::ParseTime, parse_time);
+            ctx.stats->CountRequest(requests > 0);
+            parse_time = std::chrono::nanoseconds(0);
+        }
+        ++requests;
+        if ((res == Parser::Complete) && Upgrade(ctx, worker_pool)) { // request is served as stream 1
+            r->Consume(parser.Head().head_len);
+            parser.Reset();
+            DispatchFrames();
+            return;
+        }
+        const bool due = worker_pool && out->Busy(); // responses to preceding requests are yet to be sent
+        std::unique_ptr<Concurrent::ITask> task(Request::Read(parser, r->Data(), out, ctx));
+        bool admitted = true;
+        if (!worker_pool) { // no hop to another thread, response is (at least partially) written before next request is parsed
+            task->Perform();
+        } else if (!w) { // each connection must have associated worker (or strand) to properly serialize responses (to pipelined requests)
+            w = worker_pool->SubmitTask(std::move(task));
+            admitted = bool(w);
+        } else {
+            admitted = w->AssignTask(std::move(task));
+        }
+        if (!admitted) { // overloaded, rejected right away unless the answer would overtake due responses
+            static_cast<const Request &>(*task).Shed(due ? Stats::Dropped : Stats::Answered);
+            if (due) { // connection is closed once due responses are written
+                closing = true;
+                break;
+            }
+        }
+        if (res == Parser::Failed) { // there is no way to find where next request starts
+            closing = true;
+            break;
+        }
+        r->Consume(parser.Head().head_len);
+        skip = parser.Head().content_len;
+        parser.Reset();
+    }
+    if (closing) {
+        out->Shutdown();
+    }
+}
+
+bool Connection::DetectHttp2(const Context &ctx, Concurrent::WorkerPool *worker_pool)
+{
+    const size_t n = std::min(r->Size(), Http2Session::c_preface_len);
+    if ((n == 0) || (memcmp(r->Data(), Http2Session::c_preface, n) != 0)) {
+        return true;
+    }
+    if (n < Http2Session::c_preface_len) { // beginning of the preface would be parsed as complete HTTP/1.1 request
+        return r->Eof();
+    }
+    StartHttp2(ctx, worker_pool);
+    h2->Start();
+    return true;
+}
+
+bool Connection::Upgrade(const Context &ctx, Concurrent::WorkerPool *worker_pool)
+{
+    const char *base = r->Data();
+    const auto &head = parser.Head();
+    const auto upgrade = head.Find(base, "Upgrade");
+    const auto settings = head.Find(base, "HTTP2-Settings");
+    if (!upgrade || !settings || (head.content_len > 0) || out->Busy()) { // 101 mustn't overtake due responses
+        return false;
+    }
+    bool h2c = false;
+    const auto protocols = upgrade->value.Str(base);
+    for (size_t pos = 0; !h2c && (pos < protocols.size()); ++pos) { // e.g., "h2c, websocket"
+        const size_t end = std::min(protocols.find(',', pos), protocols.size());
+        const size_t first = protocols.find_first_not_of(" \t", pos);
+        const size_t last = protocols.find_last_not_of(" \t", end - 1);
+        h2c = (first < end) && (last - first + 1 == 3) && (strncasecmp(protocols.data() + first, "h2c", 3) == 0);
+        pos = end;
+    }
+    if (!h2c) {
+        return false;
+    }
+    StartHttp2(ctx, worker_pool);
+    if (!h2->Upgrade(settings->value.Str(base), std::string(base, head.head_len))) {
+        h2.reset();
+        return false;
+    }
+    return true;
 }
 
-bool Connection::Idle(TimePoint now) const
+void Connection::StartHttp2(const Context &ctx, Concurrent::WorkerPool *worker_pool)
 {
-    return RemainingMs(now) == 0;
+    h2 = std::make_shared<Http2Session>(s, out, ctx.limits.max_head_bytes,
+        [&ctx, worker_pool](uint32_t stream_id, const std::string &head, std::shared_ptr<IO::OutQueue> stream_out, std::function<void()> done) {
+            return StreamTask::Dispatch(stream_id, head, std::move(stream_out), std::move(done), ctx, worker_pool);
+        });
 }
 
-int Connection::RemainingMs(TimePoint now) const
+void Connection::DispatchFrames()
 {
-    const int elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_active).count();
-    return (elapsed_ms < c_keep_alive_ms) ? (c_keep_alive_ms - elapsed_ms) : 0;
+    if (!closing && out->ReadingAllowed()) { // otherwise frames wait, and so do responses, until queued output is drained
+        r->Consume(h2->Receive(r->Data(), r->Size()));
+    }
+    if (!closing && (h2->Closed() || r->Eof())) {
+        h2->Abort(); // streams being served are not going to be read by anyone
+        closing = true;
+        out->Shutdown();
+    }
 }
 
 Connection::operator bool() const
@@ -139,15 +504,16 @@ Connection::operator bool() const
 
 //
 
-Acceptor::Acceptor(const std::string &ip, short port)
+Acceptor::Acceptor(const std::string &ip, unsigned short port, bool reuse_port)
     : master(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP))
 {
-    if (!master || Bind(ip, port) < 0 || Listen() < 0) {
+    const int on = 1; // with SO_REUSEPORT every acceptor gets its own listening socket, kernel balances connections among them
+    if (!master || (reuse_port && (setsockopt(master, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)) || Bind(ip, port) < 0 || Listen() < 0) {
         throw Error();
     }
 }
 
-int Acceptor::Bind(const std::string &ip, short port)
+int Acceptor::Bind(const std::string &ip, unsigned short port)
 {
     sockaddr_in addr;
     addr.sin_family = AF_INET;
@@ -165,17 +531,21 @@ int Acceptor::Listen()
     return listen(master, SOMAXCONN);
 }
 
-Connection Acceptor::Accept(TimePoint timestamp)
+Connection Acceptor::Accept(const Context &ctx)
 {
-    return Connection(IO::Socket(accept4(master, nullptr, nullptr, SOCK_NONBLOCK)), timestamp);
+    return Connection(IO::Socket(accept4(master, nullptr, nullptr, SOCK_NONBLOCK)), ctx);
 }
 
 //
 
-Poller::Poller(const Acceptor &acceptor)
+Poller::Poller(const Acceptor &acceptor, Stats *_stats)
     : epoll(epoll_create1(0))
     , ret_events(0)
     , timestamp(std::chrono::steady_clock::now())
+    , active(0)
+    , timers(std::chrono::milliseconds(c_timer_tick_ms), timestamp)
+    , wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    , stats(_stats)
 {
     epoll_event ev;
     bzero(&ev, sizeof(epoll_event));
@@ -185,289 +555,1154 @@ Poller::Poller(const Acceptor &acceptor)
     if (epoll < 0 || epoll_ctl(epoll, EPOLL_CTL_ADD, acceptor.master, &ev) < 0) {
         throw Error();
     }
+
+    ev.data.fd = wake_fd;
+    if (wake_fd < 0 || epoll_ctl(epoll, EPOLL_CTL_ADD, wake_fd, &ev) < 0) {
+        throw Error();
+    }
 }
 
-bool Poller::Wait()
+bool Poller::Wait(int max_timeout_ms)
 {
-    ret_events = epoll_wait(epoll, events, c_max_events, TimeoutMs());
+    int timeout_ms = timers.TimeoutMs(timestamp);
+    if ((max_timeout_ms >= 0) && ((timeout_ms < 0) || (timeout_ms > max_timeout_ms))) {
+        timeout_ms = max_timeout_ms;
+    }
+    ret_events = epoll_wait(epoll, events, c_max_events, timeout_ms);
     timestamp = std::chrono::steady_clock::now();
     return ret_events >= 0;
 }
 
+void Poller::SetAccepting(int master, bool on)
+{
+    epoll_event ev;
+    bzero(&ev, sizeof(epoll_event));
+    ev.events = on ? EPOLLIN : 0; // pending connections wait in the backlog meanwhile
+    ev.data.fd = master;
+    epoll_ctl(epoll, EPOLL_CTL_MOD, master, &ev);
+}
+
+void Poller::Wake(int fd)
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_mtx);
+        woken.push_back(fd);
+    }
+    eventfd_write(wake_fd, 1);
+}
+
+std::vector<int> Poller::TakeWoken()
+{
+    eventfd_t cnt;
+    eventfd_read(wake_fd, &cnt);
+
+    std::vector<int> res;
+    std::lock_guard<std::mutex> lock(wake_mtx);
+    res.swap(woken);
+    return res;
+}
+
 bool Poller::Add(Connection c)
 {
     if (!c) {
         return false;
     }
-    epoll_event ev;
-    bzero(&ev, sizeof(epoll_event));
-    ev.events = EPOLLIN;
-    ev.data.fd = c.s;
-    const int res = epoll_ctl(epoll, EPOLL_CTL_ADD, c.s, &ev);
-    if (res != 0) {
+    const int fd = c.s;
+    if (!c.out->Watch(epoll, [this, fd]() { Wake(fd); })) {
         return false;
     }
-    if (Find(c.s) == conns.end()) {
-        conns.push_back(std::move(c));
+    if (size_t(fd) >= conns.size()) {
+        conns.resize(std::max(size_t(fd) + 1, 2 * conns.size()));
+    }
+    if (!conns[fd]) {
+        c.keep_alive = timers.Schedule(timestamp + std::chrono::seconds(Connection::c_keep_alive_sec), fd);
+        conns[fd].reset(new Connection(std::move(c)));
+        ++active;
+        if (stats) {
+            stats->AddOpenConnections(1);
+        }
     }
     return true;
 }
 
 void Poller::Remove(ConnHdl c)
 {
-    if (c != conns.end()) {
-        std::swap(*c, conns.back());
-        conns.pop_back();
+    if (c) {
+        c->out->Unwatch();
+        timers.Cancel(c->keep_alive);
+        conns[int(c->s)].reset();
+        --active;
+        if (stats) {
+            stats->AddOpenConnections(-1);
+        }
     }
 }
 
 Poller::ConnHdl Poller::Find(int fd)
 {
-    return std::find_if(conns.begin(), conns.end(), [fd](const Connection &c) { return int(c.s) == fd; });
+    return ((fd >= 0) && (size_t(fd) < conns.size())) ? conns[fd].get() : nullptr;
 }
 
-void Poller::RemoveAllIdle()
+void Poller::Touch(ConnHdl c)
 {
-    conns.erase(std::remove_if(conns.begin(), conns.end(), [this](const Connection &c) { return c.Idle(timestamp); }), conns.end());
+    timers.Reschedule(c->keep_alive, timestamp + std::chrono::seconds(Connection::c_keep_alive_sec));
 }
 
-int Poller::TimeoutMs() const
+void Poller::RemoveAllIdle()
 {
-    auto it = std::min_element(conns.begin(), conns.end(), [this](const Connection &lhs, const Connection &rhs) { return lhs.RemainingMs(timestamp) < rhs.RemainingMs(timestamp); });
-    return (it != conns.end()) ? (*it).RemainingMs(timestamp) : -1;
+    expired.clear();
+    timers.Expire(timestamp, expired);
+    for (const auto fd : expired) {
+        auto c = Find(int(fd));
+        if (!c) {
+            continue;
+        }
+        c->keep_alive = IO::TimerWheel::c_none; // expired timers are released by the wheel
+        if (c->out->Busy()) { // worker is still preparing response
+            c->keep_alive = timers.Schedule(timestamp + std::chrono::seconds(Connection::c_keep_alive_sec), fd);
+        } else {
+            Remove(c);
+        }
+    }
 }
 
 //
 
-int64_t Request::count = 0;
-
-std::unique_ptr<Request> Request::Read(IO::BufReader &reader, IO::Socket s, const std::string &dir)
+Context::Context(const std::string &_dir, const Config &cfg)
+    : dir(_dir)
+    , cache((cfg.cache_bytes > 0) ? new FileCache(cfg.cache_bytes) : nullptr)
+    , compressed((cfg.compressed_cache_bytes > 0) ? new FileCache(cfg.compressed_cache_bytes) : nullptr)
+    , index(cfg.docroot_index ? new DocIndex(_dir, cfg.keep_files_open, [this](const std::string &path) { Invalidate(path); }) : nullptr)
+    , chunk_bytes(cfg.chunk_bytes)
+    , stats(cfg.stats_path.empty() ? nullptr : new Stats)
+    , stats_path(cfg.stats_path)
+    , retry_after("Retry-After: " + std::to_string(cfg.retry_after_sec) + "\r\n")
+    , max_queue_wait(std::chrono::milliseconds(cfg.max_queue_wait_ms))
+    , queue_wait_ns(0)
 {
-    const auto request_line = reader.ReadLine();
-    if (request_line.empty()) {
-        return nullptr;
+    limits.max_request_line = cfg.max_request_line;
+    limits.max_headers = cfg.max_headers;
+    limits.max_head_bytes = cfg.max_head_bytes;
+    output_high_water = cfg.output_high_water;
+    for (const auto &a : cfg.max_age) {
+        cache_control[a.first] = "Cache-Control: max-age=" + std::to_string(a.second) + "\r\n";
     }
+    if (index) {
+        if (index->Watching()) {
+            LOG_INFO("Docroot index of " + std::to_string(index->Size()) + " files");
+        } else {
+            LOG_WARN("Docroot index is disabled, changes of " + dir + " can't be watched");
+            index.reset();
+        }
+    }
+}
 
-    bool bad = false;
-    do { // ignore request headers
-        const auto line = reader.ReadLine();
-        if (line == "\r\n") {
-            break;
+void Context::Invalidate(const std::string &path)
+{
+    for (const auto c : { cache.get(), compressed.get() }) {
+        if (c) {
+            c->Invalidate(dir + path);
         }
-        if (line.empty()) {
-            bad = true;
-            break;
+    }
+    if (cache) { // the file might be a sidecar served as a content encoding too
+        for (const auto &s : c_sidecars) {
+            cache->Invalidate(Variant::CacheKey(dir + path, s.name));
         }
-    } while (true);
+    }
+}
+
+const std::string &Context::CacheControl(const std::string &fname) const
+{
+    static const std::string none;
+    if (cache_control.empty()) {
+        return none;
+    }
+    const auto dot = fname.find_last_of("./");
+    auto it = ((dot != std::string::npos) && (fname[dot] == '.')) ? cache_control.find(fname.substr(dot + 1)) : cache_control.end();
+    if (it == cache_control.end()) {
+        it = cache_control.find("*");
+    }
+    return (it != cache_control.end()) ? it->second : none;
+}
+
+void Context::RecordQueueWait(std::chrono::nanoseconds d) const
+{
+    // approximate under concurrent updates, which is good enough for admission decisions
+    const int64_t avg = queue_wait_ns.load(std::memory_order_relaxed);
+    queue_wait_ns.store(avg + (d.count() - avg) / 8, std::memory_order_relaxed);
+}
+
+void Context::DecayQueueWait(std::chrono::nanoseconds elapsed) const
+{
+    const double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+    const int64_t avg = queue_wait_ns.load(std::memory_order_relaxed);
+    queue_wait_ns.store(int64_t(avg * std::pow(0.5, ms / c_queue_wait_half_life_ms)), std::memory_order_relaxed);
+}
+
+//
+
+Variant::Variant()
+    : encoding(nullptr)
+    , compress(false)
+    , stream(false)
+    , vary(false)
+{
+}
+
+const Validators &Variant::Current() const
+{
+    if (entry && !encoding) {
+        return entry->validators;
+    }
+    if (!computed) {
+        computed.reset(new Validators(st, encoding));
+    }
+    return *computed;
+}
+
+bool Variant::Same(const struct stat &_st) const
+{
+    return (_st.st_ino == st.st_ino) && (_st.st_size == st.st_size) &&
+           (_st.st_mtim.tv_sec == st.st_mtim.tv_sec) && (_st.st_mtim.tv_nsec == st.st_mtim.tv_nsec);
+}
 
-    std::unique_ptr<Request> res(new Request(std::move(s), dir, request_line, bad));
-    IO::Logger::Instance().Log(" Request " + std::to_string(int(res->s)) + ":" + std::to_string(res->id) + ": " + (request_line.substr(0, request_line.size() - ((request_line.back() == '\n') ? 1 : 0))));
+std::string Variant::CacheKey() const
+{
+    return CacheKey(path, compress ? nullptr : encoding); // compressed on the fly go to a cache of their own
+}
+
+std::string Variant::CacheKey(const std::string &path, const char *encoding)
+{
+    return encoding ? (path + '\0' + encoding) : path;
+}
+
+//
+
+std::atomic<int64_t> Request::count(0);
+
+std::unique_ptr<Request> Request::Read(const Parser &parser, const char *buf, std::shared_ptr<IO::OutQueue> out, const Context &ctx)
+{
+    std::unique_ptr<Request> res(new Request(std::move(out), ctx, parser, buf));
+    if (res->error_status) {
+        LOG_INFO(" Request", res->out->Fd(), res->id, "<malformed>");
+    } else {
+        LOG_INFO(" Request", res->out->Fd(), res->id, "", res->raw.data() + res->head.method.off, res->head.request_line_len);
+    }
     return res;
 }
 
-Request::Request(IO::Socket _s, const std::string &_dir, const std::string &_request_line, bool _bad)
+Request::Request(std::shared_ptr<IO::OutQueue> _out, const Context &_ctx, const Parser &parser, const char *buf)
     : id(++count)
-    , s(std::move(_s))
-    , dir(_dir)
-    , request_line(_request_line)
-    , bad(_bad)
+    , out(std::move(_out))
+    , ctx(_ctx)
+    , raw(buf, parser.ErrorStatus() ? 0 : parser.Head().head_len)
+    , head(parser.Head())
+    , error_status(parser.ErrorStatus())
+    , dispatched((ctx.stats || ctx.max_queue_wait.count()) ? IO::TimerWheel::Clock::now() : TimePoint())
+{
+    if (out->BeginResponse() && ctx.stats) {
+        ctx.stats->AddBusyConnections(1);
+    }
+}
+
+Request::~Request()
 {
+    if (out->EndResponse() && ctx.stats) {
+        ctx.stats->AddBusyConnections(-1);
+    }
 }
 
 void Request::Perform()
 {
-    if (bad) {
-        IO::Logger::Instance().Log("Response " + std::to_string(int(s)) + ":" + std::to_string(id) + ": HTTP/1.1 400 Bad Request");
-        Response::Send(s, "400 Bad Request", "text/plain", strlen("Bad Request"), "Bad Request");
+    if (!ctx.stats && !ctx.max_queue_wait.count()) {
+        Serve();
+        return;
+    }
+    const auto start = IO::TimerWheel::Clock::now();
+    ctx.RecordQueueWait(start - dispatched);
+    if (!ctx.stats) {
+        Serve();
+        return;
+    }
+    ctx.stats->Record(Stats::QueueWait, start - dispatched);
+    Serve();
+    ctx.stats->Record(Stats::ServiceTime, IO::TimerWheel::Clock::now() - start);
+}
+
+void Request::Serve()
+{
+    if (error_status) {
+        SendError(error_status);
+        return;
+    }
+
+    const char *base = raw.data();
+    const bool head_only = head.method.Equals(base, "HEAD");
+    if (!head.method.Equals(base, "GET") && !head_only) {
+        SendError("501 Not Implemented");
+        return;
+    }
+
+    const auto uri = head.uri.Str(base);
+    std::string path = uri.substr(0, uri.find_first_of('?'));
+    if (ctx.stats && (path == ctx.stats_path)) {
+        const auto metrics = ctx.stats->Render();
+        LOG_INFO("Response", out->Fd(), id, "HTTP/1.1 200 OK");
+        Count("200 OK", Response::Send(*out, "200 OK", "text/plain; version=0.0.4", metrics.size(), head_only ? std::string() : metrics));
+        return;
+    }
+    if (!DocIndex::Normalize(std::string(path), path)) { // escapes docroot
+        SendError("400 Bad Request");
         return;
     }
 
-    std::string method, uri, version;
-    std::istringstream(request_line) >> method  >> uri >> version;
-    if ((method != "GET") && (method != "HEAD")) {
-        IO::Logger::Instance().Log("Response " + std::to_string(int(s)) + ":" + std::to_string(id) + ": HTTP/1.1 501 Not Implemented");
-        Response::Send(s, "501 Not Implemented", "text/plain", strlen("Not Implemented"), "Not Implemented");
+    Variant v;
+    if (!Find(path, v)) {
+        SendError("404 Not Found");
+        return;
+    }
+    const char *mime_type = v.entry ? v.entry->mime_type : FileMetaData(path.c_str()).mime_type;
+    Negotiate(path, mime_type, v);
+    if (NotModified(v)) { // neither opened nor read
+        LOG_INFO("Response", out->Fd(), id, "HTTP/1.1 304 Not Modified");
+        Count("304 Not Modified", Response::SendNotModified(*out, Meta(path, v, v.st)));
         return;
     }
 
-    const auto fname = dir + uri.substr(0, uri.find_first_of('?'));
-    const FileMetaData meta_data(fname.c_str());
+    if (v.stream) { // length is unknown, so ranges are ignored
+        auto f = (v.entry && v.entry->file) ? v.entry->file : std::make_shared<const IO::File>(v.path);
+        if (!*f) {
+            SendError("404 Not Found");
+            return;
+        }
+        const bool chunked = !head.version.Equals(base, "HTTP/2.0"); // HTTP/2 stream ends with the body
+        LOG_INFO("Response", out->Fd(), id, "HTTP/1.1 200 OK");
+        Count("200 OK", Response::SendStream(*out, mime_type, std::make_shared<GzipStream>(f, ctx.chunk_bytes, chunked), Meta(path, v, f->Stat()),
+                                             chunked, head_only));
+        return;
+    }
 
-    std::ifstream in(fname, meta_data.is_binary ? std::ios_base::binary : std::ios_base::in);
-    if (!in) {
-        IO::Logger::Instance().Log("Response " + std::to_string(int(s)) + ":" + std::to_string(id) + ": HTTP/1.1 404 Not Found");
-        Response::Send(s, "404 Not Found", "text/plain", strlen("Not Found"), "Not Found");
+    Response::Body body;
+    auto &cache = v.compress ? ctx.compressed : ctx.cache;
+    if (cache) {
+        body.cached = cache->Find(v.CacheKey(), v.st); // hit: no open, no read, no compression, no header formatting
+    }
+    if (!body.cached) {
+        body.file = (v.entry && v.entry->file) ? v.entry->file : std::make_shared<const IO::File>(v.path);
+        if (!*body.file) {
+            SendError("404 Not Found");
+            return;
+        }
+        body.cached = Load(path, v, *body.file, mime_type);
+        if (!body.cached && v.compress) { // e.g., file has grown too large meanwhile, it is sent as it is then (still varying by encoding)
+            v.encoding = nullptr;
+            v.compress = false;
+        }
+    }
+
+    std::vector<ByteRange> ranges;
+    if (!head_only && RangeRequested(body, v, ranges)) {
+        if (ranges.empty()) {
+            LOG_INFO("Response", out->Fd(), id, "HTTP/1.1 416 Range Not Satisfiable");
+            Count("416 Range Not Satisfiable", Response::SendRangeNotSatisfiable(*out, body.Size()));
+        } else {
+            LOG_INFO("Response", out->Fd(), id, "HTTP/1.1 206 Partial Content");
+            Count("206 Partial Content", Response::SendRanges(*out, mime_type, body, ranges, Meta(path, v, v.st)));
+        }
         return;
     }
 
-    std::stringstream buffer;
-    buffer << in.rdbuf();
-    const auto str = buffer.str();
-    IO::Logger::Instance().Log("Response " + std::to_string(int(s)) + ":" + std::to_string(id) + ": HTTP/1.1 200 OK");
-    Response::Send(s, "200 OK", meta_data.mime_type, str.size(), (method == "HEAD") ? std::string() : str);
+    LOG_INFO("Response", out->Fd(), id, "HTTP/1.1 200 OK");
+    if (body.cached) {
+        Count("200 OK", Response::SendCached(*out, body.cached, head_only));
+    } else {
+        Count("200 OK", Response::SendFile(*out, mime_type, body.file, Meta(path, v, body.file->Stat()), head_only));
+    }
+}
+
+bool Request::Find(const std::string &path, Variant &v) const
+{
+    v.path = ctx.dir + path;
+    if (ctx.index) { // no syscalls
+        v.entry = ctx.index->Find(path);
+        if (v.entry) {
+            v.st = v.entry->st;
+        }
+        return bool(v.entry);
+    }
+    return (stat(v.path.c_str(), &v.st) == 0) && S_ISREG(v.st.st_mode);
 }
 
-//
+void Request::Negotiate(const std::string &path, const char *mime_type, Variant &v) const
+{
+    if (!Encoding::Compressible(mime_type)) {
+        return;
+    }
+    v.vary = true;
+    const char *base = raw.data();
+    const auto accept_encoding = head.Find(base, "Accept-Encoding");
+    const unsigned accepted = accept_encoding ? Encoding::Accepted(accept_encoding->value.Str(base)) : 0;
+    for (const auto &s : c_sidecars) {
+        if (!(accepted & s.encoding)) {
+            continue;
+        }
+        Variant sidecar;
+        if (Find(path + s.suffix, sidecar) && (sidecar.st.st_mtime >= v.st.st_mtime)) { // stale one is ignored
+            sidecar.encoding = s.name;
+            sidecar.vary = true;
+            v = std::move(sidecar);
+            return;
+        }
+    }
+    if ((accepted & Encoding::Gzip) && ctx.compressed) {
+        v.compress = (size_t(v.st.st_size) <= ctx.compressed->MaxEntryBytes());
+        v.stream = !v.compress && !head.version.Equals(base, "HTTP/1.0"); // no chunked transfer coding
+        if (v.compress || v.stream) {
+            v.encoding = "gzip";
+        }
+    }
+}
 
-void Response::Send(IO::Socket s, const char *status_code, const char *content_type, size_t content_len, const std::string &content)
+bool Request::NotModified(const Variant &v) const
 {
-    std::string res = "HTTP/1.1 ";
-    res += status_code;
-    res += "\r\n";
-    res += "Server: HttpServer\r\n";
-    res += "Connection: keep-alive\r\n";
-    res += "Keep-Alive: timeout=";
-    res += std::to_string(Connection::c_keep_alive_sec);
-    res += "\r\n";
-    res += "Content-type: ";
-    res += content_type;
-    res += "\r\n";
-    res += "X-Content-Type-Options: nosniff\r\n";
-    res += "Content-length: ";
-    res += std::to_string(content_len);
-    res += "\r\n\r\n";
-    res += content; // std::string is used for 'content' to allow '\0' character to be in the middle of the buffer
+    const char *base = raw.data();
+    if (const auto if_none_match = head.Find(base, "If-None-Match")) { // takes precedence over date
+        return v.Current().MatchesAny(if_none_match->value.Str(base));
+    }
+    if (const auto if_modified_since = head.Find(base, "If-Modified-Since")) {
+        return !v.Current().ModifiedSince(if_modified_since->value.Str(base));
+    }
+    return false;
+}
 
-    send(s, res.c_str(), res.size(), MSG_NOSIGNAL);
+bool Request::RangeRequested(const Response::Body &body, const Variant &v, std::vector<ByteRange> &ranges) const
+{
+    const char *base = raw.data();
+    const auto range = head.Find(base, "Range");
+    if (!range) {
+        return false;
+    }
+    if (const auto if_range = head.Find(base, "If-Range")) { // ranges are only served if representation is unchanged
+        if (!v.Current().Matches(if_range->value.Str(base))) {
+            return false;
+        }
+    }
+    return ByteRange::Parse(range->value.Str(base), body.Size(), ranges);
 }
 
-//
+std::string Request::Meta(const std::string &path, const Variant &v, const struct stat &st) const
+{
+    auto res = (v.Same(st) ? v.Current().Headers() : Validators(st, v.encoding).Headers()) + ctx.CacheControl(path);
+    if (v.encoding) {
+        res += "Content-Encoding: ";
+        res += v.encoding;
+        res += "\r\n";
+    }
+    if (v.vary) {
+        res += "Vary: Accept-Encoding\r\n";
+    }
+    return res;
+}
 
-FileMetaData::FileMetaData(const char *fname)
-{
-    if (strstr(fname, ".html")) {
-        mime_type = "text/html";
-        is_binary = false;
-    } else if (strstr(fname, ".css")) {
-        mime_type = "text/css";
-        is_binary = false;
-    } else if (strstr(fname, ".js")) {
-        mime_type = "text/javascript";
-        is_binary = false;
-    } else if (strstr(fname, ".png")) {
-        mime_type = "image/png";
-        is_binary = true;
-    } else if (strstr(fname, ".gif")) {
-        mime_type = "image/gif";
-        is_binary = true;
-    } else if (strstr(fname, ".jpg")) {
-        mime_type = "image/jpeg";
-        is_binary = true;
-    } else if (strstr(fname, ".svg")) {
-        mime_type = "image/svg+xml";
-        is_binary = true;
-    } else if (strstr(fname, ".eot")) {
-        mime_type = "application/vnd.ms-fontobject";
-        is_binary = true;
-    } else if (strstr(fname, ".ttf")) {
-        mime_type = "font/ttf";
-        is_binary = true;
-    } else if (strstr(fname, ".woff")) {
-        mime_type = "font/woff";
-        is_binary = true;
-    } else if (strstr(fname, ".woff2")) {
-        mime_type = "font/woff2";
-        is_binary = true;
+void Request::SendError(const char *status_code) const
+{
+    const char *reason = status_code + strlen("NNN ");
+    LOG_INFO("Response", out->Fd(), id, "HTTP/1.1 ", status_code);
+    Count(status_code, Response::Send(*out, status_code, "text/plain", strlen(reason), reason));
+}
+
+void Request::Shed(Stats::ShedAction action) const
+{
+    if (ctx.stats) {
+        ctx.stats->CountShed(action);
+    }
+    if (action != Stats::Answered) {
+        LOG_INFO("Response", out->Fd(), id, (action == Stats::Refused) ? "<refused>" : "<shed>");
+        return;
+    }
+    const char *status_code = "503 Service Unavailable";
+    const char *reason = status_code + strlen("NNN ");
+    LOG_INFO("Response", out->Fd(), id, "HTTP/1.1 ", status_code);
+    Count(status_code, Response::Send(*out, status_code, "text/plain", strlen(reason), reason, ctx.retry_after));
+}
+
+void Request::Count(const char *status_code, size_t bytes) const
+{
+    if (ctx.stats) {
+        ctx.stats->CountResponse(atoi(status_code), bytes);
+    }
+}
+
+FileCache::EntryPtr Request::Load(const std::string &path, const Variant &v, const IO::File &f, const char *mime_type) const
+{
+    const auto &cache = v.compress ? ctx.compressed : ctx.cache;
+    if (!cache || (size_t(f.Size()) > cache->MaxEntryBytes())) {
+        return nullptr;
+    }
+    std::shared_ptr<FileCache::Entry> e(new FileCache::Entry(f.Stat(), mime_type));
+    const auto meta = Meta(path, v, f.Stat()); // validators of the file actually read
+    if (v.compress) {
+        std::string data;
+        if (!f.ReadAll(data)) {
+            return nullptr;
+        }
+        std::string compressed;
+        if (!Encoding::Compress(data, compressed)) {
+            return nullptr;
+        }
+        e->response = Response::FileHeader(mime_type, compressed.size(), meta);
+        e->header_len = e->response.size();
+        e->response += compressed;
     } else {
-        mime_type = "text/plain";
-        is_binary = false;
+        e->response = Response::FileHeader(mime_type, f.Size(), meta);
+        e->header_len = e->response.size();
+        if (e->header_len + size_t(f.Size()) > cache->MaxEntryBytes()) { // wouldn't be cached, file is sent from disk instead
+            return nullptr;
+        }
+        if (!f.ReadAll(e->response)) {
+            return nullptr;
+        }
     }
+    cache->Insert(v.CacheKey(), e); // compressed entry is served even if it doesn't fit into the cache
+    return e;
 }
 
-} // end namespace
+//
 
-struct Server::Impl
+StreamTask::StreamTask(std::unique_ptr<Request> _request, std::function<void()> _done)
+    : request(std::move(_request))
+    , done(std::move(_done))
 {
-    Acceptor acceptor;
-    Poller poller;
-    std::unique_ptr<Concurrent::WorkerPool> worker_pool;
-    std::string dir;
+}
+
+bool StreamTask::Dispatch(uint32_t stream_id, const std::string &head, std::shared_ptr<IO::OutQueue> out, std::function<void()> done,
+                          const Context &ctx, Concurrent::WorkerPool *worker_pool)
+{
+    Parser parser(ctx.limits);
+    parser.Parse(head.data(), head.size()); // either complete or failed (and answered with error status), as the head is whole
+    if (ctx.stats) {
+        ctx.stats->CountRequest(stream_id > 1);
+    }
+    std::unique_ptr<Concurrent::ITask> task(new StreamTask(Request::Read(parser, head.data(), std::move(out), ctx), std::move(done)));
+    if (!worker_pool) {
+        task->Perform();
+        return true;
+    }
+    if (worker_pool->SubmitTask(std::move(task))) { // streams go to different workers, so a slow one doesn't hold up the others
+        return true;
+    }
+    static_cast<const StreamTask &>(*task).request->Shed(Stats::Refused); // stream is refused, which tells client it may retry
+    return false;
+}
 
-    Impl(const std::string &_ip, short _port, const std::string &_dir);
+void StreamTask::Perform()
+{
+    request->Perform();
+    request.reset(); // response is complete once request is gone
+    done();
+}
 
-    void Run();
-    void ProcessEvents();
-    void CloseIdleConnections();
+//
 
-    void AcceptPendingConnections();
-    void ProcessConnection(Poller::ConnHdl c);
-};
+PieceTask::PieceTask(std::function<void()> _job)
+    : job(std::move(_job))
+{
+}
+
+IO::OutQueue::Runner PieceTask::Runner(Concurrent::WorkerPool *worker_pool)
+{
+    const auto loop = std::this_thread::get_id();
+    return [worker_pool, loop](std::function<void()> job) {
+        if (std::this_thread::get_id() != loop) { // tasks are submitted by event loops only (queues of worker threads have a single sender)
+            job();
+            return;
+        }
+        std::unique_ptr<Concurrent::ITask> task(new PieceTask(std::move(job)));
+        if (!worker_pool->SubmitTask(std::move(task))) {
+            task->Perform();
+        }
+    };
+}
 
-Server::Impl::Impl(const std::string &_ip, short _port, const std::string &_dir)
-    : acceptor(_ip, _port)
-    , poller(acceptor)
-    , worker_pool(new Concurrent::RoundRobinWorkerPool(std::max(1u, std::thread::hardware_concurrency()) * (1 + 50 /* wait time */ / 5 /* service time */)))
-    , dir(_dir)
+void PieceTask::Perform()
 {
+    job();
 }
 
-void Server::Impl::Run()
+//
+
+Reactor::Reactor(const std::string &ip, unsigned short port, bool reuse_port, const Context &_ctx, Concurrent::WorkerPool *_worker_pool)
+    : acceptor(ip, port, reuse_port)
+    , poller(acceptor, _ctx.stats.get())
+    , ctx(_ctx)
+    , worker_pool(_worker_pool)
+    , accepting(true)
+    , admission_checked(IO::TimerWheel::Clock::now())
 {
-    worker_pool->Start();
+}
 
-    while (poller.Wait()) {
+void Reactor::Run()
+{
+    while (poller.Wait(accepting ? -1 : Poller::c_timer_tick_ms)) { // paused accepting is revisited even if nothing happens
         ProcessEvents();
         CloseIdleConnections();
+        ControlAdmission();
     }
 }
 
-void Server::Impl::ProcessEvents()
+void Reactor::ProcessEvents()
 {
     for (int i = 0; i < poller.ret_events; ++i) {
         const auto &ev = poller.events[i];
-        if (ev.events & EPOLLIN) {
-            if (ev.data.fd == acceptor.master) {
-                AcceptPendingConnections();
-            } else {
-                ProcessConnection(poller.Find(ev.data.fd));
-            }
+        if (ev.data.fd == acceptor.master) {
+            AcceptPendingConnections();
+        } else if (ev.data.fd == poller.wake_fd) {
+            ProcessWakeups();
+        } else {
+            ProcessConnection(poller.Find(ev.data.fd), ev.events);
         }
     }
 }
 
-void Server::Impl::CloseIdleConnections()
+void Reactor::CloseIdleConnections()
 {
     poller.RemoveAllIdle();
 }
 
-void Server::Impl::AcceptPendingConnections()
+void Reactor::ControlAdmission()
+{
+    if (!worker_pool || !ctx.max_queue_wait.count()) {
+        return;
+    }
+    const auto now = IO::TimerWheel::Clock::now();
+    if (worker_pool->Waiting() == 0) { // average decays while nothing waits, by time elapsed rather than by number of event loop wakeups
+        ctx.DecayQueueWait(now - admission_checked);
+    }
+    admission_checked = now;
+    const std::chrono::nanoseconds wait(ctx.queue_wait_ns.load(std::memory_order_relaxed));
+    if (accepting && (wait > ctx.max_queue_wait)) {
+        accepting = false;
+        poller.SetAccepting(acceptor.master, false);
+        LOG_WARN("Accepting paused, average queue wait is " + std::to_string(wait.count() / 1000000) + " ms");
+        if (ctx.stats) {
+            ctx.stats->CountAcceptPause();
+        }
+    } else if (!accepting && (wait < ctx.max_queue_wait / 2)) {
+        accepting = true;
+        poller.SetAccepting(acceptor.master, true);
+        LOG_INFO("Accepting resumed");
+    }
+}
+
+void Reactor::AcceptPendingConnections()
 {
-    while (poller.Add(acceptor.Accept(poller.timestamp)))
-        ;
+    for (;;) {
+        Connection c = acceptor.Accept(ctx);
+        if (c && worker_pool) { // further pieces of streamed bodies are produced by worker threads
+            c.out->SetProducer(PieceTask::Runner(worker_pool));
+        }
+        if (!poller.Add(std::move(c))) {
+            break;
+        }
+        if (ctx.stats) {
+            ctx.stats->CountAccepted();
+        }
+    }
 }
 
-void Server::Impl::ProcessConnection(Poller::ConnHdl c)
+void Reactor::ProcessConnection(Poller::ConnHdl c, uint32_t events)
 {
-    if (c == poller.conns.end()) {
+    if (!c) {
         return;
     }
-    c->last_active = poller.timestamp;
-    do {
-        std::unique_ptr<Concurrent::ITask> task(Request::Read(*c->r, c->s, dir));
-        const bool eof = c->r->Eof(); // 'true' means socket closed from the client side
-        if (task) {
-            if (!c->w) { // each connection must have associated worker to properly serialize responses (to pipelined requests)
-                c->w = worker_pool->SubmitTask(std::move(task));
-            } else {
-                c->w->AssignTask(std::move(task));
-            }
-            if (eof) {
-                poller.Remove(c);
-                break;
+    if (events & (EPOLLERR | EPOLLHUP)) { // nothing could be sent to the client anymore
+        poller.Remove(c);
+        return;
+    }
+    if ((events & EPOLLOUT) && c->out->Flush()) {
+        poller.Touch(c);
+    }
+    if (events & EPOLLIN) {
+        poller.Touch(c);
+        c->r->Fill();
+    }
+    DispatchRequests(c);
+}
+
+void Reactor::ProcessWakeups()
+{
+    for (int fd : poller.TakeWoken()) {
+        auto c = poller.Find(fd);
+        if (c) {
+            DispatchRequests(c);
+        }
+    }
+}
+
+void Reactor::DispatchRequests(Poller::ConnHdl c)
+{
+    c->Dispatch(ctx, worker_pool);
+    if (c->closing && c->out->Idle()) {
+        poller.Remove(c);
+    }
+}
+
+//
+
+UringReactor::RingConnection::RingConnection(Connection _c, int _slot)
+    : c(std::move(_c))
+    , slot(_slot)
+    , receiving(false)
+    , writing(0)
+    , aborted(false)
+    , dirty(false)
+    , chunk_len(0)
+    , chunk_failed(false)
+    , sent(0)
+{
+}
+
+UringReactor::UringReactor(const std::string &ip, unsigned short port, bool reuse_port, const Context &_ctx)
+    : acceptor(ip, port, reuse_port)
+    , ring(c_ring_entries)
+    , ctx(_ctx)
+    , accepting(false)
+    , accept_retry()
+    , timestamp(std::chrono::steady_clock::now())
+    , timers(std::chrono::milliseconds(Poller::c_timer_tick_ms), timestamp)
+{
+    if (!ring) {
+        throw Error();
+    }
+    const size_t slot_size = ctx.limits.max_head_bytes;
+    arena.reset(new char[c_fixed_buffers * slot_size]);
+    iovec iov;
+    iov.iov_base = arena.get();
+    iov.iov_len = c_fixed_buffers * slot_size;
+    if (ring.RegisterBuffers(&iov, 1)) {
+        for (int i = int(c_fixed_buffers) - 1; i >= 0; --i) {
+            free_slots.push_back(i);
+        }
+    } else { // e.g., locked memory limit is too low, plain reads do as well
+        LOG_WARN("Failed to register io_uring buffers, reading into plain ones");
+        arena.reset();
+    }
+}
+
+void UringReactor::Run()
+{
+    StartAccept();
+    while (ring.Submit(1, WaitMs())) { // everything prepared during previous iteration goes to the kernel at once
+        timestamp = std::chrono::steady_clock::now();
+        io_uring_cqe cqe;
+        while (ring.Next(cqe)) {
+            Process(cqe);
+        }
+        CloseIdleConnections();
+        for (size_t i = 0; i < dirty.size(); ++i) {
+            const int fd = dirty[i];
+            if (conns[fd]) {
+                conns[fd]->dirty = false;
+                Update(conns[fd].get());
             }
+        }
+        dirty.clear();
+        if (!accepting && (timestamp >= accept_retry)) {
+            StartAccept();
+        }
+    }
+}
+
+int UringReactor::WaitMs() const
+{
+    const int timeout = timers.TimeoutMs(timestamp);
+    if (accepting) {
+        return timeout;
+    }
+    const auto retry = std::chrono::duration_cast<std::chrono::milliseconds>(accept_retry - timestamp).count();
+    const int retry_ms = (retry > 0) ? int(retry) : 0;
+    return (timeout < 0) ? retry_ms : std::min(timeout, retry_ms);
+}
+
+io_uring_sqe *UringReactor::Prepare(uint8_t opcode, int fd, int conn_fd, Op op)
+{
+    io_uring_sqe *sqe = ring.Sqe();
+    if (sqe) {
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->user_data = (uint64_t(conn_fd) << 8) | op;
+    }
+    return sqe;
+}
+
+void UringReactor::Process(const io_uring_cqe &cqe)
+{
+    const int fd = int(cqe.user_data >> 8);
+    const auto op = Op(cqe.user_data & 0xff);
+    if (op == Accept) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) { // multishot accept is terminated (e.g., out of descriptors), it is re-armed later
+            accepting = false;
+            accept_retry = (cqe.res < 0) ? timestamp + std::chrono::milliseconds(Poller::c_timer_tick_ms) : timestamp;
+        }
+        if (cqe.res >= 0) {
+            Add(cqe.res);
+        }
+        return;
+    }
+    auto rc = ((op != Cancel) && (size_t(fd) < conns.size())) ? conns[fd].get() : nullptr;
+    if (!rc) {
+        return;
+    }
+    switch (op) {
+    case Recv:
+        rc->receiving = false;
+        if (cqe.res == -EAGAIN) {
+            break;
+        }
+        if (cqe.res > 0) {
+            Touch(rc);
+        }
+        rc->c.r->Commit(cqe.res); // requests are dispatched by 'Update'
+        break;
+    case Send:
+        rc->writing = 0;
+        if (cqe.res > 0) {
+            Touch(rc);
+        }
+        rc->c.out->Written(cqe.res);
+        break;
+    case FileRead:
+        if (cqe.res != ssize_t(rc->chunk_len)) { // linked send is cancelled then, short read means file got truncated
+            rc->chunk_failed = true;
+        }
+        break;
+    case FileSend:
+        rc->sent = cqe.res;
+        break;
+    default:
+        break;
+    }
+    if (((op == FileRead) || (op == FileSend)) && (--rc->writing == 0)) {
+        if (rc->sent > 0) {
+            Touch(rc);
+        }
+        rc->c.out->Written(rc->chunk_failed ? -EIO : rc->sent);
+    }
+    MarkDirty(rc);
+}
+
+void UringReactor::Add(int fd)
+{
+    const int slot = free_slots.empty() ? -1 : free_slots.back();
+    Connection c(IO::Socket(fd), ctx, (slot >= 0) ? arena.get() + slot * ctx.limits.max_head_bytes : nullptr);
+    if (!c) {
+        return;
+    }
+    if (slot >= 0) {
+        free_slots.pop_back();
+    }
+    c.out->Defer();
+    c.keep_alive = timers.Schedule(timestamp + std::chrono::seconds(Connection::c_keep_alive_sec), fd);
+    if (size_t(fd) >= conns.size()) {
+        conns.resize(std::max(size_t(fd) + 1, 2 * conns.size()));
+    }
+    conns[fd].reset(new RingConnection(std::move(c), slot));
+    if (ctx.stats) {
+        ctx.stats->CountAccepted();
+        ctx.stats->AddOpenConnections(1);
+    }
+    MarkDirty(conns[fd].get());
+}
+
+void UringReactor::Remove(RingConnection *rc)
+{
+    timers.Cancel(rc->c.keep_alive);
+    if (rc->slot >= 0) {
+        free_slots.push_back(rc->slot);
+    }
+    if (ctx.stats) {
+        ctx.stats->AddOpenConnections(-1);
+    }
+    conns[int(rc->c.s)].reset(); // no operation refers to it anymore
+}
+
+void UringReactor::Abort(RingConnection *rc)
+{
+    rc->aborted = true;
+    rc->c.closing = true;
+    rc->c.out->Shutdown();
+    if (rc->receiving || rc->writing) {
+        if (auto sqe = Prepare(IORING_OP_ASYNC_CANCEL, rc->c.s, rc->c.s, Cancel)) {
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        }
+    }
+    MarkDirty(rc);
+}
+
+void UringReactor::Touch(RingConnection *rc)
+{
+    if (rc->aborted || (rc->c.keep_alive == IO::TimerWheel::c_none)) { // e.g., I/O completed after the connection expired
+        return;
+    }
+    timers.Reschedule(rc->c.keep_alive, timestamp + std::chrono::seconds(Connection::c_keep_alive_sec));
+}
+
+void UringReactor::MarkDirty(RingConnection *rc)
+{
+    if (!rc->dirty) {
+        rc->dirty = true;
+        dirty.push_back(rc->c.s);
+    }
+}
+
+void UringReactor::Update(RingConnection *rc)
+{
+    if (!rc->aborted) {
+        if (!rc->receiving) { // new requests might have been read, or paused reading could be resumed after write
+            rc->c.Dispatch(ctx, nullptr);
+        }
+        StartWrite(rc);
+        StartRecv(rc);
+    }
+    if (rc->receiving || rc->writing) {
+        return;
+    }
+    if (rc->aborted || (rc->c.closing && rc->c.out->Idle())) {
+        Remove(rc);
+    }
+}
+
+void UringReactor::StartAccept()
+{
+    if (auto sqe = Prepare(IORING_OP_ACCEPT, acceptor.master, acceptor.master, Accept)) {
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        accepting = true;
+    }
+}
+
+void UringReactor::StartRecv(RingConnection *rc)
+{
+    auto &c = rc->c;
+    if (rc->receiving || c.closing || !c.out->ReadingAllowed()) {
+        return;
+    }
+    char *tail = c.r->Tail();
+    const size_t room = c.r->Room();
+    if (room == 0) {
+        return;
+    }
+    auto sqe = Prepare((rc->slot >= 0) ? IORING_OP_READ_FIXED : IORING_OP_RECV, c.s, c.s, Recv);
+    if (!sqe) {
+        return;
+    }
+    sqe->addr = reinterpret_cast<uint64_t>(tail);
+    sqe->len = room;
+    if (rc->slot >= 0) {
+        sqe->off = uint64_t(-1); // socket has no position
+        sqe->buf_index = 0;
+    }
+    rc->receiving = true;
+}
+
+void UringReactor::StartWrite(RingConnection *rc)
+{
+    if (rc->writing || !ring.Reserve(2) || !rc->c.out->NextWrite(rc->op)) {
+        return;
+    }
+    const int s = rc->c.s;
+    auto &op = rc->op;
+    if (op.file < 0) {
+        bzero(&rc->msg, sizeof(rc->msg));
+        rc->msg.msg_iov = op.iov;
+        rc->msg.msg_iovlen = op.iov_cnt;
+        auto sqe = Prepare(IORING_OP_SENDMSG, s, s, Send);
+        sqe->addr = reinterpret_cast<uint64_t>(&rc->msg);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL | (op.more ? MSG_MORE : 0);
+        rc->writing = 1;
+        return;
+    }
+    if (!rc->chunk) {
+        rc->chunk.reset(new char[ctx.chunk_bytes]); // file ranges are sent in chunks read into connection's buffer
+    }
+    rc->chunk_len = std::min(op.len, ctx.chunk_bytes);
+    rc->chunk_failed = false;
+    rc->sent = 0;
+
+    auto read = Prepare(IORING_OP_READ, op.file, s, FileRead);
+    read->addr = reinterpret_cast<uint64_t>(rc->chunk.get());
+    read->len = rc->chunk_len;
+    read->off = op.offset;
+    read->flags = IOSQE_IO_LINK; // send starts only once the chunk is read completely
+
+    auto send = Prepare(IORING_OP_SEND, s, s, FileSend);
+    send->addr = reinterpret_cast<uint64_t>(rc->chunk.get());
+    send->len = rc->chunk_len;
+    send->msg_flags = MSG_NOSIGNAL | ((op.more || (rc->chunk_len < op.len)) ? MSG_MORE : 0);
+    rc->writing = 2;
+}
+
+void UringReactor::CloseIdleConnections()
+{
+    expired.clear();
+    timers.Expire(timestamp, expired);
+    for (const auto fd : expired) {
+        if ((fd < conns.size()) && conns[fd]) {
+            conns[fd]->c.keep_alive = IO::TimerWheel::c_none; // expired timers are released by the wheel
+            Abort(conns[fd].get());
+        }
+    }
+}
+
+} // end namespace
+
+struct Server::Impl
+{
+    Context ctx;
+    std::vector<std::unique_ptr<IReactor>> reactors;
+    std::vector<std::vector<int>> reactor_cpus; // cores each event loop is pinned to, empty if threads aren't pinned
+    std::unique_ptr<Concurrent::WorkerPool> worker_pool; // destroyed first, as running requests refer to 'ctx' and reactors
+
+    Impl(const std::string &_ip, unsigned short _port, const std::string &_dir, const Config &cfg);
+
+    void Place(const Config &cfg, unsigned reactor_count); // plans thread placement, if threads are to be pinned
+    void Run();
+};
+
+Server::Impl::Impl(const std::string &_ip, unsigned short _port, const std::string &_dir, const Config &cfg)
+    : ctx(_dir, cfg)
+{
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    const unsigned pool_size = cores * std::max(1u, cfg.workers_per_core);
+    const Concurrent::WorkerPool::Limits limits(cfg.max_queued_per_worker, cfg.max_queued);
+    const bool uring = cfg.io_uring && IO::Ring::Supported();
+    if (cfg.io_uring && !uring) {
+        LOG_WARN("io_uring is not supported by the kernel, falling back to epoll");
+    }
+    const bool inline_requests = cfg.multi_reactor || uring; // several event loops with own listening sockets perform requests themselves
+    if (inline_requests) {
+        if (uring && !cfg.multi_reactor) {
+            LOG_INFO("io_uring event loops perform requests themselves, " + std::to_string(std::max(1u, cfg.reactors)) + " of them are run instead of worker pool");
+        }
+    } else if (cfg.adaptive_pool) {
+        const Concurrent::AdaptiveWorkerPool::Sizing sizing(cfg.min_workers ? cfg.min_workers : cores, cfg.max_workers);
+        worker_pool.reset(new Concurrent::AdaptiveWorkerPool(sizing, limits));
+    } else if (cfg.work_stealing) {
+        worker_pool.reset(new Concurrent::WorkStealingWorkerPool(pool_size, limits));
+    } else {
+        worker_pool.reset(new Concurrent::RoundRobinWorkerPool(pool_size, limits));
+    }
+
+    const unsigned n = inline_requests ? std::max(1u, cfg.reactors) : 1;
+    Place(cfg, n);
+    const auto original_cpus = Concurrent::Topology::Allowed();
+    for (unsigned i = 0; i < n; ++i) {
+        if (!reactor_cpus.empty()) { // memory first touched while constructing the event loop (e.g., registered buffers) is on its node
+            Concurrent::Topology::Pin(reactor_cpus[i]);
+        }
+        if (uring) {
+            reactors.push_back(std::unique_ptr<IReactor>(new UringReactor(_ip, _port, true, ctx)));
         } else {
-            if (eof) {
-                poller.Remove(c);
+            reactors.push_back(std::unique_ptr<IReactor>(new Reactor(_ip, _port, cfg.multi_reactor, ctx, worker_pool.get())));
+        }
+    }
+    if (!reactor_cpus.empty()) {
+        Concurrent::Topology::Pin(original_cpus);
+    }
+}
+
+void Server::Impl::Place(const Config &cfg, unsigned reactor_count)
+{
+    if (!cfg.pin_threads) {
+        return;
+    }
+    auto allowed = Concurrent::Topology::Allowed();
+    if (!cfg.cpus.empty()) {
+        std::vector<int> chosen;
+        if (Concurrent::Topology::ParseList(cfg.cpus, chosen)) {
+            allowed.erase(std::remove_if(allowed.begin(), allowed.end(), [&chosen](int cpu) {
+                return std::find(chosen.begin(), chosen.end(), cpu) == chosen.end();
+            }), allowed.end());
+        } else {
+            LOG_WARN("Malformed CPU list " + cfg.cpus + " is ignored");
+        }
+    }
+    const Concurrent::Topology topology(allowed);
+    std::vector<int> irq_cpus;
+    if (!cfg.irq_interface.empty()) {
+        irq_cpus = Concurrent::Topology::IrqCpus(cfg.irq_interface);
+        if (irq_cpus.empty()) {
+            LOG_WARN("No interrupts of " + cfg.irq_interface + " found");
+        }
+    }
+    const Concurrent::Placement placement(topology, reactor_count, irq_cpus);
+    if (placement.reactors.empty()) {
+        LOG_WARN("Threads aren't pinned, none of the chosen cores is available");
+        return;
+    }
+    reactor_cpus = placement.reactors;
+    for (size_t i = 0; i < reactor_cpus.size(); ++i) {
+        const int cpu = reactor_cpus[i].front();
+        LOG_INFO("Event loop " + std::to_string(i) + " is pinned to core " + std::to_string(cpu) + " (node " + std::to_string(topology.NodeOf(cpu)) + ")");
+    }
+    if (worker_pool) {
+        const auto cpus = placement.workers;
+        worker_pool->SetThreadInit([cpus]() { Concurrent::Topology::Pin(cpus); });
+        std::string list;
+        for (const int cpu : cpus) {
+            list += (list.empty() ? "" : ",") + std::to_string(cpu);
+        }
+        LOG_INFO("Worker threads are pinned to cores " + list);
+    }
+}
+
+void Server::Impl::Run()
+{
+    if (worker_pool) {
+        if (ctx.stats) {
+            auto pool = worker_pool.get();
+            ctx.stats->SetQueueDepths([pool]() { return pool->QueueDepths(); });
+            if (auto adaptive = dynamic_cast<Concurrent::AdaptiveWorkerPool *>(pool)) {
+                ctx.stats->SetPoolSizing([adaptive]() {
+                    const auto status = adaptive->GetStatus();
+                    Stats::PoolSizing res;
+                    res.threads = status.threads;
+                    res.target = status.target;
+                    res.grown = status.grown;
+                    res.shrunk = status.shrunk;
+                    res.arrival_rate = status.arrival_rate;
+                    res.wait_sec = status.wait_sec;
+                    res.service_sec = status.service_sec;
+                    return res;
+                });
             }
-            break;
         }
-    } while (true);
+        worker_pool->Start();
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < reactors.size(); ++i) {
+        const auto cpus = reactor_cpus.empty() ? std::vector<int>() : reactor_cpus[i];
+        IReactor *r = reactors[i].get();
+        threads.push_back(std::thread([r, cpus]() {
+            Concurrent::Topology::Pin(cpus);
+            r->Run();
+        }));
+    }
+    if (!reactor_cpus.empty()) {
+        Concurrent::Topology::Pin(reactor_cpus[0]);
+    }
+    reactors[0]->Run(); // calling thread runs the first event loop
+    for (auto &thr : threads) {
+        thr.join();
+    }
 }
 
 //
 
-Server::Server(const std::string &ip, short port, const std::string &dir)
-    : pimpl(new Impl(ip, port, dir))
+Server::Server(const std::string &ip, unsigned short port, const std::string &dir, const Config &cfg)
+    : pimpl(new Impl(ip, port, dir, cfg))
 {
 }
 
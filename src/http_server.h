@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <string>
+#include <map>
 
 namespace Http {
 
@@ -10,10 +11,78 @@ struct Error
 {
 };
 
+struct Config
+{
+    size_t cache_bytes = 32 << 20; // 0 disables in-memory static content cache
+    // text files (unless precompressed '.br' or '.gz' sidecar file is found next to them) are gzip-compressed once for clients accepting it,
+    // compressed variants are cached within this budget, 0 disables on-the-fly compression
+    size_t compressed_cache_bytes = 8 << 20;
+    // per-request memory of bodies produced while being sent (gzip-compressed text files too large for the cache, sent with chunked transfer coding)
+    // and of file ranges read by io_uring event loops, such bodies are read, compressed and written this many file bytes at a time
+    size_t chunk_bytes = 128 << 10;
+
+    size_t max_request_line = 8192;
+    size_t max_headers = 100;
+    size_t max_head_bytes = 16384; // request line and all headers
+
+    size_t output_high_water = 1 << 20; // connection isn't read while more than this number of response bytes are queued
+
+    // by default single event loop dispatches requests to the pool of worker threads;
+    // in multi-reactor mode each of 'reactors' event loops has own listening socket (SO_REUSEPORT) and connections, and serves requests itself
+    bool multi_reactor = false;
+    unsigned reactors = 1;
+
+    bool work_stealing = false; // worker threads steal queued connections from each other instead of being pinned to them
+
+    // round-robin and work-stealing pools have this many worker threads per CPU core; as requests mostly wait for disk I/O rather than use CPU,
+    // the default assumes they wait about ten times longer than they take (1 + wait / service), the adaptive pool measures that instead
+    unsigned workers_per_core = 11;
+
+    // worker threads are added and removed between these bounds according to measured wait and service times (instead of fixed pool size),
+    // zeros stand for number of CPU cores and no bound but the pool's safety limit (see 'AdaptiveWorkerPool::Sizing') respectively
+    bool adaptive_pool = false;
+    unsigned min_workers = 0;
+    unsigned max_workers = 0;
+
+    // admission control of the worker pool: requests beyond these many waiting for a single worker thread (or connection, if work stealing)
+    // or for the whole pool (0 means no limit) are rejected by the event loop right away with '503 Service Unavailable' and 'Retry-After';
+    // while requests wait for workers longer than 'max_queue_wait_ms' on average (0 disables), no new connections are accepted
+    size_t max_queued_per_worker = 1024;
+    size_t max_queued = 0;
+    unsigned max_queue_wait_ms = 500;
+    unsigned retry_after_sec = 1;
+
+    // thread placement: with 'pin_threads' every event loop is pinned to a core of its own (spread over NUMA nodes) and worker threads
+    // to the other cores of the first event loop's node, so connections, their buffers and the threads serving them stay on one node;
+    // placement is limited to 'cpus' (e.g., "0-7,16-23", all cores the process may run on if empty),
+    // event loops take the cores handling interrupts of network interface 'irq_interface' (e.g., "eth0") first
+    bool pin_threads = false;
+    std::string cpus;
+    std::string irq_interface;
+
+    // event loops are built on io_uring instead of epoll (if kernel supports it) and perform requests themselves, as all the I/O of a connection
+    // is submitted through the ring of its event loop: 'reactors' of them are run as in multi-reactor mode, and there is no worker pool
+    // (i.e., pool and admission control settings don't apply)
+    bool io_uring = false;
+
+    // all files under the document root are indexed on startup (and the index is kept up to date by inotify),
+    // so requests are resolved without syscalls and the missing files are answered right away;
+    // with 'keep_files_open' the indexed files are opened once and their descriptors are shared by all requests;
+    // startup walks the whole tree (as does every inotify queue overflow) and a file created afterwards isn't found until the change is published
+    bool docroot_index = false;
+    bool keep_files_open = false;
+
+    std::string stats_path = "/__stats"; // metrics in Prometheus text format are served at this path, empty disables metrics altogether
+
+    // 'Cache-Control: max-age' (seconds) of static content by file extension, "*" stands for any other extension;
+    // files of extensions missing here are sent without 'Cache-Control' header
+    std::map<std::string, unsigned> max_age;
+};
+
 class Server
 {
 public:
-    explicit Server(const std::string &ip, short port, const std::string &dir);
+    explicit Server(const std::string &ip, unsigned short port, const std::string &dir, const Config &cfg = Config());
     ~Server();
 
     void Run();
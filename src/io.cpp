@@ -1,11 +1,27 @@
 #include "io.h"
+#include "ring_queue.h"
 
 #include <atomic>
 #include <string>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
 #include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <chrono>
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
 
 namespace IO {
 
@@ -32,14 +48,14 @@ Socket::Socket(int _fd)
     , ctl((_fd >= 0) ? new CtlBlock : nullptr)
 {
     if (fd >= 0) {
-        Logger::Instance().Log("  Socket " + std::to_string(fd) + ": Opened");
+        LOG_TRACE("  Socket", fd, -1, "Opened");
     }
 }
 
 Socket::~Socket()
 {
     if ((fd >= 0) && (--ctl->ref_cnt == 0)) {
-        Logger::Instance().Log("  Socket " + std::to_string(fd) + ": Closed");
+        LOG_TRACE("  Socket", fd, -1, "Closed");
 
         close(fd);
         fd = -1;
@@ -102,70 +118,788 @@ void Socket::Swap(Socket &other)
 
 //
 
+File::File()
+    : fd(-1)
+{
+    st.st_size = 0;
+}
+
+File::File(const std::string &path)
+    : fd(open(path.c_str(), O_RDONLY | O_CLOEXEC))
+{
+    if ((fd >= 0) && ((fstat(fd, &st) < 0) || !S_ISREG(st.st_mode))) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        st.st_size = 0;
+    }
+}
+
+File::~File()
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+File::File(File &&rhs)
+    : fd(rhs.fd)
+    , st(rhs.st)
+{
+    rhs.fd = -1;
+    rhs.st.st_size = 0;
+}
+
+File &File::operator =(File &&rhs)
+{
+    if (this != &rhs) {
+        File tmp(std::move(rhs));
+        std::swap(fd, tmp.fd);
+        std::swap(st, tmp.st);
+    }
+    return *this;
+}
+
+off_t File::Size() const
+{
+    return st.st_size;
+}
+
+const struct stat &File::Stat() const
+{
+    return st;
+}
+
+bool File::ReadAll(std::string &buf) const
+{
+    const auto start = buf.size();
+    buf.resize(start + st.st_size);
+    off_t offset = 0;
+    while (offset < st.st_size) {
+        const auto n = pread(fd, &buf[start + offset], st.st_size - offset, offset);
+        if (n > 0) {
+            offset += n;
+        } else if ((n < 0) && (errno == EINTR)) {
+            continue;
+        } else {
+            buf.resize(start);
+            return false;
+        }
+    }
+    return true;
+}
+
+ssize_t File::Read(off_t offset, char *buf, size_t len) const
+{
+    for (;;) {
+        const auto n = pread(fd, buf, len, offset);
+        if ((n >= 0) || (errno != EINTR)) {
+            return n;
+        }
+    }
+}
+
+File::operator bool() const
+{
+    return fd >= 0;
+}
+
+File::operator int() const
+{
+    return fd;
+}
+
+//
+
+struct OutQueue::Impl : std::enable_shared_from_this<OutQueue::Impl>
+{
+    struct Segment
+    {
+        std::string bytes;
+        std::shared_ptr<const void> owner;
+        const char *data; // 'nullptr' means segment owns its 'bytes'
+        std::shared_ptr<const File> file;
+        std::shared_ptr<Source> source; // 'bytes' hold its current piece (segment waits for the next one while it's empty)...
+        std::string next;               // ...and this the next one, once it's 'prefetched'
+        bool prefetched;
+        bool producing; // job producing the next piece is on its way
+        off_t offset;
+        size_t len;
+
+        const char *Ptr() const;
+    };
+
+    static const int c_max_iov = 16;
+
+    mutable std::mutex mtx;
+    Socket s;
+    std::deque<Segment> segs;
+    size_t pending;
+    size_t high_water;
+    int responses_due;
+    bool corked;
+    bool reading;
+    bool shutdown;
+    bool broken;
+
+    int epoll;
+    uint32_t events; // currently registered interest
+    std::function<void()> wake;
+
+    bool deferred;
+    bool writing; // write taken by 'NextWrite' is not reported yet
+
+    Runner run;
+    std::function<void()> ready;
+
+    Impl(Socket _s, size_t _high_water);
+
+    void Push(Segment &&seg);
+    bool Write();
+    void Consume(size_t n);
+    bool Refill(Segment &seg); // prefetched piece takes place of the written one, 'false' if it isn't produced yet
+    void Produce(); // starts production of the next piece, if some source has none prefetched (to be called without the lock)
+    void Produced(const std::shared_ptr<Source> &src, std::string &piece, bool ok);
+    void Fail(); // there is no way to deliver the rest
+    void UpdateInterest();
+    void WakeIfNeeded();
+    bool CanResume() const;
+};
+
+const char *OutQueue::Impl::Segment::Ptr() const
+{
+    return (data ? data : bytes.data()) + offset;
+}
+
+OutQueue::Impl::Impl(Socket _s, size_t _high_water)
+    : s(std::move(_s))
+    , pending(0)
+    , high_water(_high_water)
+    , responses_due(0)
+    , corked(false)
+    , reading(true)
+    , shutdown(false)
+    , broken(false)
+    , epoll(-1)
+    , events(0)
+    , deferred(false)
+    , writing(false)
+{
+}
+
+void OutQueue::Impl::Push(Segment &&seg)
+{
+    if (broken || (seg.len == 0)) {
+        return;
+    }
+    pending += seg.len;
+    segs.push_back(std::move(seg));
+    if ((segs.size() == 1) && !corked && !deferred) { // otherwise socket is known to be full already, wait for EPOLLOUT
+        Write();
+    }
+}
+
+bool OutQueue::Impl::Write()
+{
+    bool progress = false;
+    while (!segs.empty() && !broken) {
+        ssize_t n;
+        auto &front = segs.front();
+        if ((front.len == 0) && front.source) { // waiting for the next piece
+            break;
+        }
+        if (front.file) {
+            off_t offset = front.offset; // 'Consume' advances segment's offset
+            n = sendfile(s, *front.file, &offset, front.len); // kernel streams file pages directly into the socket
+        } else { // gather adjacent in-memory segments (e.g., header and cached body) into a single system call
+            iovec iov[c_max_iov];
+            int cnt = 0;
+            auto it = segs.begin();
+            for (; (it != segs.end()) && !it->file && (it->len > 0) && (cnt < c_max_iov); ++it, ++cnt) {
+                iov[cnt].iov_base = const_cast<char *>(it->Ptr());
+                iov[cnt].iov_len = it->len;
+            }
+            msghdr msg;
+            bzero(&msg, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = cnt;
+            n = sendmsg(s, &msg, MSG_NOSIGNAL | ((it != segs.end()) ? MSG_MORE : 0));
+        }
+        if (n > 0) {
+            Consume(n);
+            progress = true;
+        } else if ((n < 0) && (errno == EINTR)) {
+            continue;
+        } else if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            break;
+        } else { // connection is broken (or file got truncated)
+            Fail();
+        }
+    }
+    UpdateInterest();
+    WakeIfNeeded();
+    return progress;
+}
+
+void OutQueue::Impl::Consume(size_t n)
+{
+    pending -= n;
+    while (n > 0) {
+        auto &front = segs.front();
+        const size_t k = std::min(n, front.len);
+        front.offset += k;
+        front.len -= k;
+        n -= k;
+        if ((front.len == 0) && front.source && !Refill(front)) { // segment stays until the next piece is produced
+            break;
+        }
+        if (front.len == 0) {
+            segs.pop_front();
+        }
+    }
+}
+
+bool OutQueue::Impl::Refill(Segment &seg)
+{
+    if (!seg.prefetched) {
+        return false;
+    }
+    seg.bytes.swap(seg.next); // storage of the written piece is reused for the one after
+    seg.offset = 0;
+    seg.len = seg.bytes.size();
+    seg.prefetched = false;
+    pending += seg.len;
+    return true;
+}
+
+void OutQueue::Impl::Produce()
+{
+    std::shared_ptr<Source> src;
+    Runner runner;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto &seg : segs) {
+            if (seg.source && !seg.prefetched && !seg.producing) {
+                seg.producing = true; // so a single thread at a time calls the source
+                src = seg.source;
+                break;
+            }
+        }
+        runner = run;
+    }
+    if (!src) {
+        return;
+    }
+    std::weak_ptr<Impl> self = shared_from_this(); // the queue may be gone once the piece is produced
+    auto job = [self, src]() {
+        std::string piece;
+        const bool ok = src->Next(piece);
+        if (auto impl = self.lock()) {
+            impl->Produced(src, piece, ok);
+        }
+    };
+    if (runner) {
+        runner(std::move(job));
+    } else {
+        job();
+    }
+}
+
+void OutQueue::Impl::Produced(const std::shared_ptr<Source> &src, std::string &piece, bool ok)
+{
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = std::find_if(segs.begin(), segs.end(), [&src](const Segment &seg) { return seg.source == src; });
+        if (it == segs.end()) { // discarded meanwhile
+            return;
+        }
+        it->producing = false;
+        if (!ok) {
+            Fail();
+            UpdateInterest();
+            WakeIfNeeded();
+            notify = ready;
+        } else {
+            it->next.swap(piece);
+            it->prefetched = true;
+            if (it->len == 0) { // queue waits for it
+                Refill(*it);
+                if (it->len == 0) { // end of the source
+                    segs.erase(it);
+                }
+                if (deferred || corked) {
+                    notify = ready;
+                } else {
+                    Write();
+                }
+            }
+        }
+    }
+    if (notify) {
+        notify();
+    }
+    Produce(); // the one after
+}
+
+void OutQueue::Impl::Fail()
+{
+    broken = true;
+    segs.clear();
+    pending = 0;
+}
+
+void OutQueue::Impl::UpdateInterest()
+{
+    if (epoll < 0) {
+        return;
+    }
+    const uint32_t desired = (reading ? EPOLLIN : 0) | ((pending > 0) ? EPOLLOUT : 0);
+    if (desired != events) {
+        epoll_event ev;
+        bzero(&ev, sizeof(epoll_event));
+        ev.events = desired;
+        ev.data.fd = s;
+        if (epoll_ctl(epoll, EPOLL_CTL_MOD, s, &ev) == 0) {
+            events = desired;
+        }
+    }
+}
+
+bool OutQueue::Impl::CanResume() const
+{
+    return !reading && !shutdown && (pending <= high_water / 2);
+}
+
+void OutQueue::Impl::WakeIfNeeded()
+{
+    if (wake && (CanResume() || (shutdown && (responses_due == 0) && segs.empty()))) {
+        wake();
+    }
+}
+
+//
+
+OutQueue::OutQueue(Socket _s, size_t _high_water)
+    : pimpl(new Impl(std::move(_s), _high_water))
+{
+}
+
+OutQueue::~OutQueue() = default;
+
+bool OutQueue::Watch(int epoll, std::function<void()> wake)
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    epoll_event ev;
+    bzero(&ev, sizeof(epoll_event));
+    ev.events = EPOLLIN;
+    ev.data.fd = pimpl->s;
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, pimpl->s, &ev) != 0) {
+        return false;
+    }
+    pimpl->epoll = epoll;
+    pimpl->events = ev.events;
+    pimpl->wake = std::move(wake);
+    pimpl->UpdateInterest();
+    return true;
+}
+
+void OutQueue::Unwatch()
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    if (pimpl->epoll >= 0) {
+        epoll_ctl(pimpl->epoll, EPOLL_CTL_DEL, pimpl->s, nullptr);
+        pimpl->epoll = -1;
+    }
+    pimpl->wake = nullptr;
+    pimpl->Fail();
+}
+
+void OutQueue::Push(std::string bytes)
+{
+    Impl::Segment seg;
+    seg.data = nullptr;
+    seg.offset = 0;
+    seg.len = bytes.size();
+    seg.bytes = std::move(bytes);
+
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    pimpl->Push(std::move(seg));
+}
+
+void OutQueue::Push(std::shared_ptr<const void> owner, const char *data, size_t len)
+{
+    Impl::Segment seg;
+    seg.owner = std::move(owner);
+    seg.data = data;
+    seg.offset = 0;
+    seg.len = len;
+
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    pimpl->Push(std::move(seg));
+}
+
+void OutQueue::Push(std::shared_ptr<const File> f, off_t offset, size_t len)
+{
+    Impl::Segment seg;
+    seg.data = nullptr;
+    seg.file = std::move(f);
+    seg.offset = offset;
+    seg.len = len;
+
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    pimpl->Push(std::move(seg));
+}
+
+void OutQueue::Push(std::shared_ptr<Source> src)
+{
+    Impl::Segment seg;
+    seg.data = nullptr;
+    seg.offset = 0;
+    const bool ok = src->Next(seg.bytes); // without the lock, nobody else knows the source yet
+    seg.len = seg.bytes.size();
+    seg.source = std::move(src);
+    seg.prefetched = false;
+    seg.producing = false;
+    {
+        std::lock_guard<std::mutex> lock(pimpl->mtx);
+        if (!ok) {
+            pimpl->Fail();
+            return;
+        }
+        pimpl->Push(std::move(seg));
+    }
+    pimpl->Produce();
+}
+
+void OutQueue::SetProducer(Runner run, std::function<void()> ready)
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    pimpl->run = std::move(run);
+    pimpl->ready = std::move(ready);
+}
+
+OutQueue::Runner OutQueue::Producer() const
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    return pimpl->run;
+}
+
+void OutQueue::Produce()
+{
+    pimpl->Produce();
+}
+
+void OutQueue::Cork()
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    pimpl->corked = true;
+}
+
+void OutQueue::Uncork()
+{
+    {
+        std::lock_guard<std::mutex> lock(pimpl->mtx);
+        pimpl->corked = false;
+        if (!pimpl->deferred) {
+            pimpl->Write();
+        }
+    }
+    pimpl->Produce();
+}
+
+bool OutQueue::Flush()
+{
+    bool progress;
+    {
+        std::lock_guard<std::mutex> lock(pimpl->mtx);
+        progress = pimpl->Write();
+    }
+    pimpl->Produce();
+    return progress;
+}
+
+void OutQueue::Defer()
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    pimpl->deferred = true;
+}
+
+bool OutQueue::NextWrite(WriteOp &op)
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    auto &segs = pimpl->segs;
+    if (segs.empty() || (segs.front().len == 0) || pimpl->corked || pimpl->writing || pimpl->broken) { // or waiting for the next piece
+        return false;
+    }
+    auto it = segs.begin();
+    if (it->file) {
+        op.iov_cnt = 0;
+        op.file = *it->file;
+        op.offset = it->offset;
+        op.len = it->len;
+        ++it;
+    } else {
+        op.iov_cnt = 0;
+        op.file = -1;
+        op.len = 0;
+        for (; (it != segs.end()) && !it->file && (it->len > 0) && (op.iov_cnt < WriteOp::c_max_iov); ++it, ++op.iov_cnt) {
+            op.iov[op.iov_cnt].iov_base = const_cast<char *>(it->Ptr());
+            op.iov[op.iov_cnt].iov_len = it->len;
+            op.len += it->len;
+        }
+    }
+    op.more = (it != segs.end());
+    pimpl->writing = true;
+    return true;
+}
+
+void OutQueue::Written(ssize_t res)
+{
+    {
+        std::lock_guard<std::mutex> lock(pimpl->mtx);
+        pimpl->writing = false;
+        if (pimpl->broken) { // unwatched meanwhile
+            return;
+        }
+        if (res > 0) {
+            pimpl->Consume(res);
+        } else if ((res != -EAGAIN) && (res != -EINTR)) {
+            pimpl->Fail();
+        }
+        pimpl->WakeIfNeeded();
+    }
+    pimpl->Produce();
+}
+
+size_t OutQueue::Queued() const
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    return pimpl->pending;
+}
+
+bool OutQueue::Producing() const
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    for (const auto &seg : pimpl->segs) {
+        if (seg.source) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t OutQueue::MoveTo(OutQueue &dst, size_t len)
+{
+    std::vector<Impl::Segment> moved;
+    {
+        std::lock_guard<std::mutex> lock(pimpl->mtx);
+        auto &segs = pimpl->segs;
+        len = std::min(len, pimpl->pending);
+        size_t left = len;
+        while ((left > 0) && !segs.empty() && (segs.front().len > 0)) { // up to a source waiting for its next piece
+            auto &front = segs.front();
+            if ((front.len <= left) && !front.source) {
+                left -= front.len;
+                pimpl->pending -= front.len;
+                moved.push_back(std::move(front));
+                segs.pop_front();
+                continue;
+            }
+            Impl::Segment part; // the rest of the segment (or the source producing further pieces) stays
+            const size_t k = std::min(left, front.len);
+            if (front.file || front.data) {
+                part.owner = front.owner;
+                part.data = front.data;
+                part.file = front.file;
+                part.offset = front.offset;
+            } else {
+                part.data = nullptr;
+                part.bytes.assign(front.bytes, front.offset, k);
+                part.offset = 0;
+            }
+            part.len = k;
+            moved.push_back(std::move(part));
+            pimpl->Consume(k); // prefetched piece takes place of the whole moved one
+            left -= k;
+        }
+        len -= left;
+    }
+    std::lock_guard<std::mutex> lock(dst.pimpl->mtx);
+    for (auto &seg : moved) {
+        dst.pimpl->Push(std::move(seg));
+    }
+    return len;
+}
+
+bool OutQueue::ReadingAllowed()
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    if (pimpl->reading && (pimpl->pending > pimpl->high_water)) {
+        pimpl->reading = false;
+    } else if (pimpl->CanResume()) {
+        pimpl->reading = true;
+    }
+    pimpl->UpdateInterest();
+    return pimpl->reading;
+}
+
+void OutQueue::Shutdown()
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    pimpl->shutdown = true;
+    pimpl->reading = false;
+    pimpl->UpdateInterest();
+}
+
+bool OutQueue::BeginResponse()
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    return ++pimpl->responses_due == 1;
+}
+
+bool OutQueue::EndResponse()
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    --pimpl->responses_due;
+    pimpl->WakeIfNeeded();
+    return pimpl->responses_due == 0;
+}
+
+bool OutQueue::Busy() const
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    return pimpl->responses_due > 0;
+}
+
+bool OutQueue::Idle() const
+{
+    std::lock_guard<std::mutex> lock(pimpl->mtx);
+    return (pimpl->responses_due == 0) && pimpl->segs.empty();
+}
+
+int OutQueue::Fd() const
+{
+    return pimpl->s;
+}
+
+//
+
 struct BufReader::Impl
 {
     Socket s;
-    char buf[1024];
-    int cur;
-    int remaining;
+    std::unique_ptr<char[]> owned;
+    char *buf;
+    size_t capacity;
+    size_t begin;
+    size_t end;
     bool eof;
-	
-    Impl(Socket _s);
+
+    Impl(Socket _s, char *storage, size_t _capacity);
+
+    void Compact();
 };
 
-BufReader::Impl::Impl(Socket _s)
+BufReader::Impl::Impl(Socket _s, char *storage, size_t _capacity)
     : s(std::move(_s))
-    , cur(-1)
-    , remaining(0)
+    , owned(storage ? nullptr : new char[_capacity])
+    , buf(storage ? storage : owned.get())
+    , capacity(_capacity)
+    , begin(0)
+    , end(0)
     , eof(false)
 {
 }
 
+void BufReader::Impl::Compact()
+{
+    if (begin > 0) {
+        memmove(buf, buf + begin, end - begin);
+        end -= begin;
+        begin = 0;
+    }
+}
+
 //
 
-static const auto c_invalid_char = std::char_traits<char>::eof();
+BufReader::BufReader(Socket s, size_t capacity)
+    : pimpl(new Impl(std::move(s), nullptr, capacity))
+{
+}
 
-BufReader::BufReader(Socket s)
-    : pimpl(new Impl(std::move(s)))
+BufReader::BufReader(Socket s, char *storage, size_t capacity)
+    : pimpl(new Impl(std::move(s), storage, capacity))
 {
 }
 
 BufReader::~BufReader() = default;
 
-int BufReader::ReadChar()
+size_t BufReader::Fill()
 {
-    if (pimpl->eof) {
-        return c_invalid_char;
+    if (pimpl->end == pimpl->capacity) {
+        pimpl->Compact();
     }
-    if (pimpl->remaining == 0) {
-        const auto n = read(pimpl->s, pimpl->buf, sizeof(pimpl->buf));
+    size_t total = 0;
+    while (!pimpl->eof && (pimpl->end < pimpl->capacity)) {
+        const auto n = read(pimpl->s, pimpl->buf + pimpl->end, pimpl->capacity - pimpl->end);
         if (n > 0) {
-            pimpl->remaining = n;
-            pimpl->cur = 0;
+            pimpl->end += n;
+            total += n;
+        } else if (n == 0) {
+            pimpl->eof = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            break;
         } else {
-            if (n == 0) {
-                pimpl->eof = true;
-            }
-            return c_invalid_char;
+            pimpl->eof = true; // connection is broken, nothing more will ever be read
         }
     }
-    return pimpl->buf[--pimpl->remaining, pimpl->cur++];
+    return total;
 }
 
-std::string BufReader::ReadLine()
+char *BufReader::Tail()
 {
-    std::string line;
-    do {
-        const int c = ReadChar();
-        if (c == c_invalid_char) {
-            break;
-        }
-        line += c;
-        if (c == '\n') {
-            break;
-        }
-    } while (true);
-    return line;
+    pimpl->Compact(); // whatever is left unconsumed is a part of single request, so it's short
+    return pimpl->buf + pimpl->end;
+}
+
+size_t BufReader::Room() const
+{
+    return pimpl->capacity - pimpl->end;
+}
+
+void BufReader::Commit(ssize_t n)
+{
+    if (n > 0) {
+        pimpl->end += std::min(size_t(n), pimpl->capacity - pimpl->end);
+    } else {
+        pimpl->eof = true;
+    }
+}
+
+const char *BufReader::Data() const
+{
+    return pimpl->buf + pimpl->begin;
+}
+
+size_t BufReader::Size() const
+{
+    return pimpl->end - pimpl->begin;
+}
+
+void BufReader::Consume(size_t n)
+{
+    pimpl->begin += std::min(n, Size());
+    if (pimpl->begin == pimpl->end) {
+        pimpl->begin = pimpl->end = 0;
+    }
+}
+
+bool BufReader::Full() const
+{
+    return (pimpl->begin == 0) && (pimpl->end == pimpl->capacity);
 }
 
 bool BufReader::Eof() const
@@ -175,34 +909,197 @@ bool BufReader::Eof() const
 
 //
 
+namespace {
+
+const size_t c_log_text = 160; // longer texts (e.g., request lines) are truncated
+
+struct LogRecord
+{
+    const char *prefix;
+    const char *note;
+    int fd;
+    int64_t id;
+    uint8_t len;
+    bool truncated;
+    char text[c_log_text];
+
+    void Format(std::string &out) const;
+};
+
+void LogRecord::Format(std::string &out) const
+{
+    if (prefix) {
+        out += prefix;
+        out += ' ';
+        out += std::to_string(fd);
+        if (id >= 0) {
+            out += ':';
+            out += std::to_string(id);
+        }
+        out += ": ";
+        out += note;
+    }
+    out.append(text, len);
+    if (truncated) {
+        out += "...";
+    }
+    out += '\n';
+}
+
+}
+
 struct Logger::Impl
 {
-    std::mutex m;
     std::ofstream fs;
+    LogConfig cfg;
+    Concurrent::MpscQueue<LogRecord> queue;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> quit;
+    std::mutex idle_mtx;
+    std::condition_variable idle_cv; // flusher sleeps between flushes unless blocked producer or quitting wakes it up
+    bool urgent;
+    std::thread flusher;
+
+    Impl(const std::string &path, const LogConfig &_cfg);
+    ~Impl();
 
-    Impl(const std::string &path);
+    void Put(LogRecord &rec);
+
+    void Flush();
+    void Run();
 };
 
-Logger::Impl::Impl(const std::string &path)
+Logger::Impl::Impl(const std::string &path, const LogConfig &_cfg)
     : fs(path)
+    , cfg(_cfg)
+    , queue(_cfg.queue_size)
+    , dropped(0)
+    , quit(false)
+    , urgent(false)
+{
+    flusher = std::thread(&Impl::Run, this);
+}
+
+Logger::Impl::~Impl()
+{
+    {
+        std::lock_guard<std::mutex> lock(idle_mtx);
+        quit = true;
+    }
+    idle_cv.notify_one();
+    flusher.join(); // whatever is still queued is written out before the thread exits
+}
+
+void Logger::Impl::Put(LogRecord &rec)
+{
+    while (!queue.Send(std::move(rec))) {
+        if (cfg.overflow == LogOverflow::Drop) {
+            ++dropped;
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(idle_mtx);
+            urgent = true;
+        }
+        idle_cv.notify_one();
+        std::this_thread::yield();
+    }
+}
+
+void Logger::Impl::Flush()
+{
+    std::string buf;
+    buf.reserve(cfg.flush_bytes + 2 * c_log_text);
+    LogRecord rec;
+    while (queue.TryReceive(rec)) {
+        rec.Format(buf);
+        if (buf.size() >= cfg.flush_bytes) {
+            fs.write(buf.data(), buf.size());
+            buf.clear();
+        }
+    }
+    if (const auto n = dropped.exchange(0)) {
+        buf += "Logger: " + std::to_string(n) + " messages dropped\n";
+    }
+    fs.write(buf.data(), buf.size());
+    fs.flush();
+}
+
+void Logger::Impl::Run()
+{
+    while (!quit) {
+        const bool backlog = queue.Size() >= queue.MaxSize() / 2; // don't let producers hit the limit if they are that fast
+        Flush();
+        if (!backlog) {
+            std::unique_lock<std::mutex> lock(idle_mtx);
+            idle_cv.wait_for(lock, std::chrono::milliseconds(cfg.flush_interval_ms), [this]() { return urgent || quit; });
+            urgent = false;
+        }
+    }
+    Flush();
+}
+
+//
+
+LogLevel LogLevelFromName(const std::string &name)
 {
+    static const char *names[] = { "trace", "debug", "info", "warn", "error", "off" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (name == names[i]) {
+            return static_cast<LogLevel>(i);
+        }
+    }
+    return LogLevel::Info;
 }
 
+//
+
 Logger &Logger::Instance()
 {
     static Logger log;
     return log;
 }
 
-void Logger::Reset(const std::string &path)
+void Logger::Reset(const std::string &path, const LogConfig &cfg)
+{
+    pimpl.reset(); // previous log is completed first
+    pimpl.reset(new Impl(path, cfg));
+}
+
+void Logger::SetLevel(LogLevel level)
 {
-    pimpl.reset(new Impl(path));
+    min_level = static_cast<int>(level);
+}
+
+void Logger::Log(const char *prefix, int fd, int64_t id, const char *note, const char *text, size_t len)
+{
+    if (!pimpl) {
+        return;
+    }
+    LogRecord rec;
+    rec.prefix = prefix;
+    rec.note = note;
+    rec.fd = fd;
+    rec.id = id;
+    rec.truncated = (len > c_log_text);
+    rec.len = std::min(len, c_log_text);
+    memcpy(rec.text, text, rec.len);
+    pimpl->Put(rec);
+}
+
+void Logger::Log(const char *prefix, int fd, int64_t id, const char *note, const char *text)
+{
+    Log(prefix, fd, id, note, text, strlen(text));
 }
 
 void Logger::Log(const std::string &msg)
 {
-    std::lock_guard<std::mutex> lock(pimpl->m);
-    pimpl->fs << msg << std::endl;
+    Log(nullptr, -1, -1, "", msg.data(), msg.size());
+}
+
+uint64_t Logger::Dropped() const
+{
+    return pimpl ? pimpl->dropped.load() : 0;
 }
 
 }
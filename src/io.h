@@ -2,6 +2,14 @@
 #define IO_H
 
 #include <memory>
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <atomic>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 namespace IO {
 
@@ -29,40 +37,216 @@ private:
     CtlBlock *ctl;
 };
 
+class File
+{
+public:
+    File();
+    explicit File(const std::string &path);
+    ~File();
+
+    File(const File &) = delete;
+    File &operator =(const File &) = delete;
+
+    File(File &&rhs);
+    File &operator =(File &&rhs);
+
+    off_t Size() const;
+    const struct stat &Stat() const;
+
+    bool ReadAll(std::string &buf) const; // appends entire file contents to 'buf'
+    ssize_t Read(off_t offset, char *buf, size_t len) const; // bytes read at 'offset' (0 at the end of file), negative on error
+
+    operator bool() const;
+    operator int() const;
+private:
+    int fd;
+    struct stat st;
+};
+
+// data produced piece by piece (e.g., compressed on the fly) as pieces get written, so only a couple of pieces are ever held in memory
+class Source
+{
+public:
+    virtual ~Source() = default;
+    virtual bool Next(std::string &piece) = 0; // replaces contents of 'piece' (reusing its storage), empty one means the end; 'false' on error
+};
+
+// thread-safe queue of bytes and file ranges to be written to the non-blocking socket;
+// pushed data is written right away as far as socket send buffer allows, the rest is written once socket becomes writable again
+class OutQueue
+{
+public:
+    OutQueue(Socket _s, size_t _high_water);
+    ~OutQueue();
+
+    OutQueue(const OutQueue &) = delete;
+    OutQueue &operator =(const OutQueue &) = delete;
+
+    // adds socket to 'epoll' and keeps its interest in sync with the queue state from now on:
+    // EPOLLIN while reading is allowed, EPOLLOUT while some queued data is not yet accepted by the socket;
+    // 'wake' is called (from arbitrary thread) once paused reading can be resumed or shut down queue becomes idle
+    bool Watch(int epoll, std::function<void()> wake);
+    void Unwatch(); // removes socket from epoll and discards queued data, subsequently pushed data is discarded too
+
+    void Push(std::string bytes);
+    void Push(std::shared_ptr<const void> owner, const char *data, size_t len); // 'owner' keeps 'data' alive until written
+    void Push(std::shared_ptr<const File> f, off_t offset, size_t len);
+    void Push(std::shared_ptr<Source> src); // first piece is produced right away, further ones one piece ahead of writing (see 'SetProducer')
+
+    // jobs producing further pieces of sources are handed to 'run' (e.g., submitted to worker threads), so that neither the lock nor
+    // the thread draining the queue (e.g., event loop) waits for them; without it they are done by the draining thread once it releases the lock;
+    // 'ready' is called (from arbitrary thread) once a piece the queue waits for is produced, as deferred queue isn't written by producing thread
+    using Runner = std::function<void(std::function<void()>)>;
+    void SetProducer(Runner run, std::function<void()> ready = nullptr);
+    Runner Producer() const;
+    void Produce(); // starts production of the next piece a source lacks, called by methods draining the queue except 'MoveTo'
+
+    void Cork();   // pushed data is only queued...
+    void Uncork(); // ...until uncorked, so that e.g. response header and body could be written with one system call
+
+    bool Flush(); // to be called once socket is writable, returns 'true' if any progress is made
+
+    // alternatively to writing by the pushing thread, queue could be drained by its owner (e.g., io_uring event loop),
+    // which takes writes one by one and reports their results back (segments stay alive until then)
+    struct WriteOp
+    {
+        static const int c_max_iov = 16;
+
+        iovec iov[c_max_iov]; // adjacent in-memory segments to be gathered...
+        int iov_cnt;
+        int file;             // ...or range of the file (if 'file' isn't negative) to be sent
+        off_t offset;
+        size_t len;
+        bool more;            // more data follows the write
+    };
+    void Defer(); // pushed data is never written right away
+    bool NextWrite(WriteOp &op); // 'false' if nothing is queued (or corked) or previous write isn't reported yet
+    void Written(ssize_t res); // bytes written or negative error code
+
+    // or queued data could be relayed to another queue piece by piece (e.g., framed by HTTP/2 session),
+    // segments are moved as they are, so that file ranges are still never read into memory
+    size_t Queued() const; // produced pieces of sources count only
+    bool Producing() const; // some source is yet to produce its next pieces (which could be none, i.e., its end)
+    size_t MoveTo(OutQueue &dst, size_t len); // returns number of bytes moved, the caller calls 'Produce' once it holds no locks
+
+    // pauses reading while more than high water mark bytes are queued, resumes it once queue is drained to half of that
+    bool ReadingAllowed();
+    void Shutdown(); // no more reading, queue becomes idle once all due responses are written
+
+    bool BeginResponse(); // response is due, i.e., request is accepted for processing, returns 'true' if no other response was due
+    bool EndResponse();   // all the response data is pushed, returns 'true' if no more responses are due
+
+    bool Busy() const; // some responses are due
+    bool Idle() const; // nothing is due or queued
+
+    int Fd() const;
+private:
+    struct Impl;
+    std::shared_ptr<Impl> pimpl; // jobs producing pieces refer to it weakly
+};
+
 class BufReader
 {
 public:
-    explicit BufReader(Socket s);
+    explicit BufReader(Socket s, size_t capacity = 16384);
+    BufReader(Socket s, char *storage, size_t capacity); // 'storage' is not owned (e.g., part of buffer registered with io_uring)
     ~BufReader();
     
     BufReader(const BufReader &) = delete;
     BufReader &operator =(const BufReader &) = delete;
 
-    int ReadChar();
-    std::string ReadLine();
+    size_t Fill(); // reads available bytes (without blocking) until buffer is full, returns number of bytes read
 
+    // alternatively to 'Fill', bytes could be read into the free tail of the buffer by someone else (e.g., io_uring)
+    char *Tail();       // unconsumed bytes are moved to the beginning of the buffer first...
+    size_t Room() const; // ...so that the tail is as large as possible
+    void Commit(ssize_t n); // bytes read into the tail, zero or negative error code mean end of stream
+
+    const char *Data() const; // unconsumed bytes
+    size_t Size() const;
+    void Consume(size_t n);
+
+    bool Full() const;
     bool Eof() const;
 private:
     struct Impl;
     std::unique_ptr<Impl> pimpl;
 };
 
+enum class LogLevel
+{
+    Trace,
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+LogLevel LogLevelFromName(const std::string &name); // "trace", "debug", "info", "warn", "error" or "off" (anything else is "info")
+
+// logging is asynchronous: 'Log' only records raw fields into lock-free queue, background thread formats them
+// and writes them out in batches (once 'flush_bytes' are formatted or every 'flush_interval_ms')
+enum class LogOverflow
+{
+    Drop,  // message is discarded (and counted, the count is reported in the log later on)
+    Block  // caller waits until background thread makes room
+};
+
+struct LogConfig
+{
+    size_t queue_size = 8192; // max number of messages waiting to be formatted
+    unsigned flush_interval_ms = 100;
+    size_t flush_bytes = 64 << 10;
+    LogOverflow overflow = LogOverflow::Drop;
+};
+
 class Logger
 {
 public:
     static Logger &Instance();
-    void Reset(const std::string &path);
+    void Reset(const std::string &path, const LogConfig &cfg = LogConfig());
+
+    void SetLevel(LogLevel level);
+    bool Enabled(LogLevel level) const { return static_cast<int>(level) >= min_level.load(std::memory_order_relaxed); }
 
+    // message is formatted as "<prefix> <fd>[:<id>]: <note><text>", 'prefix' and 'note' must be string literals
+    // (only pointers to them are recorded), 'text' is copied (truncated if too long), negative 'id' is omitted
+    void Log(const char *prefix, int fd, int64_t id, const char *note, const char *text, size_t len);
+    void Log(const char *prefix, int fd, int64_t id, const char *note, const char *text = "");
     void Log(const std::string &msg);
+
+    uint64_t Dropped() const;
 private:
     Logger() = default;
     Logger(const Logger &) = delete;
     Logger &operator =(const Logger &) = delete;
 
+    std::atomic<int> min_level{static_cast<int>(LogLevel::Info)};
+
     struct Impl;
     std::unique_ptr<Impl> pimpl;
 };
 
 }
 
+// levels below LOG_COMPILED_LEVEL (index into 'LogLevel', set by CMake's LOG_LEVEL option) are compiled out,
+// levels below the one set at run time are skipped by a single relaxed load; either way arguments are not even evaluated
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 0
+#endif
+
+#define LOG_AT(level, ...)                                                                               \
+    do {                                                                                                 \
+        if ((static_cast<int>(level) >= LOG_COMPILED_LEVEL) && IO::Logger::Instance().Enabled(level)) { \
+            IO::Logger::Instance().Log(__VA_ARGS__);                                                     \
+        }                                                                                                \
+    } while (false)
+
+#define LOG_TRACE(...) LOG_AT(IO::LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(IO::LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(IO::LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(IO::LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(IO::LogLevel::Error, __VA_ARGS__)
+
 #endif
@@ -6,20 +6,52 @@
 
 int main(int argc, char **argv)
 {
+    auto& opts = Opts::Instance();
+    Http::Config cfg;
+    if (!opts.Reset(argc, argv) || !opts.MaxAge(cfg.max_age)) { // reported while stderr is still there
+        Opts::Usage(argv[0]);
+        return 1;
+    }
+
     signal(SIGHUP, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN); // broken connections are reported by 'sendfile' via EPIPE
 
     if (daemon(0, 0) < 0) {
         return 1;
     }
-    
-    auto& opts = Opts::Instance();
-    opts.Reset(argc, argv);
 
-    IO::Logger::Instance().Reset(opts.log);
-    
+    IO::LogConfig log_cfg;
+    log_cfg.queue_size = opts.log_queue_size;
+    log_cfg.flush_interval_ms = opts.log_flush_ms;
+    log_cfg.flush_bytes = opts.log_flush_bytes;
+    log_cfg.overflow = (opts.log_overflow == "block") ? IO::LogOverflow::Block : IO::LogOverflow::Drop;
+    IO::Logger::Instance().Reset(opts.log, log_cfg);
+    IO::Logger::Instance().SetLevel(IO::LogLevelFromName(opts.log_level));
+
+    cfg.cache_bytes = opts.cache_bytes;
+    cfg.compressed_cache_bytes = opts.compressed_cache_bytes;
+    cfg.chunk_bytes = opts.chunk_bytes;
+    cfg.multi_reactor = (opts.mode == "reactors");
+    cfg.reactors = opts.reactors;
+    cfg.work_stealing = (opts.scheduler == "steal");
+    cfg.adaptive_pool = (opts.scheduler == "adaptive");
+    cfg.min_workers = opts.min_workers;
+    cfg.max_workers = opts.max_workers;
+    cfg.max_queued_per_worker = opts.max_queued_per_worker;
+    cfg.max_queued = opts.max_queued;
+    cfg.max_queue_wait_ms = opts.max_queue_wait_ms;
+    cfg.io_uring = (opts.backend == "uring");
+    cfg.pin_threads = (opts.affinity == "numa") || !opts.cpus.empty() || !opts.irq_interface.empty();
+    cfg.cpus = opts.cpus;
+    cfg.irq_interface = opts.irq_interface;
+    cfg.docroot_index = (opts.index != "off");
+    cfg.keep_files_open = (opts.index == "open");
+    cfg.stats_path = (opts.stats_path == "off") ? "" : opts.stats_path;
+
     try {
-        Http::Server(opts.ip, opts.port, opts.dir).Run();
+        Http::Server(opts.ip, opts.port, opts.dir, cfg).Run();
     } catch (...) {
+        LOG_ERROR("Server failed to start on " + opts.ip + ":" + std::to_string(opts.port));
         return 1;
     }
     return 0;
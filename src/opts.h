@@ -2,17 +2,59 @@
 #define OPTS_H
 
 #include <unistd.h>
+#include <thread>
+#include <algorithm>
+#include <initializer_list>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 struct Opts
 {
     std::string dir;
     std::string ip;
     std::string log;
-    short port;
+    unsigned short port = 0; // required
+    size_t cache_bytes = 32 << 20;
+    size_t compressed_cache_bytes = 8 << 20;
+    size_t chunk_bytes = 128 << 10;
+    std::string mode = "pool";
+    unsigned reactors = std::max(1u, std::thread::hardware_concurrency());
+    std::string scheduler = "rr";
+    unsigned min_workers = 0;
+    unsigned max_workers = 0;
+    size_t max_queued_per_worker = 1024;
+    size_t max_queued = 0;
+    unsigned max_queue_wait_ms = 500;
+    std::string log_level = "info";
+    size_t log_queue_size = 8192;
+    unsigned log_flush_ms = 100;
+    size_t log_flush_bytes = 64 << 10;
+    std::string log_overflow = "drop";
+    std::string stats_path = "/__stats";
+    std::string backend = "epoll";
+    std::string affinity = "none";
+    std::string cpus;
+    std::string irq_interface;
+    std::string max_age; // e.g., "css=86400,js=86400,jpg=604800,*=60"
+    std::string index = "off"; // docroot index: "off", "on" or "open" (indexed files are kept open)
+    std::string given; // options present on the command line
 
     static Opts &Instance();
-    void Reset(int argc, char **argv);
+    bool Reset(int argc, char **argv); // 'false' if some value is malformed
+    bool MaxAge(std::map<std::string, unsigned> &res) const; // parses 'max_age', 'false' if it is malformed
+
+    static void Usage(const char *prog);
 private:
+    template <typename T>
+    static T Number(const char *s, T min = 0, T max = std::numeric_limits<T>::max()); // throws 'std::logic_error' if malformed or out of range
+    static const char *Name(const char *s, std::initializer_list<const char *> names); // throws 'std::invalid_argument' unless 's' is one of 'names'
+
     Opts() = default;
     Opts(const Opts &) = delete;
     Opts &operator =(const Opts &) = delete;
@@ -24,17 +66,100 @@ Opts &Opts::Instance()
     return opts;
 }
 
-void Opts::Reset(int argc, char **argv)
+bool Opts::Reset(int argc, char **argv)
+{
+    try {
+        int opt;
+        while ((opt = getopt(argc, argv, "h:p:d:l:c:z:k:m:r:w:v:L:f:F:o:s:b:a:i:q:Q:W:n:N:A:C:I:")) != -1) {
+            given += char(opt);
+            switch (opt) {
+            case 'h': ip = optarg;                                     break;
+            case 'p': port = Number<unsigned short>(optarg, 1);        break;
+            case 'd': dir = optarg;                                    break;
+            case 'l': log = optarg;                                    break;
+            case 'c': cache_bytes = Number<size_t>(optarg);            break;
+            case 'z': compressed_cache_bytes = Number<size_t>(optarg); break;
+            case 'k': chunk_bytes = Number<size_t>(optarg, 4096);      break;
+            case 'm': mode = Name(optarg, { "pool", "reactors" });     break;
+            case 'r': reactors = Number<unsigned>(optarg, 1);          break;
+            case 'w': scheduler = Name(optarg, { "rr", "steal", "adaptive" }); break;
+            case 'v': log_level = Name(optarg, { "trace", "debug", "info", "warn", "error", "off" }); break;
+            case 'L': log_queue_size = Number<size_t>(optarg, 2);      break;
+            case 'f': log_flush_ms = Number<unsigned>(optarg);         break;
+            case 'F': log_flush_bytes = Number<size_t>(optarg);        break;
+            case 'o': log_overflow = Name(optarg, { "drop", "block" }); break;
+            case 's': stats_path = optarg;                             break;
+            case 'b': backend = Name(optarg, { "epoll", "uring" });    break;
+            case 'a': max_age = optarg;                                break;
+            case 'i': index = Name(optarg, { "on", "off", "open" });   break;
+            case 'q': max_queued_per_worker = Number<size_t>(optarg);  break;
+            case 'Q': max_queued = Number<size_t>(optarg);             break;
+            case 'W': max_queue_wait_ms = Number<unsigned>(optarg);    break;
+            case 'n': min_workers = Number<unsigned>(optarg);          break;
+            case 'N': max_workers = Number<unsigned>(optarg);          break;
+            case 'A': affinity = Name(optarg, { "none", "numa" });     break;
+            case 'C': cpus = optarg;                                   break;
+            case 'I': irq_interface = optarg;                          break;
+            default:  return false; // unknown option or missing value
+            }
+        }
+    } catch (const std::logic_error &) { // 'Number' and 'Name' throw 'std::invalid_argument' or 'std::out_of_range'
+        return false;
+    }
+    if ((backend == "uring") && ((given.find_first_of("wnNqQW") != std::string::npos) || ((given.find('m') != std::string::npos) && (mode == "pool")))) {
+        return false; // io_uring event loops perform requests themselves, there is no worker pool to apply these to
+    }
+    return (port != 0) && (optind == argc); // no positional arguments are taken
+}
+
+template <typename T>
+T Opts::Number(const char *s, T min, T max)
+{
+    if ((*s < '0') || (*s > '9')) { // 'std::stoull' would skip spaces and take signs, so that "-1" wraps around
+        throw std::invalid_argument(s);
+    }
+    size_t len = 0;
+    const unsigned long long n = std::stoull(s, &len);
+    if (s[len] || (n < min) || (n > max)) {
+        throw std::out_of_range(s);
+    }
+    return T(n);
+}
+
+const char *Opts::Name(const char *s, std::initializer_list<const char *> names)
 {
-    int opt;
-    while ((opt = getopt(argc, argv, "h:p:d:l:")) != -1) {
-        switch (opt) {
-        case 'h': ip = optarg;              break;
-        case 'p': port = std::stoi(optarg); break;
-        case 'd': dir = optarg;             break;
-        case 'l': log = optarg;             break;
+    for (const char *name : names) {
+        if (strcmp(s, name) == 0) {
+            return s;
         }
     }
+    throw std::invalid_argument(s);
+}
+
+bool Opts::MaxAge(std::map<std::string, unsigned> &res) const
+{
+    std::istringstream items(max_age);
+    for (std::string item; std::getline(items, item, ','); ) {
+        const auto eq = item.find('=');
+        if ((eq == std::string::npos) || (eq == 0) || (eq + 1 == item.size())) {
+            return false;
+        }
+        char *end = nullptr;
+        const unsigned long sec = strtoul(item.c_str() + eq + 1, &end, 10);
+        if ((*end != '\0') || (item[eq + 1] == '-') || (sec > 0xffffffffUL)) {
+            return false;
+        }
+        res[item.substr(0, eq)] = unsigned(sec);
+    }
+    return true;
+}
+
+void Opts::Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s -h ip -p port -d dir -l log [-c cache_bytes] [-z compressed_cache_bytes] [-k chunk_bytes] [-m pool|reactors] [-r reactors] "
+                    "[-w rr|steal|adaptive] [-v trace|debug|info|warn|error|off] [-L log_queue_size] [-f log_flush_ms] [-F log_flush_bytes] [-o drop|block] [-s stats_path] "
+                    "[-b epoll|uring] [-a max_age] [-i on|off|open] [-q max_queued_per_worker] [-Q max_queued] [-W max_queue_wait_ms] [-n min_workers] "
+                    "[-N max_workers] [-A none|numa] [-C cpus] [-I irq_interface]\n", prog);
 }
 
 #endif
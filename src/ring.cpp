@@ -0,0 +1,260 @@
+#include "ring.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace IO {
+
+namespace {
+
+int Setup(unsigned entries, io_uring_params &p)
+{
+    return syscall(__NR_io_uring_setup, entries, &p);
+}
+
+int Enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+int Register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// ring indices are shared with the kernel, which reads tail of submissions and head of completions (and writes the other two)
+unsigned LoadAcquire(const unsigned *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(unsigned *p, unsigned v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+}
+
+struct Ring::Impl
+{
+    int fd;
+    io_uring_params params;
+
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    io_uring_sqe *sqes;
+    size_t sqes_len;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sqe_tail; // entries up to this one are prepared but not yet made visible to the kernel
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe *cqes;
+
+    explicit Impl(unsigned entries);
+    ~Impl();
+
+    bool Map();
+    unsigned Flush();
+};
+
+Ring::Impl::Impl(unsigned entries)
+    : fd(-1)
+    , sq_ptr(MAP_FAILED)
+    , sq_len(0)
+    , cq_ptr(MAP_FAILED)
+    , cq_len(0)
+    , sqes(static_cast<io_uring_sqe *>(MAP_FAILED))
+    , sqes_len(0)
+    , sqe_tail(0)
+{
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_COOP_TASKRUN; // no need to interrupt the event loop thread, it enters the kernel every iteration anyway
+    fd = Setup(entries, params);
+    if ((fd < 0) && (errno == EINVAL)) {
+        memset(&params, 0, sizeof(params));
+        fd = Setup(entries, params);
+    }
+    if ((fd >= 0) && !Map()) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+Ring::Impl::~Impl()
+{
+    if (sqes != MAP_FAILED) {
+        munmap(sqes, sqes_len);
+    }
+    if ((cq_ptr != MAP_FAILED) && (cq_ptr != sq_ptr)) {
+        munmap(cq_ptr, cq_len);
+    }
+    if (sq_ptr != MAP_FAILED) {
+        munmap(sq_ptr, sq_len);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool Ring::Impl::Map()
+{
+    sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        sq_len = cq_len = std::max(sq_len, cq_len);
+    }
+    sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) {
+        return false;
+    }
+    cq_ptr = single ? sq_ptr : mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED) {
+        return false;
+    }
+    sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+
+    char *sq = static_cast<char *>(sq_ptr);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_entries = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+    unsigned *array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries; ++i) { // entries are handed out in ring order, so index array is identity once and for all
+        array[i] = i;
+    }
+    sqe_tail = *sq_tail;
+
+    char *cq = static_cast<char *>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+}
+
+unsigned Ring::Impl::Flush()
+{
+    StoreRelease(sq_tail, sqe_tail);
+    return sqe_tail - LoadAcquire(sq_head); // including entries left over by previous (interrupted) submission
+}
+
+//
+
+Ring::Ring(unsigned entries)
+    : pimpl(new Impl(entries))
+{
+}
+
+Ring::~Ring() = default;
+
+bool Ring::Supported()
+{
+    Ring ring(4);
+    if (!ring) {
+        return false;
+    }
+    const auto &p = ring.pimpl->params;
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+        return false;
+    }
+    const unsigned c_ops = 256;
+    std::vector<char> buf(sizeof(io_uring_probe) + c_ops * sizeof(io_uring_probe_op), 0);
+    auto probe = reinterpret_cast<io_uring_probe *>(buf.data());
+    if (Register(ring.pimpl->fd, IORING_REGISTER_PROBE, probe, c_ops) < 0) {
+        return false;
+    }
+    // multishot accept and cancellation by fd have no probe of their own, they come with the same kernel (5.19) as IORING_OP_SOCKET
+    for (auto op : { IORING_OP_ACCEPT, IORING_OP_READ_FIXED, IORING_OP_READ, IORING_OP_SEND, IORING_OP_SENDMSG, IORING_OP_ASYNC_CANCEL, IORING_OP_SOCKET }) {
+        if ((op > probe->last_op) || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Ring::RegisterBuffers(const iovec *iov, unsigned n)
+{
+    return Register(pimpl->fd, IORING_REGISTER_BUFFERS, iov, n) == 0;
+}
+
+bool Ring::Reserve(unsigned n)
+{
+    if (pimpl->sqe_tail - LoadAcquire(pimpl->sq_head) + n > pimpl->sq_entries) {
+        return Submit(0, -1) && (pimpl->sqe_tail - LoadAcquire(pimpl->sq_head) + n <= pimpl->sq_entries);
+    }
+    return true;
+}
+
+io_uring_sqe *Ring::Sqe()
+{
+    if (!Reserve(1)) {
+        return nullptr;
+    }
+    io_uring_sqe *sqe = &pimpl->sqes[pimpl->sqe_tail & pimpl->sq_mask];
+    ++pimpl->sqe_tail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+bool Ring::Submit(unsigned wait_nr, int timeout_ms)
+{
+    const unsigned to_submit = pimpl->Flush();
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if (wait_nr > 0) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+    }
+    if ((to_submit == 0) && (wait_nr == 0)) {
+        return true;
+    }
+    if (Enter(pimpl->fd, to_submit, wait_nr, flags, (wait_nr > 0) ? &arg : nullptr, (wait_nr > 0) ? sizeof(arg) : 0) < 0) {
+        return (errno == ETIME) || (errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY);
+    }
+    return true;
+}
+
+bool Ring::Next(io_uring_cqe &cqe)
+{
+    const unsigned head = *pimpl->cq_head;
+    if (head == LoadAcquire(pimpl->cq_tail)) {
+        return false;
+    }
+    cqe = pimpl->cqes[head & pimpl->cq_mask];
+    StoreRelease(pimpl->cq_head, head + 1);
+    return true;
+}
+
+Ring::operator bool() const
+{
+    return pimpl->fd >= 0;
+}
+
+}
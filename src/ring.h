@@ -0,0 +1,44 @@
+#ifndef RING_H
+#define RING_H
+
+#include <memory>
+
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+namespace IO {
+
+// io_uring instance driven through raw system calls: submission and completion queues are mapped into user space,
+// entries prepared with 'Sqe' are handed to the kernel all at once by 'Submit'
+class Ring
+{
+public:
+    explicit Ring(unsigned entries);
+    ~Ring();
+
+    Ring(const Ring &) = delete;
+    Ring &operator =(const Ring &) = delete;
+
+    // whether running kernel provides everything event loop relies on (multishot accept, fixed buffers, waiting with timeout, cancellation by fd)
+    static bool Supported();
+
+    bool RegisterBuffers(const iovec *iov, unsigned n);
+
+    bool Reserve(unsigned n); // makes sure 'n' entries could be taken (e.g., linked ones), submitting pending entries if needed
+    io_uring_sqe *Sqe();      // cleared submission entry, pending entries are submitted first if the queue is full; 'nullptr' on failure
+
+    // submits prepared entries with single system call and waits until at least 'wait_nr' completions are available
+    // or 'timeout_ms' elapses (negative means no timeout), returns 'false' on failure other than timeout or interruption
+    bool Submit(unsigned wait_nr, int timeout_ms);
+
+    bool Next(io_uring_cqe &cqe); // takes next available completion
+
+    operator bool() const;
+private:
+    struct Impl;
+    std::unique_ptr<Impl> pimpl;
+};
+
+}
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include "event_count.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace Concurrent {
+
+// lock-free alternatives to 'MessageQueue' with the same 'Send'/'Receive'/'StopReceiving' contract, built on a ring buffer
+// allocated once on construction (max size is rounded up to a power of two), so no allocation happens while messages flow;
+// receiver spins briefly on empty queue and only then parks on a futex, sender issues a syscall only if receiver is parked
+
+const size_t c_cache_line = 64;
+
+inline size_t RingCapacity(size_t max_size)
+{
+    size_t cap = 2;
+    while (cap < max_size) {
+        cap <<= 1;
+    }
+    return cap;
+}
+
+// single producer, single consumer (e.g., event loop thread assigning tasks to a worker thread)
+template <typename T>
+class SpscQueue
+{
+public:
+    struct ReceivingStopped
+    {
+    };
+
+    explicit SpscQueue(size_t max_size = 1024);
+
+    size_t Size() const;
+    size_t MaxSize() const;
+
+    bool Send(T &&msg); // 'msg' is left intact if queue is full
+    T Receive();
+
+    void StopReceiving();
+private:
+    bool TryReceive(T &msg);
+
+    std::vector<T> slots;
+    size_t mask;
+    EventCount ec;
+    std::atomic<bool> stop_receiving;
+
+    // consumer's and producer's fields are kept on separate cache lines
+    char pad0[c_cache_line];
+    std::atomic<size_t> head; // next slot to receive from, written by consumer only
+    size_t tail_cache;        // consumer's last seen 'tail'
+    char pad1[c_cache_line];
+    std::atomic<size_t> tail; // next slot to send to, written by producer only
+    size_t head_cache;        // producer's last seen 'head'
+    char pad2[c_cache_line];
+};
+
+template <typename T>
+SpscQueue<T>::SpscQueue(size_t max_size)
+    : slots(RingCapacity(max_size))
+    , mask(slots.size() - 1)
+    , stop_receiving(false)
+    , head(0)
+    , tail_cache(0)
+    , tail(0)
+    , head_cache(0)
+{
+}
+
+template <typename T>
+size_t SpscQueue<T>::Size() const
+{
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+}
+
+template <typename T>
+size_t SpscQueue<T>::MaxSize() const
+{
+    return slots.size();
+}
+
+template <typename T>
+bool SpscQueue<T>::Send(T &&msg)
+{
+    const size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head_cache == slots.size()) {
+        head_cache = head.load(std::memory_order_acquire);
+        if (t - head_cache == slots.size()) {
+            return false;
+        }
+    }
+    slots[t & mask] = std::move(msg);
+    tail.store(t + 1, std::memory_order_release);
+    ec.Notify();
+    return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::TryReceive(T &msg)
+{
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail_cache) {
+        tail_cache = tail.load(std::memory_order_acquire);
+        if (h == tail_cache) {
+            return false;
+        }
+    }
+    msg = std::move(slots[h & mask]);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+T SpscQueue<T>::Receive()
+{
+    T msg;
+    const int spins = std::max(1, SpinLimit()); // always look at the queue at least once before parking
+    while (true) {
+        for (int i = 0; i < spins; ++i) {
+            if (stop_receiving.load(std::memory_order_acquire)) {
+                throw ReceivingStopped();
+            }
+            if (TryReceive(msg)) {
+                return msg;
+            }
+            CpuRelax();
+        }
+        const auto key = ec.PrepareWait();
+        if (!stop_receiving.load(std::memory_order_seq_cst) && (tail.load(std::memory_order_seq_cst) == head.load(std::memory_order_relaxed))) {
+            ec.Wait(key);
+        }
+    }
+}
+
+template <typename T>
+void SpscQueue<T>::StopReceiving()
+{
+    stop_receiving.store(true, std::memory_order_seq_cst);
+    ec.Notify();
+}
+
+// multiple producers, single consumer (e.g., many threads feeding one background thread),
+// slots carry sequence numbers telling whether they are free for the producer which claimed them or ready for the consumer
+template <typename T>
+class MpscQueue
+{
+public:
+    struct ReceivingStopped
+    {
+    };
+
+    explicit MpscQueue(size_t max_size = 1024);
+
+    size_t Size() const;
+    size_t MaxSize() const;
+
+    bool Send(T &&msg); // 'msg' is left intact if queue is full
+    bool TryReceive(T &msg);
+    T Receive();
+
+    void StopReceiving();
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        T msg;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t capacity;
+    size_t mask;
+    EventCount ec;
+    std::atomic<bool> stop_receiving;
+
+    char pad0[c_cache_line];
+    std::atomic<size_t> head; // written by consumer only
+    char pad1[c_cache_line];
+    std::atomic<size_t> tail; // claimed by producers with CAS
+    char pad2[c_cache_line];
+};
+
+template <typename T>
+MpscQueue<T>::MpscQueue(size_t max_size)
+    : slots(new Slot[RingCapacity(max_size)])
+    , capacity(RingCapacity(max_size))
+    , mask(capacity - 1)
+    , stop_receiving(false)
+    , head(0)
+    , tail(0)
+{
+    for (size_t i = 0; i < capacity; ++i) {
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+size_t MpscQueue<T>::Size() const
+{
+    const size_t t = tail.load(std::memory_order_acquire);
+    const size_t h = head.load(std::memory_order_acquire);
+    return (t > h) ? (t - h) : 0;
+}
+
+template <typename T>
+size_t MpscQueue<T>::MaxSize() const
+{
+    return capacity;
+}
+
+template <typename T>
+bool MpscQueue<T>::Send(T &&msg)
+{
+    size_t t = tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+        slot = &slots[t & mask];
+        const auto diff = static_cast<std::ptrdiff_t>(slot->seq.load(std::memory_order_acquire) - t);
+        if (diff == 0) { // slot is free, claim it
+            if (tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) { // slot still holds message sent one lap ago
+            return false;
+        } else { // another producer claimed it
+            t = tail.load(std::memory_order_relaxed);
+        }
+    }
+    slot->msg = std::move(msg);
+    slot->seq.store(t + 1, std::memory_order_release);
+    ec.Notify();
+    return true;
+}
+
+template <typename T>
+bool MpscQueue<T>::TryReceive(T &msg)
+{
+    const size_t h = head.load(std::memory_order_relaxed);
+    Slot &slot = slots[h & mask];
+    if (slot.seq.load(std::memory_order_acquire) != h + 1) { // empty, or producer which claimed the slot has not filled it yet
+        return false;
+    }
+    msg = std::move(slot.msg);
+    slot.seq.store(h + capacity, std::memory_order_release);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+T MpscQueue<T>::Receive()
+{
+    T msg;
+    const int spins = std::max(1, SpinLimit()); // always look at the queue at least once before parking
+    while (true) {
+        for (int i = 0; i < spins; ++i) {
+            if (stop_receiving.load(std::memory_order_acquire)) {
+                throw ReceivingStopped();
+            }
+            if (TryReceive(msg)) {
+                return msg;
+            }
+            CpuRelax();
+        }
+        const auto key = ec.PrepareWait();
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (!stop_receiving.load(std::memory_order_seq_cst) && (slots[h & mask].seq.load(std::memory_order_seq_cst) != h + 1)) {
+            ec.Wait(key);
+        }
+    }
+}
+
+template <typename T>
+void MpscQueue<T>::StopReceiving()
+{
+    stop_receiving.store(true, std::memory_order_seq_cst);
+    ec.Notify();
+}
+
+}
+
+#endif
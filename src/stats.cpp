@@ -0,0 +1,315 @@
+#include "stats.h"
+
+#include <atomic>
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+namespace Http {
+
+namespace {
+
+const size_t c_shards = 32;
+
+const int c_min_status = 100;
+const int c_max_status = 599;
+
+// HDR-style log-linear buckets of nanoseconds: values below 4 get a bucket each, every further power of two
+// is split into 4 equal sub-buckets (at most 25% relative error), values above 2^40 ns (~18 min) are clamped
+const int c_sub_bits = 2;
+const int c_sub_buckets = 1 << c_sub_bits;
+const int c_max_exp = 40;
+const int c_buckets = (c_max_exp - c_sub_bits + 1) * c_sub_buckets;
+const uint64_t c_min_exported_ns = 1000; // finer buckets are folded into the first exported one
+
+int BucketOf(uint64_t ns)
+{
+    ns = std::min(ns, (uint64_t(1) << c_max_exp) - 1);
+    if (ns < c_sub_buckets) {
+        return int(ns);
+    }
+    const int e = 63 - __builtin_clzll(ns);
+    return (e - c_sub_bits + 1) * c_sub_buckets + int((ns >> (e - c_sub_bits)) & (c_sub_buckets - 1));
+}
+
+uint64_t BucketUpperBound(int b) // inclusive
+{
+    if (b < c_sub_buckets) {
+        return b;
+    }
+    const int e = b / c_sub_buckets + c_sub_bits - 1;
+    const uint64_t sub = b % c_sub_buckets;
+    return ((c_sub_buckets + sub + 1) << (e - c_sub_bits)) - 1;
+}
+
+const char *c_histogram_names[] = {
+    "http_request_parse_seconds",
+    "http_request_queue_wait_seconds",
+    "http_request_service_seconds"
+};
+
+const char *c_histogram_help[] = {
+    "Time spent parsing request line and headers.",
+    "Time from dispatching request by the event loop to start of its processing.",
+    "Time spent processing request until response is queued."
+};
+
+thread_local size_t current_shard = size_t(-1);
+std::atomic<size_t> next_shard(0);
+
+void Append(std::string &out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void Append(std::string &out, const char *fmt, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    const int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    out.append(buf, std::min(size_t(std::max(n, 0)), sizeof(buf) - 1));
+}
+
+}
+
+struct Stats::Shard
+{
+    struct Hist
+    {
+        std::atomic<uint64_t> buckets[c_buckets];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum_ns;
+    };
+
+    std::atomic<uint64_t> accepted;
+    std::atomic<uint64_t> requests;
+    std::atomic<uint64_t> reused;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> shed[c_shed_actions];
+    std::atomic<uint64_t> accept_pauses;
+    std::atomic<int64_t> open;
+    std::atomic<int64_t> busy;
+    std::atomic<uint64_t> responses[c_max_status - c_min_status + 1];
+    Hist hists[c_histograms];
+    char pad[64]; // keeps the next shard's hot counters off this shard's last cache line
+
+    Shard();
+};
+
+Stats::Shard::Shard()
+    : accepted(0)
+    , requests(0)
+    , reused(0)
+    , bytes(0)
+    , accept_pauses(0)
+    , open(0)
+    , busy(0)
+{
+    for (auto &r : responses) {
+        r.store(0, std::memory_order_relaxed);
+    }
+    for (auto &r : shed) {
+        r.store(0, std::memory_order_relaxed);
+    }
+    for (auto &h : hists) {
+        for (auto &b : h.buckets) {
+            b.store(0, std::memory_order_relaxed);
+        }
+        h.count.store(0, std::memory_order_relaxed);
+        h.sum_ns.store(0, std::memory_order_relaxed);
+    }
+}
+
+//
+
+Stats::Stats()
+    : shards(new Shard[c_shards])
+{
+}
+
+Stats::~Stats() = default;
+
+Stats::Shard &Stats::Local()
+{
+    if (current_shard == size_t(-1)) {
+        current_shard = next_shard++ % c_shards;
+    }
+    return shards[current_shard];
+}
+
+void Stats::CountAccepted()
+{
+    Local().accepted.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Stats::CountRequest(bool reused)
+{
+    auto &s = Local();
+    s.requests.fetch_add(1, std::memory_order_relaxed);
+    if (reused) {
+        s.reused.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Stats::CountResponse(int status, size_t bytes)
+{
+    auto &s = Local();
+    if ((status >= c_min_status) && (status <= c_max_status)) {
+        s.responses[status - c_min_status].fetch_add(1, std::memory_order_relaxed);
+    }
+    s.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Stats::CountShed(ShedAction action)
+{
+    Local().shed[action].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Stats::CountAcceptPause()
+{
+    Local().accept_pauses.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Stats::Record(Histogram h, std::chrono::nanoseconds d)
+{
+    const uint64_t ns = std::max<int64_t>(0, d.count());
+    auto &hist = Local().hists[h];
+    hist.buckets[BucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    hist.count.fetch_add(1, std::memory_order_relaxed);
+    hist.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+void Stats::AddOpenConnections(int delta)
+{
+    Local().open.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void Stats::AddBusyConnections(int delta)
+{
+    Local().busy.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void Stats::SetQueueDepths(std::function<std::vector<size_t>()> f)
+{
+    queue_depths = std::move(f);
+}
+
+void Stats::SetPoolSizing(std::function<PoolSizing()> f)
+{
+    pool_sizing = std::move(f);
+}
+
+std::string Stats::Render() const
+{
+    uint64_t accepted = 0, requests = 0, reused = 0, bytes = 0, shed[c_shed_actions] = {0, 0, 0}, accept_pauses = 0;
+    int64_t open = 0, busy = 0;
+    std::vector<uint64_t> responses(c_max_status - c_min_status + 1, 0);
+    std::vector<std::vector<uint64_t>> buckets(c_histograms, std::vector<uint64_t>(c_buckets, 0));
+    std::vector<uint64_t> counts(c_histograms, 0), sums(c_histograms, 0);
+
+    for (size_t i = 0; i < c_shards; ++i) {
+        const auto &s = shards[i];
+        accepted += s.accepted.load(std::memory_order_relaxed);
+        requests += s.requests.load(std::memory_order_relaxed);
+        reused += s.reused.load(std::memory_order_relaxed);
+        bytes += s.bytes.load(std::memory_order_relaxed);
+        for (int k = 0; k < c_shed_actions; ++k) {
+            shed[k] += s.shed[k].load(std::memory_order_relaxed);
+        }
+        accept_pauses += s.accept_pauses.load(std::memory_order_relaxed);
+        open += s.open.load(std::memory_order_relaxed);
+        busy += s.busy.load(std::memory_order_relaxed);
+        for (size_t k = 0; k < responses.size(); ++k) {
+            responses[k] += s.responses[k].load(std::memory_order_relaxed);
+        }
+        for (int h = 0; h < c_histograms; ++h) {
+            for (int b = 0; b < c_buckets; ++b) {
+                buckets[h][b] += s.hists[h].buckets[b].load(std::memory_order_relaxed);
+            }
+            counts[h] += s.hists[h].count.load(std::memory_order_relaxed);
+            sums[h] += s.hists[h].sum_ns.load(std::memory_order_relaxed);
+        }
+    }
+    open = std::max<int64_t>(open, 0); // shards are read one by one, so gauges could be momentarily skewed
+    busy = std::min(std::max<int64_t>(busy, 0), open);
+
+    std::string out;
+    out.reserve(32 << 10);
+
+    out += "# HELP http_connections_accepted_total Connections accepted.\n# TYPE http_connections_accepted_total counter\n";
+    Append(out, "http_connections_accepted_total %llu\n", (unsigned long long)accepted);
+
+    out += "# HELP http_connections Open connections by state (busy ones have responses due).\n# TYPE http_connections gauge\n";
+    Append(out, "http_connections{state=\"busy\"} %lld\n", (long long)busy);
+    Append(out, "http_connections{state=\"idle\"} %lld\n", (long long)(open - busy));
+
+    out += "# HELP http_requests_total Requests received.\n# TYPE http_requests_total counter\n";
+    Append(out, "http_requests_total %llu\n", (unsigned long long)requests);
+
+    out += "# HELP http_keepalive_reused_requests_total Requests received on already used connections.\n# TYPE http_keepalive_reused_requests_total counter\n";
+    Append(out, "http_keepalive_reused_requests_total %llu\n", (unsigned long long)reused);
+
+    out += "# HELP http_keepalive_reuse_ratio Share of requests received on already used connections.\n# TYPE http_keepalive_reuse_ratio gauge\n";
+    Append(out, "http_keepalive_reuse_ratio %g\n", requests ? double(reused) / requests : 0.0);
+
+    out += "# HELP http_responses_total Responses by status code.\n# TYPE http_responses_total counter\n";
+    for (size_t k = 0; k < responses.size(); ++k) {
+        if (responses[k]) {
+            Append(out, "http_responses_total{code=\"%d\"} %llu\n", int(k) + c_min_status, (unsigned long long)responses[k]);
+        }
+    }
+
+    out += "# HELP http_response_bytes_total Bytes of responses (headers and bodies) queued for sending.\n# TYPE http_response_bytes_total counter\n";
+    Append(out, "http_response_bytes_total %llu\n", (unsigned long long)bytes);
+
+    out += "# HELP http_requests_shed_total Requests rejected due to overload (answered with 503, dropped with their connection or refused HTTP/2 streams).\n# TYPE http_requests_shed_total counter\n";
+    Append(out, "http_requests_shed_total{action=\"answered\"} %llu\n", (unsigned long long)shed[Answered]);
+    Append(out, "http_requests_shed_total{action=\"dropped\"} %llu\n", (unsigned long long)shed[Dropped]);
+    Append(out, "http_requests_shed_total{action=\"refused\"} %llu\n", (unsigned long long)shed[Refused]);
+
+    out += "# HELP http_accept_pauses_total Times accepting of new connections was paused due to long queue wait.\n# TYPE http_accept_pauses_total counter\n";
+    Append(out, "http_accept_pauses_total %llu\n", (unsigned long long)accept_pauses);
+
+    if (queue_depths) {
+        out += "# HELP http_worker_queue_depth Tasks waiting for each worker.\n# TYPE http_worker_queue_depth gauge\n";
+        const auto depths = queue_depths();
+        for (size_t i = 0; i < depths.size(); ++i) {
+            Append(out, "http_worker_queue_depth{worker=\"%zu\"} %zu\n", i, depths[i]);
+        }
+    }
+
+    if (pool_sizing) {
+        const auto p = pool_sizing();
+        out += "# HELP http_worker_threads Worker threads of adaptively sized pool.\n# TYPE http_worker_threads gauge\n";
+        Append(out, "http_worker_threads{state=\"running\"} %u\n", p.threads);
+        Append(out, "http_worker_threads{state=\"target\"} %u\n", p.target);
+
+        out += "# HELP http_worker_pool_resizes_total Sizing decisions of adaptively sized pool.\n# TYPE http_worker_pool_resizes_total counter\n";
+        Append(out, "http_worker_pool_resizes_total{direction=\"grow\"} %llu\n", (unsigned long long)p.grown);
+        Append(out, "http_worker_pool_resizes_total{direction=\"shrink\"} %llu\n", (unsigned long long)p.shrunk);
+
+        out += "# HELP http_worker_pool_arrival_rate Tasks handed to the pool per second, as of the last sizing interval.\n# TYPE http_worker_pool_arrival_rate gauge\n";
+        Append(out, "http_worker_pool_arrival_rate %g\n", p.arrival_rate);
+
+        out += "# HELP http_worker_pool_task_seconds Mean wait and service time of tasks, as of the last sizing interval.\n# TYPE http_worker_pool_task_seconds gauge\n";
+        Append(out, "http_worker_pool_task_seconds{phase=\"wait\"} %.9f\n", p.wait_sec);
+        Append(out, "http_worker_pool_task_seconds{phase=\"service\"} %.9f\n", p.service_sec);
+    }
+
+    for (int h = 0; h < c_histograms; ++h) {
+        Append(out, "# HELP %s %s\n# TYPE %s histogram\n", c_histogram_names[h], c_histogram_help[h], c_histogram_names[h]);
+        uint64_t cumulative = 0;
+        for (int b = 0; b < c_buckets; ++b) {
+            cumulative += buckets[h][b];
+            const uint64_t upper = BucketUpperBound(b);
+            if (upper >= c_min_exported_ns) {
+                Append(out, "%s_bucket{le=\"%.9g\"} %llu\n", c_histogram_names[h], upper * 1e-9, (unsigned long long)cumulative);
+            }
+        }
+        Append(out, "%s_bucket{le=\"+Inf\"} %llu\n", c_histogram_names[h], (unsigned long long)counts[h]);
+        Append(out, "%s_sum %.9f\n", c_histogram_names[h], sums[h] * 1e-9);
+        Append(out, "%s_count %llu\n", c_histogram_names[h], (unsigned long long)counts[h]);
+    }
+    return out;
+}
+
+}
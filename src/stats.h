@@ -0,0 +1,76 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+namespace Http {
+
+// server metrics rendered in Prometheus text format; every thread updates its own shard with relaxed atomics
+// (no locks, no shared cache lines on the hot path), shards are only summed up when metrics are collected
+class Stats
+{
+public:
+    enum Histogram
+    {
+        ParseTime,   // parsing of request line and headers (summed over all reads request arrived in)
+        QueueWait,   // from dispatching request by the event loop to start of its processing
+        ServiceTime, // processing of request (until response is queued for sending)
+        c_histograms
+    };
+
+    enum ShedAction // what happened to request rejected due to overload
+    {
+        Dropped,  // along with its connection
+        Answered, // with 503
+        Refused,  // HTTP/2 stream reset with REFUSED_STREAM, client may retry it
+        c_shed_actions
+    };
+
+    Stats();
+    ~Stats();
+
+    Stats(const Stats &) = delete;
+    Stats &operator =(const Stats &) = delete;
+
+    void CountAccepted();
+    void CountRequest(bool reused); // 'reused' means request is not the first one on its connection
+    void CountResponse(int status, size_t bytes);
+    void CountShed(ShedAction action);
+    void CountAcceptPause();       // accepting of new connections is paused due to long queue wait
+    void Record(Histogram h, std::chrono::nanoseconds d);
+
+    void AddOpenConnections(int delta);
+    void AddBusyConnections(int delta); // connections with responses due
+
+    struct PoolSizing
+    {
+        unsigned threads;
+        unsigned target;
+        uint64_t grown;
+        uint64_t shrunk;
+        double arrival_rate; // of tasks (or their batches), per second
+        double wait_sec;     // mean, during the last sizing interval
+        double service_sec;
+    };
+
+    void SetQueueDepths(std::function<std::vector<size_t>()> f); // reports tasks waiting for each worker
+    void SetPoolSizing(std::function<PoolSizing()> f);           // reports state of adaptively sized worker pool
+
+    std::string Render() const;
+private:
+    struct Shard;
+    Shard &Local();
+
+    std::unique_ptr<Shard[]> shards;
+    std::function<std::vector<size_t>()> queue_depths;
+    std::function<PoolSizing()> pool_sizing;
+};
+
+}
+
+#endif
@@ -0,0 +1,168 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+namespace IO {
+
+const TimerWheel::Id TimerWheel::c_none;
+
+TimerWheel::TimerWheel(std::chrono::milliseconds _tick, Clock::time_point now)
+    : tick(_tick)
+    , origin(now)
+    , now_tick(0)
+    , free_list(c_none)
+    , size(0)
+{
+    std::fill(heads, heads + c_levels * c_slots, c_none);
+    std::fill(occupied, occupied + c_levels, 0);
+}
+
+TimerWheel::Id TimerWheel::Schedule(Clock::time_point deadline, uint64_t data)
+{
+    Id id = free_list;
+    if (id != c_none) {
+        free_list = nodes[id].next;
+    } else {
+        id = nodes.size();
+        nodes.push_back(Node());
+    }
+    nodes[id].expiry = TickOf(deadline, true);
+    nodes[id].data = data;
+    Link(id, now_tick + 1);
+    ++size;
+    return id;
+}
+
+void TimerWheel::Reschedule(Id id, Clock::time_point deadline)
+{
+    if ((id == c_none) || (nodes[id].slot < 0)) {
+        return;
+    }
+    Unlink(id);
+    nodes[id].expiry = TickOf(deadline, true);
+    Link(id, now_tick + 1);
+}
+
+void TimerWheel::Cancel(Id id)
+{
+    if ((id == c_none) || (nodes[id].slot < 0)) {
+        return;
+    }
+    Unlink(id);
+    nodes[id].slot = -1;
+    nodes[id].next = free_list;
+    free_list = id;
+    --size;
+}
+
+size_t TimerWheel::Size() const
+{
+    return size;
+}
+
+void TimerWheel::Expire(Clock::time_point now, std::vector<uint64_t> &expired)
+{
+    const uint64_t target = TickOf(now, false);
+    while (now_tick < target) {
+        if (size == 0) { // nothing to cascade or expire on the way
+            now_tick = target;
+            break;
+        }
+        ++now_tick;
+        for (int level = 1; (level < c_levels) && ((now_tick & ((uint64_t(1) << (c_slot_bits * level)) - 1)) == 0); ++level) {
+            Cascade(level);
+        }
+        const int slot = now_tick & (c_slots - 1);
+        while (heads[slot] != c_none) {
+            const Id id = heads[slot];
+            expired.push_back(nodes[id].data);
+            Cancel(id);
+        }
+    }
+}
+
+int TimerWheel::TimeoutMs(Clock::time_point now) const
+{
+    if (size == 0) {
+        return -1;
+    }
+    uint64_t next = (now_tick | (c_slots - 1)) + 1; // next cascade, when upper levels could bring timers down to level 0
+    if (occupied[0]) {
+        const int start = (now_tick + 1) & (c_slots - 1);
+        const uint64_t rotated = (occupied[0] >> start) | ((start > 0) ? (occupied[0] << (c_slots - start)) : 0);
+        next = std::min(next, now_tick + 1 + __builtin_ctzll(rotated));
+    } else {
+        bool upper = false;
+        for (int level = 1; level < c_levels; ++level) {
+            upper = upper || occupied[level];
+        }
+        if (!upper) {
+            return -1;
+        }
+    }
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(origin + tick * next - now).count();
+    return (remaining > 0) ? int(remaining) : 0;
+}
+
+uint64_t TimerWheel::TickOf(Clock::time_point t, bool round_up) const
+{
+    if (t <= origin) {
+        return 0;
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(t - origin).count() + (round_up ? (tick.count() - 1) : 0);
+    return elapsed / tick.count();
+}
+
+void TimerWheel::Link(Id id, uint64_t earliest)
+{
+    auto &n = nodes[id];
+    const uint64_t expiry = std::max(n.expiry, earliest); // overdue timers fire as soon as possible
+    const uint64_t delta = expiry - now_tick;
+
+    int level = 0;
+    while ((level < c_levels - 1) && (delta >= (uint64_t(1) << (c_slot_bits * (level + 1))))) {
+        ++level;
+    }
+    const uint64_t capped = std::min(expiry, now_tick + (uint64_t(1) << (c_slot_bits * c_levels)) - 1);
+    const int idx = (capped >> (c_slot_bits * level)) & (c_slots - 1);
+
+    n.slot = level * c_slots + idx;
+    n.prev = c_none;
+    n.next = heads[n.slot];
+    if (n.next != c_none) {
+        nodes[n.next].prev = id;
+    }
+    heads[n.slot] = id;
+    occupied[level] |= uint64_t(1) << idx;
+}
+
+void TimerWheel::Unlink(Id id)
+{
+    auto &n = nodes[id];
+    if (n.prev != c_none) {
+        nodes[n.prev].next = n.next;
+    } else {
+        heads[n.slot] = n.next;
+        if (n.next == c_none) {
+            occupied[n.slot / c_slots] &= ~(uint64_t(1) << (n.slot % c_slots));
+        }
+    }
+    if (n.next != c_none) {
+        nodes[n.next].prev = n.prev;
+    }
+}
+
+void TimerWheel::Cascade(int level)
+{
+    const int slot = level * c_slots + ((now_tick >> (c_slot_bits * level)) & (c_slots - 1));
+    Id id = heads[slot];
+    heads[slot] = c_none;
+    occupied[level] &= ~(uint64_t(1) << (slot % c_slots));
+    while (id != c_none) { // timers due within the next lower level's span move down
+        const Id next = nodes[id].next;
+        Link(id, now_tick); // current tick's level 0 slot is yet to be expired
+        id = next;
+    }
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <chrono>
+#include <vector>
+#include <cstdint>
+
+namespace IO {
+
+// hierarchical timing wheel: scheduling, rescheduling and cancelling of a timer take constant time,
+// expired timers are collected in batches once per tick (i.e., timers fire up to one tick late, but never early)
+class TimerWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Id = int; // handle of scheduled timer
+
+    static const Id c_none = -1;
+
+    TimerWheel(std::chrono::milliseconds _tick, Clock::time_point now);
+
+    Id Schedule(Clock::time_point deadline, uint64_t data);
+    void Reschedule(Id id, Clock::time_point deadline);
+    void Cancel(Id id);
+
+    size_t Size() const;
+
+    // advances the wheel to 'now', appends data of expired timers to 'expired' (expired timers are cancelled)
+    void Expire(Clock::time_point now, std::vector<uint64_t> &expired);
+    // time until the wheel has to be advanced next time, -1 if there are no timers
+    int TimeoutMs(Clock::time_point now) const;
+private:
+    static const int c_levels = 4;
+    static const int c_slot_bits = 6;
+    static const int c_slots = 1 << c_slot_bits;
+
+    struct Node
+    {
+        Id prev;
+        Id next;
+        int slot; // index into 'heads', -1 if node is free
+        uint64_t expiry; // tick
+        uint64_t data;
+    };
+
+    uint64_t TickOf(Clock::time_point t, bool round_up) const;
+    void Link(Id id, uint64_t earliest);
+    void Unlink(Id id);
+    void Cascade(int level);
+
+    std::chrono::milliseconds tick;
+    Clock::time_point origin;
+    uint64_t now_tick;
+
+    std::vector<Node> nodes;
+    Id free_list;
+    size_t size;
+
+    Id heads[c_levels * c_slots];
+    uint64_t occupied[c_levels]; // bit per non-empty slot
+};
+
+}
+
+#endif
@@ -1,24 +1,45 @@
 #include "worker_pool.h"
-#include "message_queue.h"
+#include "ring_queue.h"
+#include "io.h"
 
 #include <thread>
+#include <deque>
+#include <limits>
+#include <cmath>
+#include <algorithm>
 
 namespace Concurrent {
 
+namespace {
+
+const size_t c_worker_queue_size = 4096;
+
+}
+
+// tasks are assigned by a single thread (event loop) only, so worker's queue needs no locking
 struct WorkerPool::Worker : IWorker
 {
-    MessageQueue<std::unique_ptr<ITask>> task_queue;
+    WorkerPool &pool;
+    SpscQueue<std::unique_ptr<ITask>> task_queue;
     std::thread thr;
 
     void Start();
     void Quit();
     void Wait();
 
+    explicit Worker(WorkerPool &_pool);
+
     bool AssignTask(std::unique_ptr<ITask> &&task) override;
 
     void Run();
 };
 
+WorkerPool::Worker::Worker(WorkerPool &_pool)
+    : pool(_pool)
+    , task_queue(_pool.limits.per_worker ? _pool.limits.per_worker : c_worker_queue_size)
+{
+}
+
 void WorkerPool::Worker::Start()
 {
     if (!thr.joinable()) {
@@ -40,16 +61,24 @@ void WorkerPool::Worker::Wait()
 
 bool WorkerPool::Worker::AssignTask(std::unique_ptr<ITask> &&task)
 {
-    return task_queue.Send(std::move(task));
+    if ((pool.limits.per_worker && (task_queue.Size() >= pool.limits.per_worker)) || !pool.Admit()) {
+        return false;
+    }
+    while (!task_queue.Send(std::move(task))) { // worker is far behind, hold back the sender (workers never wait for it, so no deadlock)
+        std::this_thread::yield();
+    }
+    return true;
 }
 
 void WorkerPool::Worker::Run()
 {
+    pool.InitThread();
     while (true) {
         try {
             auto task = task_queue.Receive();
+            pool.Started();
             task->Perform();
-        } catch (MessageQueue<std::unique_ptr<ITask>>::ReceivingStopped &) {
+        } catch (SpscQueue<std::unique_ptr<ITask>>::ReceivingStopped &) {
             break;
         }
     }
@@ -57,10 +86,18 @@ void WorkerPool::Worker::Run()
 
 //
 
-WorkerPool::WorkerPool(unsigned pool_size)
+WorkerPool::Limits::Limits(size_t _per_worker, size_t _total)
+    : per_worker(_per_worker)
+    , total(_total)
+{
+}
+
+WorkerPool::WorkerPool(unsigned pool_size, const Limits &_limits)
+    : limits(_limits)
+    , waiting(0)
 {
     for (unsigned i = 0; i < pool_size; ++i) {
-        workers.push_back(std::unique_ptr<Worker>(new Worker));
+        workers.push_back(std::unique_ptr<Worker>(new Worker(*this)));
     }
 }
 
@@ -91,20 +128,475 @@ void WorkerPool::Wait()
     }
 }
 
+std::vector<size_t> WorkerPool::QueueDepths() const
+{
+    std::vector<size_t> res;
+    for (auto &w : workers) {
+        res.push_back(w->task_queue.Size());
+    }
+    return res;
+}
+
+size_t WorkerPool::Waiting() const
+{
+    return waiting.load(std::memory_order_relaxed);
+}
+
+bool WorkerPool::Admit()
+{
+    if (waiting.fetch_add(1, std::memory_order_relaxed) >= (limits.total ? limits.total : std::numeric_limits<size_t>::max())) {
+        waiting.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void WorkerPool::Started()
+{
+    waiting.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void WorkerPool::Schedule(std::shared_ptr<Strand>)
+{
+}
+
+void WorkerPool::SetThreadInit(std::function<void()> f)
+{
+    thread_init = std::move(f);
+}
+
+void WorkerPool::InitThread() const
+{
+    if (thread_init) {
+        thread_init();
+    }
+}
+
 //
 
-RoundRobinWorkerPool::RoundRobinWorkerPool(unsigned pool_size)
-    : WorkerPool(pool_size)
+RoundRobinWorkerPool::RoundRobinWorkerPool(unsigned pool_size, const Limits &_limits)
+    : WorkerPool(pool_size, _limits)
     , next_worker(0)
 {
 }
 
-IWorker *RoundRobinWorkerPool::SubmitTask(std::unique_ptr<ITask> &&task)
+std::shared_ptr<IWorker> RoundRobinWorkerPool::SubmitTask(std::unique_ptr<ITask> &&task)
+{
+    for (size_t i = 0; i < workers.size(); ++i) {
+        auto w = workers[next_worker].get();
+        next_worker = (next_worker + 1) % workers.size();
+        if (w->AssignTask(std::move(task))) {
+            return std::shared_ptr<IWorker>(std::shared_ptr<IWorker>(), w); // non-owning, workers live as long as the pool
+        }
+        if (limits.total && (Waiting() >= limits.total)) { // no other worker would take it either
+            break;
+        }
+    }
+    return nullptr;
+}
+
+//
+
+namespace {
+
+const int c_strand_batch = 4; // strand with more tasks is put back (e.g., to the deque where it could be stolen) after performing this many
+
+thread_local size_t current_runner = size_t(-1);
+
+}
+
+struct WorkerPool::Strand : IWorker, std::enable_shared_from_this<Strand>
+{
+    WorkerPool *pool;
+    std::mutex mtx;
+    std::deque<std::unique_ptr<ITask>> tasks;
+    bool scheduled; // strand is either waiting to be run or being performed
+
+    explicit Strand(WorkerPool *_pool);
+
+    bool AssignTask(std::unique_ptr<ITask> &&task) override;
+
+    void Run();
+};
+
+struct WorkStealingWorkerPool::Runner
+{
+    std::mutex mtx;
+    std::deque<std::shared_ptr<Strand>> strands;
+    std::thread thr;
+};
+
+WorkerPool::Strand::Strand(WorkerPool *_pool)
+    : pool(_pool)
+    , scheduled(false)
+{
+}
+
+bool WorkerPool::Strand::AssignTask(std::unique_ptr<ITask> &&task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if ((pool->limits.per_worker && (tasks.size() >= pool->limits.per_worker)) || !pool->Admit()) {
+            return false;
+        }
+        tasks.push_back(std::move(task));
+        if (scheduled) {
+            return true;
+        }
+        scheduled = true;
+    }
+    pool->Schedule(shared_from_this());
+    return true;
+}
+
+void WorkerPool::Strand::Run()
+{
+    for (int i = 0; i < c_strand_batch; ++i) {
+        std::unique_ptr<ITask> task;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (tasks.empty()) {
+                scheduled = false;
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        pool->Started();
+        task->Perform();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (tasks.empty()) {
+            scheduled = false;
+            return;
+        }
+    }
+    pool->Schedule(shared_from_this()); // still scheduled, give other strands a chance
+}
+
+//
+
+WorkStealingWorkerPool::WorkStealingWorkerPool(unsigned pool_size, const Limits &_limits)
+    : WorkerPool(0, _limits)
+    , next_runner(0)
+    , queued(0)
+    , quit(false)
+{
+    for (unsigned i = 0; i < std::max(1u, pool_size); ++i) {
+        runners.push_back(std::unique_ptr<Runner>(new Runner));
+    }
+}
+
+WorkStealingWorkerPool::~WorkStealingWorkerPool()
+{
+    Quit();
+    Wait();
+}
+
+std::shared_ptr<IWorker> WorkStealingWorkerPool::SubmitTask(std::unique_ptr<ITask> &&task)
+{
+    std::shared_ptr<Strand> s(new Strand(this));
+    if (!s->AssignTask(std::move(task))) {
+        return nullptr;
+    }
+    return s;
+}
+
+void WorkStealingWorkerPool::Start()
+{
+    for (size_t i = 0; i < runners.size(); ++i) {
+        if (!runners[i]->thr.joinable()) {
+            runners[i]->thr = std::thread(&WorkStealingWorkerPool::Run, this, i);
+        }
+    }
+}
+
+void WorkStealingWorkerPool::Quit()
 {
-    auto w = workers[next_worker].get();
-    w->AssignTask(std::move(task));
-    next_worker = (next_worker + 1) % workers.size();
-    return w;
+    {
+        std::lock_guard<std::mutex> lock(park_mtx);
+        quit = true;
+    }
+    park_cv.notify_all();
+}
+
+void WorkStealingWorkerPool::Wait()
+{
+    for (auto &r : runners) {
+        if (r->thr.joinable()) {
+            r->thr.join();
+        }
+    }
+}
+
+std::vector<size_t> WorkStealingWorkerPool::QueueDepths() const
+{
+    std::vector<size_t> res;
+    for (auto &r : runners) {
+        size_t n = 0;
+        std::lock_guard<std::mutex> lock(r->mtx);
+        for (auto &s : r->strands) {
+            std::lock_guard<std::mutex> strand_lock(s->mtx);
+            n += s->tasks.size();
+        }
+        res.push_back(n);
+    }
+    return res;
+}
+
+void WorkStealingWorkerPool::Schedule(std::shared_ptr<Strand> s)
+{
+    // runner's own strands go to its own deque, others (e.g., from the event loop) are spread round-robin
+    const size_t target = (current_runner < runners.size()) ? current_runner : (next_runner++ % runners.size());
+    {
+        std::lock_guard<std::mutex> lock(runners[target]->mtx);
+        runners[target]->strands.push_back(std::move(s));
+    }
+    {
+        std::lock_guard<std::mutex> lock(park_mtx);
+        ++queued;
+    }
+    park_cv.notify_one();
+}
+
+std::shared_ptr<WorkStealingWorkerPool::Strand> WorkStealingWorkerPool::Take(size_t self)
+{
+    for (size_t k = 0; k < runners.size(); ++k) { // own deque first (oldest strand), then steal from the others (newest strand)
+        auto &r = *runners[(self + k) % runners.size()];
+        std::lock_guard<std::mutex> lock(r.mtx);
+        if (!r.strands.empty()) {
+            std::shared_ptr<Strand> s;
+            if (k == 0) {
+                s = std::move(r.strands.front());
+                r.strands.pop_front();
+            } else {
+                s = std::move(r.strands.back());
+                r.strands.pop_back();
+            }
+            --queued;
+            return s;
+        }
+    }
+    return nullptr;
+}
+
+void WorkStealingWorkerPool::Run(size_t self)
+{
+    InitThread();
+    current_runner = self;
+    while (true) {
+        if (auto s = Take(self)) {
+            s->Run();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(park_mtx);
+        park_cv.wait(lock, [this]() { return quit || (queued > 0); });
+        if (quit) {
+            break;
+        }
+    }
+}
+
+//
+
+namespace {
+
+const unsigned c_thread_limit = 1024; // of adaptive pool without explicit bound, so that e.g. stalled disk doesn't grow it without end
+
+}
+
+AdaptiveWorkerPool::Sizing::Sizing(unsigned _min_threads, unsigned _max_threads)
+    : min_threads(std::max(1u, _min_threads))
+    , max_threads(std::max(min_threads, _max_threads ? _max_threads : c_thread_limit))
+    , interval(500)
+    , utilization(0.75)
+    , shrink_after(4)
+{
+}
+
+AdaptiveWorkerPool::AdaptiveWorkerPool(const Sizing &_sizing, const Limits &_limits)
+    : WorkerPool(0, _limits)
+    , sizing(_sizing)
+    , running(0)
+    , next_slot(0)
+    , quit(false)
+    , runs(0)
+    , wait(0)
+    , busy(0)
+    , below(0)
+{
+    status.threads = 0;
+    status.target = sizing.min_threads;
+    status.grown = 0;
+    status.shrunk = 0;
+    status.arrival_rate = 0;
+    status.wait_sec = 0;
+    status.service_sec = 0;
+}
+
+AdaptiveWorkerPool::~AdaptiveWorkerPool()
+{
+    Quit();
+    Wait();
+}
+
+std::shared_ptr<IWorker> AdaptiveWorkerPool::SubmitTask(std::unique_ptr<ITask> &&task)
+{
+    std::shared_ptr<Strand> s(new Strand(this));
+    if (!s->AssignTask(std::move(task))) {
+        return nullptr;
+    }
+    return s;
+}
+
+void AdaptiveWorkerPool::Start()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    if (quit || controller.joinable()) {
+        return;
+    }
+    Resize();
+    controller = std::thread(&AdaptiveWorkerPool::Control, this);
+}
+
+void AdaptiveWorkerPool::Quit()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        quit = true;
+    }
+    cv.notify_all();
+    controller_cv.notify_all();
+}
+
+void AdaptiveWorkerPool::Wait()
+{
+    if (controller.joinable()) {
+        controller.join();
+    }
+    std::map<unsigned, std::thread> rest;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        rest.swap(threads); // no more threads are started once controller is gone
+    }
+    for (auto &t : rest) {
+        t.second.join();
+    }
+}
+
+std::vector<size_t> AdaptiveWorkerPool::QueueDepths() const
+{
+    size_t n = 0;
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto &r : ready) {
+        std::lock_guard<std::mutex> strand_lock(r.first->mtx);
+        n += r.first->tasks.size();
+    }
+    return std::vector<size_t>(1, n);
+}
+
+AdaptiveWorkerPool::Status AdaptiveWorkerPool::GetStatus() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    auto res = status;
+    res.threads = running;
+    return res;
+}
+
+void AdaptiveWorkerPool::Schedule(std::shared_ptr<Strand> s)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        ready.emplace_back(std::move(s), Clock::now());
+    }
+    cv.notify_one();
+}
+
+void AdaptiveWorkerPool::Run(unsigned slot)
+{
+    InitThread();
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        cv.wait(lock, [this]() { return quit || !ready.empty() || (running > status.target); });
+        if (quit || (running > status.target)) { // pool is shrunk
+            break;
+        }
+        auto s = std::move(ready.front().first);
+        const auto start = Clock::now();
+        wait += start - ready.front().second;
+        ready.pop_front();
+        lock.unlock();
+
+        s->Run();
+        s.reset();
+
+        const auto end = Clock::now();
+        lock.lock();
+        busy += end - start;
+        ++runs;
+    }
+    --running;
+    exited.push_back(slot);
+}
+
+void AdaptiveWorkerPool::Control()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    auto last = Clock::now();
+    while (!controller_cv.wait_for(lock, sizing.interval, [this]() { return quit; })) {
+        const auto now = Clock::now();
+        const double elapsed = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        // Little's law: mean number of strands being run is their arrival rate times mean service time
+        status.arrival_rate = runs / elapsed;
+        status.service_sec = runs ? std::chrono::duration<double>(busy).count() / runs : 0;
+        status.wait_sec = runs ? std::chrono::duration<double>(wait).count() / runs : 0;
+        unsigned needed = unsigned(std::ceil(status.arrival_rate * status.service_sec / sizing.utilization));
+        if (runs && (status.wait_sec > status.service_sec)) { // queue builds up
+            needed = std::max(needed, running + std::max(1u, running / 4));
+        }
+        needed = std::min(sizing.max_threads, std::max(sizing.min_threads, needed));
+        runs = 0;
+        wait = busy = std::chrono::nanoseconds(0);
+
+        const unsigned prev = status.target;
+        if (needed > status.target) {
+            status.target = needed;
+            ++status.grown;
+            below = 0;
+        } else if ((needed < status.target) && (++below >= sizing.shrink_after)) { // hysteresis: only sustained drop shrinks the pool
+            status.target = std::max(needed, status.target - std::max(1u, status.target / 4));
+            ++status.shrunk;
+            below = 0;
+        } else if (needed == status.target) {
+            below = 0;
+        }
+        if (status.target != prev) {
+            LOG_INFO("Worker pool resized from " + std::to_string(prev) + " to " + std::to_string(status.target) + " threads: " +
+                     std::to_string(int64_t(status.arrival_rate)) + " runs/s, service " + std::to_string(int64_t(status.service_sec * 1e6)) +
+                     " us, wait " + std::to_string(int64_t(status.wait_sec * 1e6)) + " us");
+        }
+        Resize();
+        if (status.target < prev) {
+            cv.notify_all(); // extra threads exit once they are idle
+        }
+    }
+}
+
+void AdaptiveWorkerPool::Resize()
+{
+    for (const auto slot : exited) {
+        threads[slot].join(); // it doesn't touch the pool anymore
+        threads.erase(slot);
+    }
+    exited.clear();
+    while (running < status.target) {
+        const unsigned slot = next_slot++;
+        threads[slot] = std::thread(&AdaptiveWorkerPool::Run, this, slot);
+        ++running;
+    }
 }
 
 }
@@ -2,7 +2,15 @@
 #define WORKERPOOL_H
 
 #include <vector>
+#include <deque>
+#include <map>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
 
 namespace Concurrent {
 
@@ -15,35 +23,164 @@ struct ITask
 struct IWorker
 {
     virtual ~IWorker() = default;
-    virtual bool AssignTask(std::unique_ptr<ITask> &&task) = 0;
+    virtual bool AssignTask(std::unique_ptr<ITask> &&task) = 0; // 'false' if task is rejected due to pool limits ('task' is left intact)
 };
 
 class WorkerPool
 {
 public:
-    explicit WorkerPool(unsigned pool_size);
+    // tasks beyond these limits are rejected instead of being queued, zero means no limit
+    // (unbounded queue of a worker thread holds back the submitting thread once it's full)
+    struct Limits
+    {
+        size_t per_worker; // tasks waiting for a single worker thread (for a single strand in 'WorkStealingWorkerPool')
+        size_t total;      // tasks waiting in the whole pool
+
+        Limits(size_t _per_worker = 0, size_t _total = 0);
+    };
+
+    explicit WorkerPool(unsigned pool_size, const Limits &_limits = Limits());
 
     virtual ~WorkerPool();
-    virtual IWorker *SubmitTask(std::unique_ptr<ITask> &&task) = 0;
+    virtual std::shared_ptr<IWorker> SubmitTask(std::unique_ptr<ITask> &&task) = 0; // 'nullptr' if task is rejected ('task' is left intact)
+
+    virtual void Start();
+    virtual void Quit();
+    virtual void Wait();
 
-    void Start();
-    void Quit();
-    void Wait();
+    virtual std::vector<size_t> QueueDepths() const; // tasks waiting for each worker thread
+    size_t Waiting() const; // tasks waiting in the whole pool
+
+    // called by every thread of the pool before it performs any task (e.g., to set its CPU affinity), must be set before 'Start'
+    void SetThreadInit(std::function<void()> f);
 protected:
     struct Worker;
+    struct Strand; // serial queue of tasks performed by at most one thread at a time, for pools which don't pin connections to threads
+
+    bool Admit();   // counts task about to be queued, 'false' if total limit is reached
+    void Started(); // task is taken off the queue
+
+    virtual void Schedule(std::shared_ptr<Strand> s); // strand becomes ready to run, pools of strands must override it
+
+    void InitThread() const;
+
     std::vector<std::unique_ptr<Worker>> workers;
+    Limits limits;
+    std::atomic<size_t> waiting;
+    std::function<void()> thread_init;
 };
 
 class RoundRobinWorkerPool : public WorkerPool
 {
 public:
-    explicit RoundRobinWorkerPool(unsigned pool_size);
+    explicit RoundRobinWorkerPool(unsigned pool_size, const Limits &_limits = Limits());
 
-    IWorker *SubmitTask(std::unique_ptr<ITask> &&task) override;
+    std::shared_ptr<IWorker> SubmitTask(std::unique_ptr<ITask> &&task) override; // the next worker with room in its queue
 private:
     size_t next_worker;
 };
 
+// tasks assigned to the worker returned by 'SubmitTask' form serial queue (strand) which is performed by at most one thread at a time,
+// so tasks are performed in order of assignment, but idle threads steal queued strands from busy ones instead of being pinned to them
+class WorkStealingWorkerPool : public WorkerPool
+{
+public:
+    explicit WorkStealingWorkerPool(unsigned pool_size, const Limits &_limits = Limits());
+    ~WorkStealingWorkerPool() override;
+
+    std::shared_ptr<IWorker> SubmitTask(std::unique_ptr<ITask> &&task) override;
+
+    void Start() override;
+    void Quit() override;
+    void Wait() override;
+
+    std::vector<size_t> QueueDepths() const override; // tasks of strands waiting in each thread's deque
+private:
+    struct Runner;
+
+    void Schedule(std::shared_ptr<Strand> s) override;
+    std::shared_ptr<Strand> Take(size_t self);
+    void Run(size_t self);
+
+    std::vector<std::unique_ptr<Runner>> runners;
+    std::atomic<size_t> next_runner;
+
+    std::mutex park_mtx;
+    std::condition_variable park_cv;
+    std::atomic<long> queued; // strands waiting in runners' deques (transiently negative as strand could be taken before it's counted)
+    bool quit;
+};
+
+// strands (as in 'WorkStealingWorkerPool') wait in a single queue served by a variable number of threads:
+// every interval the controller thread estimates threads needed to keep them busy at most 'utilization' of the time
+// following Little's law (arrival rate of strand runs times their mean service time, i.e., busy time per interval),
+// and grows the pool right away (also once runs wait longer than they take), but shrinks it only after 'shrink_after' intervals in a row
+class AdaptiveWorkerPool : public WorkerPool
+{
+public:
+    struct Sizing
+    {
+        unsigned min_threads;
+        unsigned max_threads;
+        std::chrono::milliseconds interval;
+        double utilization;
+        unsigned shrink_after;
+
+        Sizing(unsigned _min_threads, unsigned _max_threads); // zero '_max_threads' leaves growth to measurements, only bounded by a safety limit
+    };
+
+    struct Status // of the last interval
+    {
+        unsigned threads;
+        unsigned target;
+        uint64_t grown;  // sizing decisions so far
+        uint64_t shrunk;
+        double arrival_rate; // strand runs per second
+        double wait_sec;     // mean time strand waits for a thread
+        double service_sec;  // mean time strand runs
+    };
+
+    AdaptiveWorkerPool(const Sizing &_sizing, const Limits &_limits = Limits());
+    ~AdaptiveWorkerPool() override;
+
+    std::shared_ptr<IWorker> SubmitTask(std::unique_ptr<ITask> &&task) override;
+
+    void Start() override;
+    void Quit() override;
+    void Wait() override;
+
+    std::vector<size_t> QueueDepths() const override; // tasks of strands waiting in the queue
+    Status GetStatus() const;
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void Schedule(std::shared_ptr<Strand> s) override;
+    void Run(unsigned slot);
+    void Control();
+    void Resize(); // starts threads up to target (threads above it exit on their own), joins exited ones
+
+    Sizing sizing;
+
+    mutable std::mutex mtx;
+    std::condition_variable cv;            // idle threads park on it
+    std::condition_variable controller_cv; // signalled on quit
+    std::deque<std::pair<std::shared_ptr<Strand>, Clock::time_point>> ready; // with time strand became ready
+    std::map<unsigned, std::thread> threads; // by slot
+    std::vector<unsigned> exited; // slots of threads to be joined
+    unsigned running;
+    unsigned next_slot;
+    bool quit;
+    std::thread controller;
+
+    // measured during the current interval
+    uint64_t runs;
+    std::chrono::nanoseconds wait;
+    std::chrono::nanoseconds busy;
+    unsigned below; // intervals in a row estimate is below the target
+
+    Status status;
+};
+
 }
 
 #endif
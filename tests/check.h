@@ -0,0 +1,43 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+
+// harness of self-checks run by 'ctest' (e.g., 'h2_check', 'range_check', 'index_check'): every check prints "ok" or "FAIL" after the first mismatch it reports,
+// exit code is nonzero if any check fails, optional argument selects checks by part of their name
+namespace Checks {
+
+struct Check
+{
+    const char *name;
+    std::function<bool()> run; // 'true' if passed
+};
+
+inline bool Fail(const char *what, const std::string &detail = std::string()) // reports mismatch, returns 'false' for the check to return it
+{
+    printf("    %s%s%s\n", what, detail.empty() ? "" : ": ", detail.c_str());
+    return false;
+}
+
+template <size_t N>
+int Run(int argc, char **argv, const Check (&checks)[N]) // to be returned by 'main'
+{
+    const char *filter = (argc > 1) ? argv[1] : "";
+    int failed = 0;
+    for (const auto &check : checks) {
+        if (!strstr(check.name, filter)) {
+            continue;
+        }
+        const bool ok = check.run();
+        printf("%-40s %s\n", check.name, ok ? "ok" : "FAIL");
+        failed += ok ? 0 : 1;
+    }
+    return failed ? 1 : 0;
+}
+
+}
+
+#endif
@@ -0,0 +1,835 @@
+// Checks HPACK (examples of RFC 7541 Appendix C, integer and Huffman coding, table eviction, limits) and HTTP/2 framing of 'Http2Session'
+// (translation between HTTP/2 streams and HTTP/1.1 heads, flow control, malformed frames) driven by a client over a socketpair.
+// Usage: h2_check [name_filter]
+
+#include "check.h"
+#include "../src/hpack.h"
+#include "../src/http2.h"
+#include "../src/io.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Checks::Check;
+using Checks::Fail;
+using Http::Hpack::Field;
+using Http::Hpack::Fields;
+using Http::Http2Session;
+
+const size_t c_read_capacity = 16384; // as the server's read buffer
+const char c_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+enum FrameType
+{
+    Data = 0x0,
+    Headers = 0x1,
+    RstStream = 0x3,
+    Settings = 0x4,
+    PushPromise = 0x5,
+    Ping = 0x6,
+    GoAway = 0x7,
+    WindowUpdate = 0x8,
+    Continuation = 0x9
+};
+
+enum Flag
+{
+    EndStream = 0x1,
+    Ack = 0x1,
+    EndHeaders = 0x4,
+    Padded = 0x8
+};
+
+enum ErrorCode
+{
+    ProtocolError = 0x1,
+    FlowControlError = 0x3,
+    FrameSizeError = 0x6,
+    StreamClosed = 0x5,
+    RefusedStream = 0x7,
+    CompressionError = 0x9,
+    EnhanceYourCalm = 0xb
+};
+
+std::string Hex(const char *hex) // spaces are ignored
+{
+    std::string res;
+    for (const char *p = hex; *p; ) {
+        if (*p == ' ') {
+            ++p;
+            continue;
+        }
+        res += char(strtol(std::string(p, 2).c_str(), nullptr, 16));
+        p += 2;
+    }
+    return res;
+}
+
+std::string Dump(const Fields &fields)
+{
+    std::string res;
+    for (const auto &f : fields) {
+        res += "[" + f.name + ": " + f.value + "]";
+    }
+    return res;
+}
+
+std::string Put32(uint32_t v)
+{
+    const char b[] = { char(v >> 24), char(v >> 16), char(v >> 8), char(v) };
+    return std::string(b, 4);
+}
+
+uint32_t Get32(const std::string &s, size_t pos = 0)
+{
+    return (uint32_t(uint8_t(s[pos])) << 24) | (uint32_t(uint8_t(s[pos + 1])) << 16) | (uint32_t(uint8_t(s[pos + 2])) << 8) | uint8_t(s[pos + 3]);
+}
+
+//
+
+// header blocks decoded in sequence by the same decoder (so its dynamic table carries over) must give 'expected' fields
+bool DecodeSequence(const std::vector<std::pair<std::string, Fields>> &blocks)
+{
+    Http::Hpack::Decoder decoder;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        Fields fields;
+        if (!decoder.Decode(blocks[i].first.data(), blocks[i].first.size(), c_read_capacity, fields)) {
+            return Fail("block isn't decoded", std::to_string(i + 1));
+        }
+        if (Dump(fields) != Dump(blocks[i].second)) {
+            return Fail("block is decoded differently", std::to_string(i + 1) + " " + Dump(fields));
+        }
+    }
+    return true;
+}
+
+const Fields c_request1 = { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { ":authority", "www.example.com" } };
+const Fields c_request2 = { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { ":authority", "www.example.com" }, { "cache-control", "no-cache" } };
+const Fields c_request3 = { { ":method", "GET" }, { ":scheme", "https" }, { ":path", "/index.html" }, { ":authority", "www.example.com" },
+                            { "custom-key", "custom-value" } };
+
+const Fields c_response1 = { { ":status", "302" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+                             { "location", "https://www.example.com" } };
+const Fields c_response2 = { { ":status", "307" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+                             { "location", "https://www.example.com" } };
+const Fields c_response3 = { { ":status", "200" }, { "cache-control", "private" }, { "date", "Mon, 21 Oct 2013 20:13:22 GMT" },
+                             { "location", "https://www.example.com" }, { "content-encoding", "gzip" },
+                             { "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1" } };
+
+const char *c_size_update_256 = "3fe101"; // examples of responses assume SETTINGS_HEADER_TABLE_SIZE of 256, the decoder learns it from the block
+
+bool LiteralFields() // C.2
+{
+    const std::pair<const char *, Field> examples[] = {
+        { "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 6572", { "custom-key", "custom-header" } }, // with indexing
+        { "040c 2f73 616d 706c 652f 7061 7468", { ":path", "/sample/path" } },                                    // without indexing
+        { "1008 7061 7373 776f 7264 0673 6563 7265 74", { "password", "secret" } },                                // never indexed
+        { "82", { ":method", "GET" } },                                                                            // indexed
+    };
+    for (const auto &e : examples) {
+        if (!DecodeSequence({ { Hex(e.first), Fields(1, e.second) } })) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Requests() // C.3
+{
+    return DecodeSequence({ { Hex("8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d"), c_request1 },
+                            { Hex("8286 84be 5808 6e6f 2d63 6163 6865"), c_request2 },
+                            { Hex("8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65"), c_request3 } });
+}
+
+bool HuffmanRequests() // C.4
+{
+    return DecodeSequence({ { Hex("8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff"), c_request1 },
+                            { Hex("8286 84be 5886 a8eb 1064 9cbf"), c_request2 },
+                            { Hex("8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf"), c_request3 } });
+}
+
+bool Responses() // C.5, entries are evicted as the table of 256 bytes fills up
+{
+    return DecodeSequence({ { Hex(c_size_update_256) + Hex("4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3120"
+                                                            "474d 546e 1768 7474 7073 3a2f 2f77 7777 2e65 7861 6d70 6c65 2e63 6f6d"), c_response1 },
+                            { Hex("4803 3330 37c1 c0bf"), c_response2 },
+                            { Hex("88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3220 474d 54c0 5a04 677a 6970 7738 666f 6f3d 4153"
+                                  "444a 4b48 514b 425a 584f 5157 454f 5049 5541 5851 5745 4f49 553b 206d 6178 2d61 6765 3d33 3630 303b 2076 6572 7369"
+                                  "6f6e 3d31"), c_response3 } });
+}
+
+bool HuffmanResponses() // C.6
+{
+    return DecodeSequence({ { Hex(c_size_update_256) + Hex("4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504 0b81 66e0 82a6 2d1b ff6e 919d 29ad 1718"
+                                                            "63c7 8f0b 97c8 e9ae 82ae 43d3"), c_response1 },
+                            { Hex("4883 640e ffc1 c0bf"), c_response2 },
+                            { Hex("88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff c05a 839b d9ab 77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b 3960"
+                                  "d5af 2708 7f36 72c1 ab27 0fb5 291f 9587 3160 65c0 03ed 4ee5 b106 3d50 07"), c_response3 } });
+}
+
+bool Eviction() // dynamic table after each response of C.5
+{
+    Http::Hpack::Table table;
+    table.Resize(256);
+    for (const auto *fields : { &c_response1, &c_response2, &c_response3 }) {
+        for (const auto &f : *fields) {
+            size_t index;
+            if (!table.Find(f, index)) { // as the examples do, fields not in the tables are added
+                table.Add(f);
+            }
+        }
+    }
+    const Fields expected = { c_response3[5], c_response3[4], c_response3[2] }; // 215 bytes, older entries are evicted
+    for (size_t i = 0; i < expected.size(); ++i) {
+        const Field *f = table.Get(62 + i);
+        if (!f || (f->name != expected[i].name) || (f->value != expected[i].value)) {
+            return Fail("unexpected entry", std::to_string(62 + i));
+        }
+    }
+    if (table.Get(62 + expected.size())) {
+        return Fail("entry isn't evicted");
+    }
+    table.Add(Field{ std::string(100, 'n'), std::string(200, 'v') }); // larger than the table, which just becomes empty
+    if (table.Get(62)) {
+        return Fail("oversized entry doesn't empty the table");
+    }
+    return true;
+}
+
+bool Integers()
+{
+    // value length of 300 takes prefix and two continuation bytes (7f ad 01)
+    const std::string value(300, 'x');
+    if (!DecodeSequence({ { Hex("0f27 7fad01") + value, { { "server", value } } } })) { // without indexing, name index 54 is 15 + 39
+        return false;
+    }
+    Http::Hpack::Decoder decoder;
+    Fields fields;
+    const std::string overlong = Hex("ff ffffffffffffff7f"); // index that can't be right
+    if (decoder.Decode(overlong.data(), overlong.size(), c_read_capacity, fields)) {
+        return Fail("overlong integer is accepted");
+    }
+    const std::string truncated = Hex("0f27 7fad"); // length is cut off
+    if (decoder.Decode(truncated.data(), truncated.size(), c_read_capacity, fields)) {
+        return Fail("truncated integer is accepted");
+    }
+    const std::string beyond = Hex("0f27 05") + "abc"; // string longer than the block
+    if (decoder.Decode(beyond.data(), beyond.size(), c_read_capacity, fields)) {
+        return Fail("string beyond the block is accepted");
+    }
+    return true;
+}
+
+bool Limits()
+{
+    const std::string block = Hex("8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d"); // names and values of C.3.1 take 52 bytes
+    Fields fields;
+    if (!Http::Hpack::Decoder().Decode(block.data(), block.size(), 52, fields)) {
+        return Fail("block of max_fields_bytes is rejected");
+    }
+    fields.clear();
+    if (Http::Hpack::Decoder().Decode(block.data(), block.size(), 51, fields)) {
+        return Fail("block above max_fields_bytes is accepted");
+    }
+    const std::string too_large = Hex("3fe21f"); // size update to 4097, beyond SETTINGS_HEADER_TABLE_SIZE
+    if (Http::Hpack::Decoder().Decode(too_large.data(), too_large.size(), c_read_capacity, fields)) {
+        return Fail("table size above the limit is accepted");
+    }
+    const std::string late = Hex("82 3fe101"); // size update after a field
+    if (Http::Hpack::Decoder().Decode(late.data(), late.size(), c_read_capacity, fields)) {
+        return Fail("table size update after a field is accepted");
+    }
+    const std::string bad_index = Hex("be"); // 62, dynamic table is empty
+    if (Http::Hpack::Decoder().Decode(bad_index.data(), bad_index.size(), c_read_capacity, fields)) {
+        return Fail("index beyond the tables is accepted");
+    }
+    return true;
+}
+
+bool Huffman()
+{
+    std::string res;
+    Http::Hpack::HuffmanEncode("www.example.com", res);
+    if ((res != Hex("f1e3 c2e5 f23a 6ba0 ab90 f4ff")) || (Http::Hpack::HuffmanLen("www.example.com") != res.size())) {
+        return Fail("www.example.com is coded differently");
+    }
+    std::string all; // every symbol, in several alignments
+    for (int k = 0; k < 3; ++k) {
+        for (int c = 0; c < 256; ++c) {
+            all += char(c);
+        }
+        all += 'a';
+    }
+    for (size_t len = 0; len <= all.size(); len += 97) {
+        const std::string str = all.substr(0, len);
+        std::string coded, decoded;
+        Http::Hpack::HuffmanEncode(str, coded);
+        if ((coded.size() != Http::Hpack::HuffmanLen(str)) || !Http::Hpack::HuffmanDecode(coded.data(), coded.size(), decoded) || (decoded != str)) {
+            return Fail("round trip fails", std::to_string(len) + " bytes");
+        }
+    }
+    const std::string long_padding = Hex("f1e3 c2e5 f23a 6ba0 ab90 f4ff ff"); // 8 bits or more
+    const std::string zero_padding = Hex("18"); // 'a' (00011) followed by zeros
+    const std::string eos = Hex("ffff ffff"); // EOS symbol (30 ones) is never sent
+    for (const auto *bad : { &long_padding, &zero_padding, &eos }) {
+        std::string decoded;
+        if (Http::Hpack::HuffmanDecode(bad->data(), bad->size(), decoded)) {
+            return Fail("invalid coding is accepted", Dump({ Field{ "decoded", decoded } }));
+        }
+    }
+    return true;
+}
+
+bool EncoderRoundTrip()
+{
+    Http::Hpack::Encoder encoder;
+    Http::Hpack::Decoder decoder;
+    std::vector<Fields> blocks = { c_response1, c_response2, c_response3, c_response3,
+                                   { { ":status", "200" }, { "content-type", "text/html" }, { "x-long", std::string(1000, 'q') } },
+                                   c_response1 };
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (i == 2) {
+            encoder.SetMaxTableSize(256); // signalled in the next block, decoder follows it
+        } else if (i == 4) {
+            encoder.SetMaxTableSize(0);
+        }
+        std::string block;
+        encoder.Encode(blocks[i], block);
+        if (((i == 2) || (i == 4)) && ((uint8_t(block[0]) & 0xe0) != 0x20)) {
+            return Fail("table size update isn't signalled first", std::to_string(i + 1));
+        }
+        Fields fields;
+        if (!decoder.Decode(block.data(), block.size(), 1 << 20, fields) || (Dump(fields) != Dump(blocks[i]))) {
+            return Fail("block doesn't round trip", std::to_string(i + 1));
+        }
+    }
+    std::string block;
+    encoder.Encode(c_response1, block); // with the empty table nothing is indexed into it, encoder and decoder agree still
+    Fields fields;
+    return decoder.Decode(block.data(), block.size(), c_read_capacity, fields) && (Dump(fields) == Dump(c_response1)) ? true : Fail("table of size 0");
+}
+
+bool EncoderSizeUpdates()
+{
+    Http::Hpack::Encoder encoder;
+    Http::Hpack::Decoder decoder;
+    for (int i = 0; i < 3; ++i) {
+        if (i == 1) { // shrinks and grows back between blocks, so the smallest size is signalled before the final one
+            encoder.SetMaxTableSize(0);
+            encoder.SetMaxTableSize(4096);
+        } else if (i == 2) { // shrinks and grows, but not back to the size it had
+            encoder.SetMaxTableSize(100);
+            encoder.SetMaxTableSize(200);
+        }
+        std::string block;
+        encoder.Encode(c_response1, block);
+        const std::string updates[] = { "", Hex("20 3fe11f"), Hex("3f45 3fa901") }; // 0 and 4096, 100 and 200
+        if ((i > 0) && (block.compare(0, updates[i].size(), updates[i]) != 0)) {
+            return Fail("size updates", std::to_string(i + 1));
+        }
+        Fields fields;
+        if (!decoder.Decode(block.data(), block.size(), c_read_capacity, fields) || (Dump(fields) != Dump(c_response1))) {
+            return Fail("block doesn't round trip", std::to_string(i + 1));
+        }
+    }
+    return true;
+}
+
+//
+
+struct Frame
+{
+    uint8_t type;
+    uint8_t flags;
+    uint32_t id;
+    std::string payload;
+};
+
+std::string Encode(uint8_t type, uint8_t flags, uint32_t id, const std::string &payload)
+{
+    const char h[] = { char(payload.size() >> 16), char(payload.size() >> 8), char(payload.size()), char(type), char(flags) };
+    return std::string(h, 5) + Put32(id) + payload;
+}
+
+// client of a session over a socketpair: frames are handed to the session directly, frames it sends are read from the socket
+struct Client
+{
+    struct Handed
+    {
+        uint32_t id;
+        std::string head;
+        std::shared_ptr<IO::OutQueue> out;
+        std::function<void()> done;
+    };
+
+    int fds[2];
+    std::shared_ptr<Http2Session> session;
+    std::vector<Handed> requests; // handed over by the session
+    bool refuse; // requests, as if overloaded
+    std::string received;
+    Http::Hpack::Encoder encoder;
+    Http::Hpack::Decoder decoder;
+
+    Client();
+    ~Client();
+
+    size_t Send(const std::string &bytes);
+    void Connect(const std::string &settings = std::string()); // preface and SETTINGS, server's SETTINGS and the ACK are read
+    void Request(uint32_t id, const Fields &fields);
+    void Respond(size_t i, const std::string &response);
+    std::vector<Frame> Read();
+    int GoAwayCode(); // of GOAWAY read, -1 if none
+};
+
+Client::Client()
+    : refuse(false)
+{
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    IO::Socket s(fds[0]);
+    session = std::make_shared<Http2Session>(s, std::make_shared<IO::OutQueue>(s, 1 << 20), c_read_capacity,
+        [this](uint32_t id, const std::string &head, std::shared_ptr<IO::OutQueue> out, std::function<void()> done) {
+            if (refuse) {
+                return false;
+            }
+            requests.push_back(Handed{ id, head, std::move(out), std::move(done) });
+            return true;
+        });
+}
+
+Client::~Client()
+{
+    close(fds[1]);
+}
+
+size_t Client::Send(const std::string &bytes)
+{
+    return session->Receive(bytes.data(), bytes.size());
+}
+
+void Client::Connect(const std::string &settings)
+{
+    session->Start();
+    Send(std::string(c_preface) + Encode(Settings, 0, 0, settings));
+    Read();
+}
+
+void Client::Request(uint32_t id, const Fields &fields)
+{
+    std::string block;
+    encoder.Encode(fields, block);
+    Send(Encode(Headers, EndHeaders | EndStream, id, block));
+}
+
+void Client::Respond(size_t i, const std::string &response)
+{
+    requests[i].out->Push(response);
+    requests[i].done();
+}
+
+std::vector<Frame> Client::Read()
+{
+    char buf[65536];
+    for (ssize_t n; (n = read(fds[1], buf, sizeof(buf))) > 0; ) {
+        received.append(buf, n);
+    }
+    std::vector<Frame> frames;
+    size_t pos = 0;
+    while (received.size() - pos >= 9) {
+        const size_t len = (size_t(uint8_t(received[pos])) << 16) | (size_t(uint8_t(received[pos + 1])) << 8) | uint8_t(received[pos + 2]);
+        if (received.size() - pos < 9 + len) {
+            break;
+        }
+        frames.push_back(Frame{ uint8_t(received[pos + 3]), uint8_t(received[pos + 4]), Get32(received, pos + 5) & 0x7fffffff, received.substr(pos + 9, len) });
+        pos += 9 + len;
+    }
+    received.erase(0, pos);
+    return frames;
+}
+
+int Client::GoAwayCode()
+{
+    for (const auto &f : Read()) {
+        if ((f.type == GoAway) && (f.payload.size() == 8)) {
+            return int(Get32(f.payload, 4));
+        }
+    }
+    return -1;
+}
+
+const Fields c_get = { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/index.html" }, { ":authority", "example.com" }, { "accept-encoding", "gzip" } };
+
+bool Preface()
+{
+    Client c;
+    c.session->Start();
+    if (c.Send(std::string(c_preface) + Encode(Settings, 0, 0, std::string())) != strlen(c_preface) + 9) {
+        return Fail("preface and SETTINGS aren't consumed");
+    }
+    const auto frames = c.Read();
+    if ((frames.size() != 2) || (frames[0].type != Settings) || (frames[0].flags != 0) || (frames[1].type != Settings) || (frames[1].flags != Ack)) {
+        return Fail("server's SETTINGS and ACK expected");
+    }
+    c.Send(Encode(Ping, 0, 0, "12345678"));
+    const auto pong = c.Read();
+    if ((pong.size() != 1) || (pong[0].type != Ping) || (pong[0].flags != Ack) || (pong[0].payload != "12345678")) {
+        return Fail("PING isn't acknowledged");
+    }
+    Client bad;
+    bad.session->Start();
+    bad.Send("GET / HTTP/1.1\r\nHost: x\r\n\r\nxxxxxxxxxxxxxxxx");
+    return (bad.GoAwayCode() == ProtocolError) && bad.session->Closed() ? true : Fail("wrong preface isn't rejected");
+}
+
+bool Translation()
+{
+    Client c;
+    c.Connect();
+    c.Request(1, c_get);
+    if ((c.requests.size() != 1) || (c.requests[0].head != "GET /index.html HTTP/2.0\r\nhost: example.com\r\naccept-encoding: gzip\r\n\r\n")) {
+        return Fail("request head", c.requests.empty() ? "none" : c.requests[0].head);
+    }
+    c.Respond(0, "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nConnection: keep-alive\r\nContent-type: text/plain\r\n\r\nhello");
+    auto frames = c.Read();
+    if ((frames.size() != 2) || (frames[0].type != Headers) || (frames[0].flags != EndHeaders) || (frames[0].id != 1)) {
+        return Fail("HEADERS expected");
+    }
+    const Fields expected = { { ":status", "200" }, { "content-length", "5" }, { "content-type", "text/plain" } }; // 'Connection' is dropped
+    Fields fields;
+    if (!c.decoder.Decode(frames[0].payload.data(), frames[0].payload.size(), c_read_capacity, fields) || (Dump(fields) != Dump(expected))) {
+        return Fail("response fields", Dump(fields));
+    }
+    if ((frames[1].type != Data) || (frames[1].flags != EndStream) || (frames[1].payload != "hello")) {
+        return Fail("DATA with END_STREAM expected");
+    }
+
+    c.Request(3, { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { "host", "h" }, { "te", "trailers" } }); // 'host' stays, 'te' goes
+    if ((c.requests.size() != 2) || (c.requests[1].head != "GET / HTTP/2.0\r\nhost: h\r\n\r\n")) {
+        return Fail("request head", c.requests.back().head);
+    }
+    c.Respond(1, "HTTP/1.1 304 Not Modified\r\nETag: \"x\"\r\n\r\n");
+    frames = c.Read();
+    if ((frames.size() != 1) || (frames[0].type != Headers) || (frames[0].flags != (EndHeaders | EndStream))) {
+        return Fail("response without body ends stream on HEADERS");
+    }
+
+    std::string block; // header block split into HEADERS and CONTINUATION
+    c.encoder.Encode(c_get, block);
+    c.Send(Encode(Headers, EndStream, 5, block.substr(0, 5)) + Encode(Continuation, EndHeaders, 5, block.substr(5)));
+    if ((c.requests.size() != 3) || (c.requests[2].id != 5)) {
+        return Fail("CONTINUATION isn't joined");
+    }
+
+    const std::vector<Fields> malformed = {
+        { { ":method", "GET" }, { ":scheme", "http" } },                                          // no path
+        { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { "Upper", "x" } },      // uppercase name
+        { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { "connection", "close" } },
+        { { ":method", "GET" }, { ":scheme", "http" }, { "x", "y" }, { ":path", "/" } },          // pseudo-header after regular one
+        { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" }, { "x", "a\r\nb: c" } },  // would split the head
+    };
+    uint32_t id = 7;
+    for (const auto &fields : malformed) {
+        c.Request(id, fields);
+        frames = c.Read();
+        if ((c.requests.size() != 3) || (frames.size() != 1) || (frames[0].type != RstStream) || (frames[0].id != id) || (Get32(frames[0].payload) != ProtocolError)) {
+            return Fail("malformed request isn't reset", Dump(fields));
+        }
+        id += 2;
+    }
+    return true;
+}
+
+bool Upgrade()
+{
+    Client c;
+    if (c.session->Upgrade("AAMAAABkAAQAAP__", "GET /index.html HTTP/1.1\r\nHost: example.com\r\nUpgrade: h2c\r\n\r\n")) { // MAX_CONCURRENT_STREAMS and INITIAL_WINDOW_SIZE
+        if ((c.requests.size() != 1) || (c.requests[0].id != 1) || (c.requests[0].head != "GET /index.html HTTP/2.0\r\nHost: example.com\r\nUpgrade: h2c\r\n\r\n")) {
+            return Fail("stream 1 head", c.requests.empty() ? "none" : c.requests[0].head);
+        }
+    } else {
+        return Fail("upgrade is rejected");
+    }
+    c.Respond(0, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+    char buf[4096];
+    const ssize_t n = read(c.fds[1], buf, sizeof(buf)); // nothing but 101 and SETTINGS until client's preface
+    const std::string switching = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    if ((n < ssize_t(switching.size())) || (std::string(buf, switching.size()) != switching)) {
+        return Fail("101 expected");
+    }
+    c.received.assign(buf + switching.size(), n - switching.size());
+    auto frames = c.Read();
+    if ((frames.size() != 1) || (frames[0].type != Settings)) {
+        return Fail("SETTINGS alone expected before client's preface");
+    }
+    c.Send(std::string(c_preface) + Encode(Settings, 0, 0, std::string()));
+    frames = c.Read();
+    if ((frames.size() != 3) || (frames[1].type != Headers) || (frames[1].id != 1) || (frames[2].payload != "ok")) {
+        return Fail("response to stream 1 expected once preface is received");
+    }
+    return Client().session->Upgrade("not base64url!", "GET / HTTP/1.1\r\n\r\n") ? Fail("malformed HTTP2-Settings are accepted") : true;
+}
+
+bool FlowControl()
+{
+    Client c;
+    c.Connect(Hex("0004 0000000a")); // INITIAL_WINDOW_SIZE of 10
+    c.Request(1, c_get);
+    c.Respond(0, "HTTP/1.1 200 OK\r\nContent-Length: 25\r\n\r\n" + std::string(25, 'b'));
+    auto frames = c.Read();
+    if ((frames.size() != 2) || (frames[1].type != Data) || (frames[1].payload.size() != 10) || (frames[1].flags != 0)) {
+        return Fail("DATA of the stream window expected");
+    }
+    c.Send(Encode(WindowUpdate, 0, 1, Put32(10)));
+    frames = c.Read();
+    if ((frames.size() != 1) || (frames[0].payload.size() != 10) || (frames[0].flags != 0)) {
+        return Fail("DATA of the window update expected");
+    }
+    c.Send(Encode(Settings, 0, 0, Hex("0004 00000064"))); // stream window grows by the difference, to 90
+    frames = c.Read();
+    if ((frames.size() != 2) || (frames[0].type != Settings) || (frames[0].flags != Ack) || (frames[1].payload.size() != 5) || (frames[1].flags != EndStream)) {
+        return Fail("the rest of DATA expected once SETTINGS enlarge the window");
+    }
+
+    c.Request(3, c_get);
+    c.Send(Encode(WindowUpdate, 0, 3, Put32(0x7fffffff))); // stream window overflows
+    frames = c.Read();
+    if ((frames.size() != 1) || (frames[0].type != RstStream) || (frames[0].id != 3) || (Get32(frames[0].payload) != FlowControlError)) {
+        return Fail("stream window overflow isn't reset");
+    }
+    c.Send(Encode(WindowUpdate, 0, 0, Put32(0x7fffffff))); // connection window overflows
+    if (c.GoAwayCode() != FlowControlError) {
+        return Fail("connection window overflow isn't rejected");
+    }
+    Client big;
+    big.Connect();
+    big.Send(Encode(Settings, 0, 0, Hex("0004 80000000")));
+    if (big.GoAwayCode() != FlowControlError) {
+        return Fail("INITIAL_WINDOW_SIZE above the maximum isn't rejected");
+    }
+    Client grown;
+    grown.Connect();
+    grown.Request(1, c_get);
+    grown.Send(Encode(WindowUpdate, 0, 1, Put32(0x7fffffff - 65535))); // stream window is at the maximum
+    grown.Send(Encode(Settings, 0, 0, Hex("0004 00010000"))); // and would grow beyond it by one
+    return (grown.GoAwayCode() == FlowControlError) ? true : Fail("INITIAL_WINDOW_SIZE pushing stream window beyond the maximum isn't rejected");
+}
+
+bool MalformedFrames()
+{
+    struct Case
+    {
+        const char *name;
+        std::string frames;
+        int error;
+    };
+    std::string block;
+    Http::Hpack::Encoder().Encode(c_get, block);
+    const Case cases[] = {
+        { "frame above max size", Encode(Data, 0, 1, std::string(16385, 'x')), FrameSizeError },
+        { "SETTINGS of 5 bytes", Encode(Settings, 0, 0, "12345"), FrameSizeError },
+        { "SETTINGS ACK with payload", Encode(Settings, Ack, 0, Hex("0004 0000000a")), FrameSizeError },
+        { "SETTINGS on stream", Encode(Settings, 0, 1, std::string()), ProtocolError },
+        { "PING of 7 bytes", Encode(Ping, 0, 0, "1234567"), FrameSizeError },
+        { "PING on stream", Encode(Ping, 0, 1, "12345678"), ProtocolError },
+        { "WINDOW_UPDATE of 3 bytes", Encode(WindowUpdate, 0, 0, "123"), FrameSizeError },
+        { "connection WINDOW_UPDATE of 0", Encode(WindowUpdate, 0, 0, Put32(0)), ProtocolError },
+        { "HEADERS on stream 0", Encode(Headers, EndHeaders | EndStream, 0, block), ProtocolError },
+        { "HEADERS on even stream", Encode(Headers, EndHeaders | EndStream, 2, block), ProtocolError },
+        { "DATA on stream 0", Encode(Data, 0, 0, "x"), ProtocolError },
+        { "DATA on idle stream", Encode(Data, 0, 1, "x"), ProtocolError },
+        { "RST_STREAM on stream 0", Encode(RstStream, 0, 0, Put32(0)), ProtocolError },
+        { "RST_STREAM of 3 bytes", Encode(RstStream, 0, 1, "123"), FrameSizeError },
+        { "padding beyond payload", Encode(Headers, EndHeaders | Padded, 1, std::string(1, char(200)) + block), ProtocolError },
+        { "CONTINUATION without HEADERS", Encode(Continuation, EndHeaders, 1, block), ProtocolError },
+        { "HEADERS interrupted", Encode(Headers, 0, 1, block) + Encode(Ping, 0, 0, "12345678"), ProtocolError },
+        { "PUSH_PROMISE from client", Encode(PushPromise, EndHeaders, 1, Put32(2) + block), ProtocolError },
+        { "broken header block", Encode(Headers, EndHeaders, 1, Hex("80")), CompressionError },
+        { "ENABLE_PUSH of 2", Encode(Settings, 0, 0, Hex("0002 00000002")), ProtocolError },
+        { "MAX_FRAME_SIZE below minimum", Encode(Settings, 0, 0, Hex("0005 00000100")), ProtocolError },
+    };
+    for (const auto &cs : cases) {
+        Client c;
+        c.Connect();
+        c.Send(cs.frames);
+        const int error = c.GoAwayCode();
+        if ((error != cs.error) || !c.session->Closed()) {
+            return Fail(cs.name, "GOAWAY " + std::to_string(error));
+        }
+        if (!c.requests.empty()) {
+            return Fail(cs.name, "request is handed over");
+        }
+    }
+    return true;
+}
+
+bool Reset(Client &c, uint32_t id, uint32_t error) // 'true' if RST_STREAM of 'error' alone is sent on stream 'id'
+{
+    bool reset = false;
+    for (const auto &f : c.Read()) {
+        if ((f.type == RstStream) && (f.id == id) && (Get32(f.payload) == error) && !reset) {
+            reset = true;
+        } else if (f.type != WindowUpdate) { // DATA of request bodies is acknowledged meanwhile
+            return false;
+        }
+    }
+    return reset;
+}
+
+bool StreamStates()
+{
+    Client c;
+    c.Connect();
+    c.Request(1, c_get);
+    c.Respond(0, "HTTP/1.1 204 No Content\r\n\r\n");
+    c.Read();
+    c.Request(1, c_get); // closed stream
+    if (!Reset(c, 1, StreamClosed) || (c.requests.size() != 1)) {
+        return Fail("HEADERS on closed stream isn't reset with STREAM_CLOSED");
+    }
+    c.Send(Encode(Data, 0, 1, "x"));
+    if (!Reset(c, 1, StreamClosed)) {
+        return Fail("DATA on closed stream isn't reset with STREAM_CLOSED");
+    }
+
+    c.Request(3, c_get); // half-closed by client, request is being served
+    c.Request(3, c_get);
+    if (!Reset(c, 3, StreamClosed)) {
+        return Fail("HEADERS on half-closed stream isn't reset with STREAM_CLOSED");
+    }
+    c.Respond(1, "HTTP/1.1 204 No Content\r\n\r\n");
+    if (!c.Read().empty()) {
+        return Fail("response to reset stream is sent");
+    }
+    c.Request(5, c_get);
+    c.Send(Encode(Data, EndStream, 5, "x"));
+    if (!Reset(c, 5, StreamClosed)) {
+        return Fail("DATA on half-closed stream isn't reset with STREAM_CLOSED");
+    }
+
+    std::string block; // request with body and trailers
+    c.encoder.Encode(c_get, block);
+    c.Send(Encode(Headers, EndHeaders, 7, block) + Encode(Data, 0, 7, "body"));
+    std::string trailers;
+    c.encoder.Encode({ { "x-checksum", "1" } }, trailers);
+    c.Send(Encode(Headers, EndHeaders | EndStream, 7, trailers));
+    for (const auto &f : c.Read()) {
+        if (f.type == RstStream) {
+            return Fail("trailers are reset");
+        }
+    }
+    c.Respond(3, "HTTP/1.1 204 No Content\r\n\r\n");
+    const auto frames = c.Read();
+    if ((frames.size() != 1) || (frames[0].type != Headers) || (frames[0].id != 7)) {
+        return Fail("response to stream with trailers expected");
+    }
+    c.Send(Encode(Headers, EndHeaders, 9, block));
+    c.encoder.Encode({ { "x-checksum", "1" } }, trailers);
+    c.Send(Encode(Headers, EndHeaders, 9, trailers)); // trailers have to end the stream
+    if (!Reset(c, 9, ProtocolError)) {
+        return Fail("trailers without END_STREAM aren't reset with PROTOCOL_ERROR");
+    }
+    return (c.GoAwayCode() < 0) ? true : Fail("connection is closed");
+}
+
+bool Refusal()
+{
+    Client c;
+    c.Connect();
+    for (uint32_t i = 0; i < Http2Session::c_max_streams; ++i) {
+        c.Request(1 + 2 * i, c_get);
+    }
+    c.Request(1 + 2 * Http2Session::c_max_streams, c_get); // one too many
+    auto frames = c.Read();
+    if ((c.requests.size() != Http2Session::c_max_streams) || (frames.size() != 1) || (frames[0].type != RstStream) || (Get32(frames[0].payload) != RefusedStream)) {
+        return Fail("stream beyond the limit isn't refused");
+    }
+    c.Send(Encode(RstStream, 0, 1, Put32(0x8))); // reset stream still counts until it's served
+    c.Request(3 + 2 * Http2Session::c_max_streams, c_get);
+    frames = c.Read();
+    if ((frames.size() != 1) || (frames[0].type != RstStream) || (Get32(frames[0].payload) != RefusedStream)) {
+        return Fail("reset stream doesn't count until it's served");
+    }
+    c.Respond(0, "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\nx"); // nothing is sent for the reset stream, which is dropped now
+    if (!c.Read().empty()) {
+        return Fail("response to reset stream is sent");
+    }
+    c.Request(5 + 2 * Http2Session::c_max_streams, c_get);
+    if (c.requests.size() != Http2Session::c_max_streams + 1) {
+        return Fail("stream isn't accepted once reset one is served");
+    }
+
+    Client overloaded;
+    overloaded.Connect();
+    overloaded.refuse = true;
+    overloaded.Request(1, c_get);
+    frames = overloaded.Read();
+    if ((frames.size() != 1) || (frames[0].type != RstStream) || (Get32(frames[0].payload) != RefusedStream)) {
+        return Fail("stream refused by handler isn't reset with REFUSED_STREAM");
+    }
+    return true;
+}
+
+bool RapidReset()
+{
+    Client c;
+    c.Connect();
+    uint32_t id = 1;
+    for (size_t i = 0; i <= Http2Session::c_max_resets; ++i, id += 2) { // requests are never served meanwhile
+        c.Request(id, c_get);
+        c.Send(Encode(RstStream, 0, id, Put32(0x8)));
+    }
+    if (c.GoAwayCode() != EnhanceYourCalm) {
+        return Fail("GOAWAY with ENHANCE_YOUR_CALM expected");
+    }
+    Client fair; // resets are fine as long as most of the streams aren't reset
+    fair.Connect();
+    id = 1;
+    for (size_t i = 0; i < 3 * (Http2Session::c_max_resets + 1); ++i, id += 2) { // one of three is reset before it's served
+        fair.Request(id, c_get);
+        if (i % 3 == 0) {
+            fair.Send(Encode(RstStream, 0, id, Put32(0x8)));
+        }
+        fair.Respond(fair.requests.size() - 1, "HTTP/1.1 204 No Content\r\n\r\n");
+    }
+    return (fair.GoAwayCode() < 0) ? true : Fail("connection with some resets is closed");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const Check checks[] = {
+        { "hpack literal fields (C.2)", LiteralFields },
+        { "hpack requests (C.3)", Requests },
+        { "hpack requests with huffman (C.4)", HuffmanRequests },
+        { "hpack responses (C.5)", Responses },
+        { "hpack responses with huffman (C.6)", HuffmanResponses },
+        { "hpack table eviction", Eviction },
+        { "hpack integers", Integers },
+        { "hpack limits", Limits },
+        { "hpack huffman", Huffman },
+        { "hpack encoder round trip", EncoderRoundTrip },
+        { "hpack encoder size updates", EncoderSizeUpdates },
+        { "h2 preface", Preface },
+        { "h2 translation", Translation },
+        { "h2 upgrade", Upgrade },
+        { "h2 flow control", FlowControl },
+        { "h2 malformed frames", MalformedFrames },
+        { "h2 stream states", StreamStates },
+        { "h2 refused streams", Refusal },
+        { "h2 rapid reset", RapidReset },
+    };
+    return Checks::Run(argc, argv, checks);
+}
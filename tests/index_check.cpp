@@ -0,0 +1,69 @@
+// Checks request path normalization by 'DocIndex::Normalize': repeated slashes, "." segments, ".." resolved within the docroot
+// and paths climbing above it or not being absolute.
+// Usage: index_check [name_filter]
+
+#include "check.h"
+#include "../src/doc_index.h"
+
+#include <string>
+
+namespace {
+
+using Checks::Check;
+using Checks::Fail;
+using Http::DocIndex;
+
+struct NormalizeCase
+{
+    const char *path;
+    bool ok;         // 'false' if the path is to be rejected
+    const char *res; // normalized path, if accepted
+};
+
+const NormalizeCase c_normalize_cases[] = {
+    { "/", true, "/" },
+    { "/a.txt", true, "/a.txt" },
+    { "//sub//a.txt", true, "/sub/a.txt" },
+    { "/./sub/./a.txt", true, "/sub/a.txt" },
+    { "/sub/", true, "/sub" },
+    // ".." within the root
+    { "/sub2/../a.txt", true, "/a.txt" },
+    { "/sub/dir/../../a.txt", true, "/a.txt" },
+    { "/sub/dir/..", true, "/sub" },
+    { "/sub/..", true, "/" },
+    { "/sub/.../a.txt", true, "/sub/.../a.txt" },
+    { "/sub/..a/a.txt", true, "/sub/..a/a.txt" },
+    // above the root
+    { "/..", false, "" },
+    { "/../a.txt", false, "" },
+    { "/sub/../../a.txt", false, "" },
+    { "/./../a.txt", false, "" },
+    // not absolute
+    { "", false, "" },
+    { "a.txt", false, "" },
+};
+
+bool Normalize()
+{
+    for (const auto &c : c_normalize_cases) {
+        std::string res;
+        const bool ok = DocIndex::Normalize(c.path, res);
+        if (ok != c.ok) {
+            return Fail(ok ? "accepted" : "rejected", c.path);
+        }
+        if (ok && (res != c.res)) {
+            return Fail("normalized", std::string(c.path) + " -> " + res + ", expected " + c.res);
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const Check checks[] = {
+        { "path normalization", Normalize },
+    };
+    return Checks::Run(argc, argv, checks);
+}
@@ -0,0 +1,339 @@
+// Checks byte ranges: parsing of 'Range' header values by 'ByteRange::Parse' (suffix and open-ended ranges, merging of overlapping ones,
+// unsatisfiable sets, whitespace and case, malformed values) and '206 Partial Content' / '416 Range Not Satisfiable' responses read back over a socketpair.
+// Usage: range_check [name_filter]
+
+#include "check.h"
+#include "../src/http_response.h"
+#include "../src/io.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Checks::Check;
+using Checks::Fail;
+using Http::ByteRange;
+using Http::Response;
+
+const off_t c_size = 1000; // of the body ranges are taken from
+
+std::string Str(const std::vector<ByteRange> &ranges) // e.g. "0-9,20-29"
+{
+    std::string res;
+    for (const auto &r : ranges) {
+        res += (res.empty() ? "" : ",") + std::to_string(r.first) + "-" + std::to_string(r.last);
+    }
+    return res;
+}
+
+struct ParseCase
+{
+    const char *spec;
+    off_t size;
+    bool ok;           // 'false' if the header is to be ignored
+    const char *ranges; // satisfiable ones as sent, empty if none is
+};
+
+const ParseCase c_parse_cases[] = {
+    { "bytes=0-99", c_size, true, "0-99" },
+    { "bytes=0-0", c_size, true, "0-0" },
+    { "bytes=999-999", c_size, true, "999-999" },
+    // suffix
+    { "bytes=-100", c_size, true, "900-999" },
+    { "bytes=-1", c_size, true, "999-999" },
+    { "bytes=-1000", c_size, true, "0-999" },
+    { "bytes=-5000", c_size, true, "0-999" },
+    { "bytes=-0", c_size, true, "" },
+    { "bytes=-5", 0, true, "" },
+    // open-ended and beyond the end
+    { "bytes=900-", c_size, true, "900-999" },
+    { "bytes=0-", c_size, true, "0-999" },
+    { "bytes=500-5000", c_size, true, "500-999" },
+    { "bytes=999-", c_size, true, "999-999" },
+    // unsatisfiable sets
+    { "bytes=1000-", c_size, true, "" },
+    { "bytes=1000-1100", c_size, true, "" },
+    { "bytes=1000-1100,2000-,-0", c_size, true, "" },
+    { "bytes=0-", 0, true, "" },
+    { "bytes=0-99,1000-1100", c_size, true, "0-99" },
+    // overlapping, adjacent and unordered sets
+    { "bytes=0-99,50-149", c_size, true, "0-149" },
+    { "bytes=0-99,100-199", c_size, true, "0-199" },
+    { "bytes=0-99,101-199", c_size, true, "0-99,101-199" },
+    { "bytes=200-299,0-99", c_size, true, "0-99,200-299" },
+    { "bytes=0-999,10-20", c_size, true, "0-999" },
+    { "bytes=-100,0-0", c_size, true, "0-0,900-999" },
+    { "bytes=950-,-100", c_size, true, "900-999" },
+    { "bytes=0-1,2-3,4-5,6-7", c_size, true, "0-7" },
+    // whitespace, case and empty list elements
+    { " bytes = 0-9 , 20-29 ", c_size, true, "0-9,20-29" },
+    { "bytes=\t0-9\t", c_size, true, "0-9" },
+    { "BYTES=0-9", c_size, true, "0-9" },
+    { "Bytes=-10", c_size, true, "990-999" },
+    { "bytes=,0-9,,20-29,", c_size, true, "0-9,20-29" },
+    // malformed ones are ignored
+    { "bytes=5-4", c_size, false, "" },
+    { "bytes=", c_size, false, "" },
+    { "bytes=,", c_size, false, "" },
+    { "bytes=-", c_size, false, "" },
+    { "bytes=abc", c_size, false, "" },
+    { "bytes=0-9;x", c_size, false, "" },
+    { "bytes=0-9-", c_size, false, "" },
+    { "bytes=0 -9", c_size, false, "" },
+    { "bytes=0-9 20-29", c_size, false, "" },
+    { "bytes 0-9", c_size, false, "" },
+    { "byte=0-9", c_size, false, "" },
+    { "items=0-9", c_size, false, "" },
+    { "bytes=99999999999999999999-", c_size, false, "" },
+    { "", c_size, false, "" },
+};
+
+bool Parse()
+{
+    bool ok = true;
+    for (const auto &c : c_parse_cases) {
+        std::vector<ByteRange> ranges;
+        const bool res = ByteRange::Parse(c.spec, c.size, ranges);
+        if ((res != c.ok) || (Str(ranges) != c.ranges)) {
+            ok = Fail(("\"" + std::string(c.spec) + "\" of " + std::to_string(c.size)).c_str(),
+                      std::string(res ? "accepted" : "ignored") + " '" + Str(ranges) + "', expected " + (c.ok ? "accepted" : "ignored") + " '" + c.ranges + "'");
+        }
+    }
+    return ok;
+}
+
+std::string RangeList(int n) // "bytes=0-0,2-2,..." of 'n' disjoint ranges
+{
+    std::string res = "bytes=";
+    for (int i = 0; i < n; ++i) {
+        res += (i ? "," : "") + std::to_string(2 * i) + "-" + std::to_string(2 * i);
+    }
+    return res;
+}
+
+bool Limit()
+{
+    std::vector<ByteRange> ranges;
+    if (!ByteRange::Parse(RangeList(ByteRange::c_max_ranges), c_size, ranges) || (ranges.size() != ByteRange::c_max_ranges)) {
+        return Fail("ranges up to the limit", Str(ranges));
+    }
+    ranges.clear();
+    if (ByteRange::Parse(RangeList(ByteRange::c_max_ranges + 1), c_size, ranges) || !ranges.empty()) {
+        return Fail("ranges beyond the limit are to be ignored", Str(ranges));
+    }
+    ranges.clear();
+    if (ByteRange::Parse(RangeList(ByteRange::c_max_ranges) + ",5000-", c_size, ranges)) {
+        return Fail("unsatisfiable ranges count towards the limit");
+    }
+    return true;
+}
+
+// response written to a socketpair by a queue, split into its head and body
+struct Sent
+{
+    std::string head;
+    std::string body;
+    size_t reported; // by the sending method
+
+    std::string Status() const
+    {
+        return head.substr(0, head.find("\r\n"));
+    }
+
+    std::string Header(const char *name) const // value of the first one, case-insensitive
+    {
+        const size_t len = strlen(name);
+        for (size_t p = head.find("\r\n"); p != std::string::npos; p = head.find("\r\n", p + 2)) {
+            const char *line = head.c_str() + p + 2;
+            if ((strncasecmp(line, name, len) == 0) && (line[len] == ':')) {
+                const size_t begin = p + 2 + len + 2;
+                return head.substr(begin, head.find("\r\n", begin) - begin);
+            }
+        }
+        return std::string();
+    }
+};
+
+// body file of 'c_size' printable bytes repeating every 95 ones
+class Fixture
+{
+public:
+    Fixture()
+    {
+        char path[] = "/tmp/range_check_XXXXXX";
+        const int fd = mkstemp(path);
+        for (off_t i = 0; i < c_size; ++i) {
+            data += char(' ' + i % 95);
+        }
+        if ((fd < 0) || (write(fd, data.data(), data.size()) != ssize_t(data.size()))) {
+            perror("range_check file");
+            exit(1);
+        }
+        close(fd);
+        body.file = std::make_shared<IO::File>(path);
+        unlink(path);
+    }
+
+    template <typename F>
+    bool Send(F send, Sent &sent) const // 'send(out)' queues the response, 'false' if it isn't read back whole
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0) {
+            perror("socketpair");
+            exit(1);
+        }
+        std::string res;
+        {
+            IO::Socket s(fds[0]);
+            IO::OutQueue out(s, 1 << 20);
+            sent.reported = send(out);
+            char buf[4096];
+            for (ssize_t n; (n = read(fds[1], buf, sizeof(buf))) > 0; ) {
+                res.append(buf, n);
+            }
+        }
+        close(fds[1]);
+        const size_t end = res.find("\r\n\r\n");
+        if ((end == std::string::npos) || (res.size() != sent.reported)) {
+            return Fail("response", std::to_string(res.size()) + " bytes read of " + std::to_string(sent.reported) + " reported");
+        }
+        sent.head = res.substr(0, end + 2);
+        sent.body = res.substr(end + 4);
+        if (sent.Header("Content-length") != std::to_string(sent.body.size())) {
+            return Fail("Content-length", sent.Header("Content-length") + " of " + std::to_string(sent.body.size()) + " bytes body");
+        }
+        return true;
+    }
+
+    std::string data;
+    Response::Body body;
+};
+
+bool SingleRange()
+{
+    const Fixture f;
+    const struct { const char *spec; const char *content_range; off_t first; size_t len; } cases[] = {
+        { "bytes=0-99", "bytes 0-99/1000", 0, 100 },
+        { "bytes=-100", "bytes 900-999/1000", 900, 100 },
+        { "bytes=990-", "bytes 990-999/1000", 990, 10 },
+        { "bytes=500-5000", "bytes 500-999/1000", 500, 500 },
+        { "bytes=10-19,15-29", "bytes 10-29/1000", 10, 20 },
+    };
+    for (const auto &c : cases) {
+        std::vector<ByteRange> ranges;
+        if (!ByteRange::Parse(c.spec, c_size, ranges)) {
+            return Fail(c.spec, "not parsed");
+        }
+        Sent sent;
+        if (!f.Send([&](IO::OutQueue &out) { return Response::SendRanges(out, "text/plain", f.body, ranges, "X-Meta: 1\r\n"); }, sent)) {
+            return Fail(c.spec);
+        }
+        if (sent.Status() != "HTTP/1.1 206 Partial Content") {
+            return Fail(c.spec, sent.Status());
+        }
+        if (sent.Header("Content-Range") != c.content_range) {
+            return Fail(c.spec, "Content-Range: " + sent.Header("Content-Range"));
+        }
+        if ((sent.Header("Content-type") != "text/plain") || (sent.Header("Accept-Ranges") != "bytes") || (sent.Header("X-Meta") != "1")) {
+            return Fail(c.spec, "headers " + sent.head);
+        }
+        if (sent.body != f.data.substr(c.first, c.len)) {
+            return Fail(c.spec, "body " + sent.body);
+        }
+    }
+    return true;
+}
+
+bool MultipleRanges()
+{
+    const Fixture f;
+    std::vector<ByteRange> ranges;
+    if (!ByteRange::Parse("bytes=-10, 0-9, 5-19, 500-509", c_size, ranges) || (Str(ranges) != "0-19,500-509,990-999")) {
+        return Fail("parsed", Str(ranges));
+    }
+    Sent sent;
+    if (!f.Send([&](IO::OutQueue &out) { return Response::SendRanges(out, "text/html", f.body, ranges, std::string()); }, sent)) {
+        return false;
+    }
+    if (sent.Status() != "HTTP/1.1 206 Partial Content") {
+        return Fail("status", sent.Status());
+    }
+    if (!sent.Header("Content-Range").empty()) {
+        return Fail("Content-Range of the whole multipart response", sent.Header("Content-Range"));
+    }
+    const std::string type = sent.Header("Content-type");
+    const std::string prefix = "multipart/byteranges; boundary=";
+    if ((type.compare(0, prefix.size(), prefix) != 0) || (type.size() == prefix.size())) {
+        return Fail("Content-type", type);
+    }
+    const std::string boundary = type.substr(prefix.size());
+    std::string expected;
+    for (const auto &r : ranges) {
+        expected += "\r\n--" + boundary + "\r\nContent-type: text/html\r\nContent-Range: bytes " + std::to_string(r.first) + "-" + std::to_string(r.last) +
+                    "/1000\r\n\r\n" + f.data.substr(r.first, r.Len());
+    }
+    expected += "\r\n--" + boundary + "--\r\n";
+    if (sent.body != expected) {
+        return Fail("body", sent.body);
+    }
+
+    Sent other;
+    if (!f.Send([&](IO::OutQueue &out) { return Response::SendRanges(out, "text/html", f.body, ranges, std::string()); }, other)) {
+        return false;
+    }
+    if (other.Header("Content-type") == type) {
+        return Fail("boundary is reused", type);
+    }
+    return true;
+}
+
+bool NotSatisfiable()
+{
+    const Fixture f;
+    for (const char *spec : { "bytes=1000-", "bytes=-0", "bytes=2000-3000,1000-" }) {
+        std::vector<ByteRange> ranges;
+        if (!ByteRange::Parse(spec, c_size, ranges) || !ranges.empty()) {
+            return Fail(spec, "expected to be unsatisfiable, got '" + Str(ranges) + "'");
+        }
+    }
+    for (const off_t size : { c_size, off_t(0), off_t(1) << 40 }) {
+        Sent sent;
+        if (!f.Send([&](IO::OutQueue &out) { return Response::SendRangeNotSatisfiable(out, size); }, sent)) {
+            return false;
+        }
+        if (sent.Status() != "HTTP/1.1 416 Range Not Satisfiable") {
+            return Fail("status", sent.Status());
+        }
+        if (sent.Header("Content-Range") != "bytes */" + std::to_string(size)) {
+            return Fail("Content-Range", sent.Header("Content-Range"));
+        }
+        if (sent.Header("Content-type") != "text/plain") {
+            return Fail("Content-type", sent.Header("Content-type"));
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const Check checks[] = {
+        { "range parsing", Parse },
+        { "range count limit", Limit },
+        { "206 single range", SingleRange },
+        { "206 multiple ranges", MultipleRanges },
+        { "416 range not satisfiable", NotSatisfiable },
+    };
+    return Checks::Run(argc, argv, checks);
+}
@@ -0,0 +1,191 @@
+// Checks precompressed sidecars through a server running in this process: a '.gz' sidecar requested directly is sent as it is
+// (no 'Content-Encoding', its own type), served as 'Content-Encoding: gzip' of the requested file when negotiated, whichever of them comes first.
+// Usage: sidecar_check [name_filter]
+
+#include "check.h"
+#include "../src/http_server.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Checks::Check;
+using Checks::Fail;
+
+const char *c_css = "body { color: black; }\n";
+const char *c_gz = "\x1f\x8b sidecar bytes"; // not inflated by the server, so anything marked as gzip does
+
+std::string dir;
+unsigned short port;
+
+void Write(const std::string &name, const char *data)
+{
+    FILE *f = fopen((dir + "/" + name).c_str(), "wb");
+    if (!f || (fwrite(data, 1, strlen(data), f) != strlen(data))) {
+        perror("sidecar_check file");
+        exit(1);
+    }
+    fclose(f);
+}
+
+// response to a single request on a connection of its own
+struct Received
+{
+    std::string head;
+    std::string body;
+
+    std::string Header(const char *name) const // value of the first one, case-insensitive
+    {
+        const size_t len = strlen(name);
+        for (size_t p = head.find("\r\n"); p != std::string::npos; p = head.find("\r\n", p + 2)) {
+            const char *line = head.c_str() + p + 2;
+            if ((strncasecmp(line, name, len) == 0) && (line[len] == ':')) {
+                const size_t begin = p + 2 + len + 2;
+                return head.substr(begin, head.find("\r\n", begin) - begin);
+            }
+        }
+        return std::string();
+    }
+};
+
+bool Get(const std::string &path, const char *accept_encoding, Received &res)
+{
+    const int s = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((s < 0) || (connect(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)) {
+        perror("sidecar_check connect");
+        exit(1);
+    }
+    std::string req = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n";
+    if (accept_encoding) {
+        req += std::string("Accept-Encoding: ") + accept_encoding + "\r\n";
+    }
+    req += "\r\n";
+    if (write(s, req.data(), req.size()) != ssize_t(req.size())) {
+        close(s);
+        return Fail("request", path);
+    }
+    std::string raw;
+    char buf[4096];
+    size_t end = std::string::npos;
+    for (ssize_t n; (n = read(s, buf, sizeof(buf))) > 0; ) { // connection is kept alive, so the response is read up to its length
+        raw.append(buf, n);
+        end = raw.find("\r\n\r\n");
+        if (end != std::string::npos) {
+            res.head = raw.substr(0, end + 2);
+            if (raw.size() >= end + 4 + strtoul(res.Header("Content-length").c_str(), nullptr, 10)) {
+                break;
+            }
+        }
+    }
+    close(s);
+    if (end == std::string::npos) {
+        return Fail("response", path);
+    }
+    res.body = raw.substr(end + 4);
+    if (res.head.compare(0, 15, "HTTP/1.1 200 OK") != 0) {
+        return Fail("status", path + ": " + res.head.substr(0, res.head.find("\r\n")));
+    }
+    return true;
+}
+
+bool Direct(const std::string &name) // sidecar requested as a file of its own
+{
+    Received r;
+    if (!Get("/" + name + ".gz", "gzip", r)) {
+        return false;
+    }
+    if (!r.Header("Content-Encoding").empty() || (r.Header("Content-type") != "application/gzip") || (r.body != c_gz)) {
+        return Fail("direct", r.head);
+    }
+    return true;
+}
+
+bool Negotiated(const std::string &name) // sidecar served for the file it was compressed from
+{
+    Received r;
+    if (!Get("/" + name, "gzip", r)) {
+        return false;
+    }
+    if ((r.Header("Content-Encoding") != "gzip") || (r.Header("Content-type") != "text/css") || (r.body != c_gz)) {
+        return Fail("negotiated", r.head);
+    }
+    return true;
+}
+
+bool Identity(const std::string &name) // file itself for clients not accepting gzip
+{
+    Received r;
+    if (!Get("/" + name, nullptr, r)) {
+        return false;
+    }
+    if (!r.Header("Content-Encoding").empty() || (r.body != c_css)) {
+        return Fail("identity", r.head);
+    }
+    return true;
+}
+
+bool DirectFirst()
+{
+    return Direct("a.css") && Negotiated("a.css") && Identity("a.css") && Direct("a.css");
+}
+
+bool NegotiatedFirst()
+{
+    return Negotiated("b.css") && Direct("b.css") && Identity("b.css") && Negotiated("b.css");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    char tmp[] = "/tmp/sidecar_check_XXXXXX";
+    if (!mkdtemp(tmp)) {
+        perror("sidecar_check dir");
+        return 1;
+    }
+    dir = tmp;
+    for (const char *name : { "a.css", "b.css" }) { // sidecars are written last, as older ones are ignored
+        Write(name, c_css);
+        Write(std::string(name) + ".gz", c_gz);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    Http::Config cfg;
+    cfg.stats_path.clear();
+    Http::Server *server = nullptr;
+    for (port = 20000 + getpid() % 20000; !server; ++port) { // first free port
+        try {
+            server = new Http::Server("127.0.0.1", port, dir, cfg);
+        } catch (const Http::Error &) {
+        }
+    }
+    --port;
+    std::thread([server]() { server->Run(); }).detach(); // server never stops, so the process exits past it
+
+    const Check checks[] = {
+        { "sidecar requested, then negotiated", DirectFirst },
+        { "sidecar negotiated, then requested", NegotiatedFirst },
+    };
+    const int res = Checks::Run(argc, argv, checks);
+    for (const char *name : { "a.css", "a.css.gz", "b.css", "b.css.gz" }) {
+        unlink((dir + "/" + name).c_str());
+    }
+    rmdir(tmp);
+    fflush(stdout);
+    _exit(res); // without destroying the running server
+}